@@ -0,0 +1,213 @@
+#include "applyjournal.h"
+#include "platform/platform.h"
+
+#include <QDebug>
+#include <QFileInfo>
+
+static const int kBatchRecords = 256;
+
+// Put an applied file back where a re-run will pick it up again. If that fails it is
+// deleted instead and simply staged once more.
+static bool moveBackToStaging(const QString& targetPath, const QString& stagingPath)
+{
+    QDir().mkpath(QFileInfo(stagingPath).absolutePath());
+    return QFile::rename(targetPath, stagingPath) || QFile::remove(targetPath);
+}
+
+ApplyJournal::ApplyJournal(Durability durability)
+    : m_durability(durability)
+{
+}
+
+QString ApplyJournal::pathFor(const QDir& targetDir)
+{
+    QFileInfo target(targetDir.absolutePath());
+    return target.absolutePath() + "/." + target.fileName() + ".apply.journal";
+}
+
+bool ApplyJournal::begin(const QDir& targetDir, const QDir& stagingDir,
+                         const QStringList& updated, const QStringList& added)
+{
+    // A journal that is still there belongs to an apply whose recovery failed; it and
+    // its .bak files are the only way back, so it is never overwritten.
+    m_file.setFileName(pathFor(targetDir));
+    if(!m_file.open(QFile::WriteOnly | QFile::NewOnly))
+    {
+        qWarning() << "Cannot write apply journal:" << m_file.fileName() << m_file.errorString();
+        m_file.setFileName(QString());
+        return false;
+    }
+
+    QByteArray plan;
+    plan += "target " + targetDir.absolutePath().toUtf8() + '\n';
+    plan += "staging " + stagingDir.absolutePath().toUtf8() + '\n';
+    for(const auto& relPath : updated)
+        plan += "update " + relPath.toUtf8() + '\n';
+    for(const auto& relPath : added)
+        plan += "add " + relPath.toUtf8() + '\n';
+    m_file.write(plan);
+
+    // The plan must be on disk before the first rename it describes.
+    append("begin", m_durability != Durability::None);
+    if(m_durability != Durability::None)
+        Platform::syncDirectory(QFileInfo(m_file.fileName()).absolutePath());
+    return true;
+}
+
+void ApplyJournal::backupsDone()
+{
+    append("backed-up", m_durability == Durability::Strict);
+}
+
+void ApplyJournal::applied(const QString& relPath)
+{
+    append("applied " + relPath.toUtf8(),
+           m_durability == Durability::Strict
+               || (m_durability == Durability::Batch && m_unsynced + 1 >= kBatchRecords));
+}
+
+void ApplyJournal::commit()
+{
+    append("commit", m_durability != Durability::None);
+}
+
+void ApplyJournal::finish()
+{
+    if(m_file.fileName().isEmpty())
+        return;
+    m_file.close();
+    QFile::remove(m_file.fileName());
+}
+
+bool ApplyJournal::rollBack(const QDir& targetDir)
+{
+    if(!m_file.isOpen())
+        return false;
+    m_file.close();
+    return recover(targetDir) == Recovery::RolledBack;
+}
+
+void ApplyJournal::append(const QByteArray& record, bool sync)
+{
+    if(!m_file.isOpen())
+        return;
+
+    m_file.write(record + '\n');
+    m_file.flush();
+    ++m_unsynced;
+    if(sync)
+    {
+        Platform::syncFile(m_file.handle());
+        m_unsynced = 0;
+    }
+}
+
+ApplyJournal::Recovery ApplyJournal::recover(const QDir& targetDir)
+{
+    QFile file(pathFor(targetDir));
+    if(!file.exists())
+        return Recovery::None;
+    if(!file.open(QFile::ReadOnly))
+    {
+        qCritical().noquote() << "Cannot read apply journal:" << file.fileName() << file.errorString();
+        return Recovery::Failed;
+    }
+
+    QString stagingPath;
+    QStringList updated, added;
+    bool begun = false;
+    bool committed = false;
+    int appliedCount = 0;
+
+    while(!file.atEnd())
+    {
+        QByteArray line = file.readLine();
+        if(!line.endsWith('\n'))
+            break;  // torn last record
+        line.chop(1);
+
+        qsizetype space = line.indexOf(' ');
+        QByteArray op = space < 0 ? line : line.left(space);
+        QString arg = space < 0 ? QString() : QString::fromUtf8(line.mid(space + 1));
+
+        if(op == "staging")
+            stagingPath = arg;
+        else if(op == "update")
+            updated.append(arg);
+        else if(op == "add")
+            added.append(arg);
+        else if(op == "begin")
+            begun = true;
+        else if(op == "applied")
+            ++appliedCount;
+        else if(op == "commit")
+            committed = true;
+    }
+    file.close();
+
+    // Cut short while the plan was written: nothing in the target was touched yet.
+    if(!begun || stagingPath.isEmpty())
+    {
+        QFile::remove(file.fileName());
+        return Recovery::None;
+    }
+
+    QDir stagingDir(stagingPath);
+    bool ok = true;
+    if(committed)
+    {
+        for(const auto& relPath : updated)
+        {
+            QString bakPath = targetDir.filePath(relPath) + ".bak";
+            if(QFile::exists(bakPath) && !QFile::remove(bakPath))
+                ok = false;
+        }
+        stagingDir.removeRecursively();
+        QFile::remove(stagingDir.absolutePath() + ".journal");
+    }
+    else
+    {
+        // Renames are atomic, so a file is either still in staging or already in the target.
+        for(const auto& relPath : added)
+        {
+            QString targetPath = targetDir.filePath(relPath);
+            QString stagedPath = stagingDir.filePath(relPath);
+            if(QFileInfo::exists(targetPath) && !QFileInfo::exists(stagedPath)
+               && !moveBackToStaging(targetPath, stagedPath))
+                ok = false;
+        }
+        for(const auto& relPath : updated)
+        {
+            QString targetPath = targetDir.filePath(relPath);
+            QString bakPath = targetPath + ".bak";
+            if(!QFile::exists(bakPath))
+                continue;
+            if(QFileInfo::exists(targetPath))
+            {
+                bool moved = QFileInfo::exists(stagingDir.filePath(relPath))
+                                 ? QFile::remove(targetPath)
+                                 : moveBackToStaging(targetPath, stagingDir.filePath(relPath));
+                if(!moved)
+                {
+                    ok = false;
+                    continue;
+                }
+            }
+            if(!QFile::rename(bakPath, targetPath))
+                ok = false;
+        }
+    }
+
+    if(!ok)
+    {
+        qCritical().noquote() << "Could not recover interrupted update of" << targetDir.absolutePath()
+                              << "- see" << file.fileName();
+        return Recovery::Failed;
+    }
+
+    qWarning().noquote() << (committed ? "Completed" : "Rolled back") << "interrupted update of"
+                         << targetDir.absolutePath() << QString("(%1 of %2 files had been applied)")
+                                                            .arg(appliedCount).arg(updated.size() + added.size());
+    QFile::remove(file.fileName());
+    return committed ? Recovery::RolledForward : Recovery::RolledBack;
+}
@@ -0,0 +1,60 @@
+#ifndef APPLYJOURNAL_H
+#define APPLYJOURNAL_H
+
+#include "durability.h"
+
+#include <QDir>
+#include <QFile>
+#include <QString>
+#include <QStringList>
+
+// Write-ahead log of the per-file apply: which files are about to be renamed to .bak
+// and which staged files are about to be moved into the target, followed by what was
+// done and finally a commit once the target verified. It lets the next start of the
+// updater finish or undo an apply that was cut short, touching only the files listed.
+//
+// Format, one record per line:
+//   target <path> / staging <path> / update <relPath> / add <relPath>   the plan
+//   begin                                                             end of the plan
+//   backed-up / applied <relPath>                                     progress
+//   commit                                                            target verified
+class ApplyJournal {
+public:
+    enum class Recovery { None, RolledBack, RolledForward, Failed };
+
+    explicit ApplyJournal(Durability durability = Durability::Batch);
+    ApplyJournal(const ApplyJournal&) = delete;
+    ApplyJournal& operator=(const ApplyJournal&) = delete;
+
+    // Next to the target, so it is neither scanned nor swapped along with it.
+    static QString pathFor(const QDir& targetDir);
+
+    // Write the plan and flush it before anything is touched. Returns false if the
+    // journal cannot be written, the apply is then not crash-safe, or if a journal of
+    // an unrecovered apply exists, which is left as it is.
+    bool begin(const QDir& targetDir, const QDir& stagingDir,
+               const QStringList& updated, const QStringList& added);
+    void backupsDone();
+    void applied(const QString& relPath);
+    void commit();
+    // Delete the journal once the target is consistent again.
+    void finish();
+    // Undo an apply that failed in this process the same way recover() would.
+    // Returns false if nothing was journaled or the rollback did not complete.
+    bool rollBack(const QDir& targetDir);
+
+    // Complete or undo an interrupted apply of targetDir. Without a commit every .bak
+    // file is restored and applied files go back to staging, where a re-run resumes
+    // them; after a commit the leftover backups and staging are removed. The journal
+    // is kept if recovery fails so that the next start tries again.
+    static Recovery recover(const QDir& targetDir);
+
+private:
+    void append(const QByteArray& record, bool sync);
+
+    Durability m_durability;
+    QFile m_file;
+    int m_unsynced = 0;
+};
+
+#endif // APPLYJOURNAL_H
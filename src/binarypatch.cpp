@@ -0,0 +1,365 @@
+#include "binarypatch.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QFile>
+#include <QHash>
+#include <QIODevice>
+#include <QMultiHash>
+#include <QtEndian>
+
+#include <cstring>
+#include <limits>
+
+static const quint32 kPatchMagic = 0x53555054; // "SUPT"
+static const quint32 kPatchFormatVersion = 1;
+static const quint8 kOpCopy = 0;
+static const quint8 kOpInsert = 1;
+static const quint8 kOpEnd = 0xff;
+static const qint64 kMaxIndexedBlocks = 4 * 1024 * 1024;
+static const qint64 kCopyChunkSize = 1024 * 1024;
+static const int kMinBlockSize = 4096;
+static const int kMaxBlockCount = 16384;
+static const int kStrongSumSize = BlockChecksums::kSumSize - 4;
+
+static int chooseBlockSize(qint64 oldSize)
+{
+    int blockSize = 32;
+    while(oldSize / blockSize > kMaxIndexedBlocks)
+        blockSize *= 2;
+    return blockSize;
+}
+
+static void writeInsert(QDataStream& out, const char* data, qint64 length)
+{
+    while(length > 0)
+    {
+        quint32 chunk = static_cast<quint32>(qMin<qint64>(length, std::numeric_limits<qint32>::max()));
+        out << kOpInsert << chunk;
+        out.writeRawData(data, static_cast<int>(chunk));
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+QByteArray createBinaryPatch(const QByteArray& oldData, const QByteArray& newData)
+{
+    QByteArray patch;
+    QDataStream out(&patch, QIODevice::WriteOnly);
+    out << kPatchMagic << kPatchFormatVersion << static_cast<quint64>(newData.size());
+
+    const char* oldBytes = oldData.constData();
+    const char* newBytes = newData.constData();
+    const qint64 oldSize = oldData.size();
+    const qint64 newSize = newData.size();
+    const int blockSize = chooseBlockSize(oldSize);
+
+    // Index block-aligned windows of the old data by weak checksum; first occurrence wins.
+    QHash<quint32, qint64> index;
+    index.reserve(static_cast<qsizetype>(oldSize / blockSize));
+    RollingChecksum rc(blockSize);
+    for(qint64 off = 0; off + blockSize <= oldSize; off += blockSize)
+    {
+        rc.reset(oldBytes + off);
+        if(!index.contains(rc.value()))
+            index.insert(rc.value(), off);
+    }
+
+    qint64 literalStart = 0;
+    qint64 pos = 0;
+    bool rolling = false;
+
+    while(pos + blockSize <= newSize)
+    {
+        if(!rolling)
+        {
+            rc.reset(newBytes + pos);
+            rolling = true;
+        }
+
+        auto hit = index.constFind(rc.value());
+        if(hit != index.constEnd()
+           && std::memcmp(oldBytes + hit.value(), newBytes + pos, blockSize) == 0)
+        {
+            qint64 oldStart = hit.value();
+            qint64 newStart = pos;
+
+            // Grow the match backwards into the pending literal, then forwards.
+            while(newStart > literalStart && oldStart > 0
+                  && oldBytes[oldStart - 1] == newBytes[newStart - 1])
+            {
+                --oldStart;
+                --newStart;
+            }
+            qint64 length = pos + blockSize - newStart;
+            while(newStart + length < newSize && oldStart + length < oldSize
+                  && oldBytes[oldStart + length] == newBytes[newStart + length])
+                ++length;
+
+            writeInsert(out, newBytes + literalStart, newStart - literalStart);
+            while(length > 0)
+            {
+                quint32 chunk = static_cast<quint32>(qMin<qint64>(length, std::numeric_limits<qint32>::max()));
+                out << kOpCopy << static_cast<quint64>(oldStart) << chunk;
+                oldStart += chunk;
+                newStart += chunk;
+                length -= chunk;
+            }
+
+            pos = newStart;
+            literalStart = pos;
+            rolling = false;
+            continue;
+        }
+
+        if(pos + blockSize < newSize)
+            rc.roll(static_cast<uchar>(newBytes[pos]), static_cast<uchar>(newBytes[pos + blockSize]));
+        ++pos;
+    }
+
+    writeInsert(out, newBytes + literalStart, newSize - literalStart);
+    out << kOpEnd;
+    return patch;
+}
+
+bool applyBinaryPatch(const QString& basePath, const QString& patchPath, const QString& outPath)
+{
+    QFile base(basePath);
+    QFile patch(patchPath);
+    QFile output(outPath);
+
+    if(!base.open(QFile::ReadOnly))
+    {
+        qWarning() << "Cannot open patch base" << basePath << ":" << base.errorString();
+        return false;
+    }
+    if(!patch.open(QFile::ReadOnly))
+    {
+        qWarning() << "Cannot open patch" << patchPath << ":" << patch.errorString();
+        return false;
+    }
+    if(!output.open(QFile::WriteOnly | QFile::Truncate))
+    {
+        qWarning() << "Cannot write patched file" << outPath << ":" << output.errorString();
+        return false;
+    }
+
+    auto fail = [&](const char* reason) {
+        qWarning() << "Cannot apply patch" << patchPath << "to" << basePath << ":" << reason;
+        output.close();
+        QFile::remove(outPath);
+        return false;
+    };
+
+    QDataStream in(&patch);
+    quint32 magic = 0;
+    quint32 version = 0;
+    quint64 newSize = 0;
+    in >> magic >> version >> newSize;
+    if(magic != kPatchMagic || version != kPatchFormatVersion)
+        return fail("not a patch file");
+
+    // Every length comes from the patch, so none is trusted beyond what is still missing
+    // of newSize: a bad patch can neither allocate nor write more than the result.
+    quint64 written = 0;
+    QByteArray buffer;
+    while(true)
+    {
+        quint8 op = kOpEnd;
+        in >> op;
+        if(in.status() != QDataStream::Ok)
+            return fail("truncated patch");
+
+        if(op == kOpEnd)
+            break;
+
+        if(op == kOpCopy)
+        {
+            quint64 offset = 0;
+            quint32 length = 0;
+            in >> offset >> length;
+            if(in.status() != QDataStream::Ok)
+                return fail("truncated patch");
+            if(length > newSize - written)
+                return fail("patch writes past the recorded size");
+            const quint64 baseSize = static_cast<quint64>(base.size());
+            if(offset > baseSize || length > baseSize - offset || !base.seek(static_cast<qint64>(offset)))
+                return fail("copy range outside base file");
+
+            qint64 remaining = length;
+            while(remaining > 0)
+            {
+                buffer = base.read(qMin(remaining, kCopyChunkSize));
+                if(buffer.isEmpty() || output.write(buffer) != buffer.size())
+                    return fail("I/O error");
+                remaining -= buffer.size();
+            }
+            written += length;
+        }
+        else if(op == kOpInsert)
+        {
+            quint32 length = 0;
+            in >> length;
+            if(in.status() != QDataStream::Ok)
+                return fail("truncated patch");
+            if(length > newSize - written)
+                return fail("patch writes past the recorded size");
+
+            qint64 remaining = length;
+            while(remaining > 0)
+            {
+                int chunk = static_cast<int>(qMin(remaining, kCopyChunkSize));
+                buffer.resize(chunk);
+                if(in.readRawData(buffer.data(), chunk) != chunk)
+                    return fail("truncated patch");
+                if(output.write(buffer) != buffer.size())
+                    return fail("I/O error");
+                remaining -= chunk;
+            }
+            written += length;
+        }
+        else
+        {
+            return fail("unknown patch operation");
+        }
+    }
+
+    if(written != newSize)
+        return fail("size mismatch");
+
+    output.close();
+    return true;
+}
+
+int blockSizeFor(qint64 fileSize)
+{
+    int blockSize = kMinBlockSize;
+    while(fileSize / blockSize > kMaxBlockCount)
+        blockSize *= 2;
+    return blockSize;
+}
+
+static QByteArray strongSum(const uchar* data, int length)
+{
+    return QCryptographicHash::hash(QByteArrayView(data, length), QCryptographicHash::Sha256)
+        .left(kStrongSumSize);
+}
+
+std::optional<BlockChecksums> computeBlockChecksums(const QString& path, int blockSize)
+{
+    QFile file(path);
+    if(blockSize <= 0 || !file.open(QFile::ReadOnly))
+    {
+        qWarning() << "Cannot compute block checksums for" << path << ":" << file.errorString();
+        return std::nullopt;
+    }
+
+    BlockChecksums result;
+    result.blockSize = blockSize;
+    result.fileSize = file.size();
+    result.sums.reserve(static_cast<qsizetype>((result.fileSize / blockSize + 1) * BlockChecksums::kSumSize));
+
+    RollingChecksum rc(blockSize);
+    QByteArray block;
+    while(!(block = file.read(blockSize)).isEmpty())
+    {
+        if(block.size() < blockSize)
+            block.append(QByteArray(blockSize - block.size(), '\0'));
+        rc.reset(block.constData());
+        uchar weak[4];
+        qToBigEndian(rc.value(), weak);
+        result.sums.append(reinterpret_cast<const char*>(weak), 4);
+        result.sums.append(strongSum(reinterpret_cast<const uchar*>(block.constData()), blockSize));
+    }
+
+    if(file.error() != QFile::NoError)
+    {
+        qWarning() << "Error reading" << path << ":" << file.errorString();
+        return std::nullopt;
+    }
+    return result;
+}
+
+QList<qint64> matchBlocks(const BlockChecksums& sums, const QString& localPath)
+{
+    const int blockCount = sums.blockCount();
+    const int blockSize = sums.blockSize;
+    QList<qint64> matches(blockCount, -1);
+
+    // Only full blocks can be matched; a short tail block is always fetched.
+    int fullBlocks = static_cast<int>(qMin<qint64>(blockCount, blockSize > 0 ? sums.fileSize / blockSize : 0));
+    if(fullBlocks == 0)
+        return matches;
+
+    QFile file(localPath);
+    if(!file.open(QFile::ReadOnly))
+        return matches;
+
+    const qint64 size = file.size();
+    if(size < blockSize)
+        return matches;
+
+    QByteArray fallback;
+    const uchar* data = file.map(0, size);
+    if(!data)
+    {
+        fallback = file.readAll();
+        data = reinterpret_cast<const uchar*>(fallback.constData());
+    }
+
+    auto weakAt = [&](int block) {
+        return qFromBigEndian<quint32>(sums.sums.constData() + block * BlockChecksums::kSumSize);
+    };
+    auto strongAt = [&](int block) {
+        return QByteArrayView(sums.sums.constData() + block * BlockChecksums::kSumSize + 4, kStrongSumSize);
+    };
+
+    QMultiHash<quint32, int> index;
+    index.reserve(fullBlocks);
+    for(int block = 0; block < fullBlocks; ++block)
+        index.insert(weakAt(block), block);
+
+    int remaining = fullBlocks;
+    RollingChecksum rc(blockSize);
+    qint64 pos = 0;
+    bool rolling = false;
+
+    while(pos + blockSize <= size && remaining > 0)
+    {
+        if(!rolling)
+        {
+            rc.reset(reinterpret_cast<const char*>(data + pos));
+            rolling = true;
+        }
+
+        bool matched = false;
+        const quint32 weak = rc.value();
+        auto it = index.constFind(weak);
+        if(it != index.constEnd())
+        {
+            QByteArray strong = strongSum(data + pos, blockSize);
+            for(; it != index.constEnd() && it.key() == weak; ++it)
+            {
+                if(matches[it.value()] < 0 && strongAt(it.value()) == strong)
+                {
+                    matches[it.value()] = pos;
+                    --remaining;
+                    matched = true;
+                }
+            }
+        }
+
+        if(matched)
+        {
+            pos += blockSize;
+            rolling = false;
+            continue;
+        }
+
+        if(pos + blockSize < size)
+            rc.roll(data[pos], data[pos + blockSize]);
+        ++pos;
+    }
+
+    return matches;
+}
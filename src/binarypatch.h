@@ -0,0 +1,69 @@
+#ifndef BINARYPATCH_H
+#define BINARYPATCH_H
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+#include <optional>
+
+// rsync-style weak checksum over a fixed window that can be rolled one byte at a time.
+class RollingChecksum {
+public:
+    explicit RollingChecksum(int windowSize) : m_window(windowSize) {}
+
+    void reset(const char* data)
+    {
+        m_a = 0;
+        m_b = 0;
+        for(int i = 0; i < m_window; ++i)
+        {
+            m_a += static_cast<uchar>(data[i]);
+            m_b += static_cast<quint32>(m_window - i) * static_cast<uchar>(data[i]);
+        }
+    }
+
+    void roll(uchar out, uchar in)
+    {
+        m_a += in - out;
+        m_b += m_a - static_cast<quint32>(m_window) * out;
+    }
+
+    quint32 value() const { return (m_b << 16) | (m_a & 0xffff); }
+    int windowSize() const { return m_window; }
+
+private:
+    int m_window;
+    quint32 m_a = 0;
+    quint32 m_b = 0;
+};
+
+// zsync-style per-block checksums of a file: for every blockSize chunk, a 4-byte weak
+// rolling checksum (big-endian) followed by the first 16 bytes of its SHA-256.
+struct BlockChecksums {
+    static constexpr int kSumSize = 20;
+
+    int blockSize = 0;
+    qint64 fileSize = 0;
+    QByteArray sums;
+
+    int blockCount() const { return blockSize > 0 ? static_cast<int>(sums.size() / kSumSize) : 0; }
+};
+
+// Pick a block size that keeps the checksum table for fileSize reasonably small.
+int blockSizeFor(qint64 fileSize);
+
+// Compute block checksums of the file at path. Returns nullopt if it cannot be read.
+std::optional<BlockChecksums> computeBlockChecksums(const QString& path, int blockSize);
+
+// For every full block described by sums, find an offset in localPath with identical
+// content. Returns one entry per block: the local offset, or -1 if the block must be fetched.
+QList<qint64> matchBlocks(const BlockChecksums& sums, const QString& localPath);
+
+// Create a patch that rebuilds newData from oldData (COPY ranges of old + INSERT literals).
+QByteArray createBinaryPatch(const QByteArray& oldData, const QByteArray& newData);
+
+// Rebuild outPath from basePath plus the patch at patchPath. Returns false on a malformed
+// patch, a base that is too short, or any I/O error; outPath is removed in that case.
+bool applyBinaryPatch(const QString& basePath, const QString& patchPath, const QString& outPath);
+
+#endif // BINARYPATCH_H
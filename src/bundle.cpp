@@ -0,0 +1,304 @@
+#include "bundle.h"
+#include "manifest.h"
+
+#include <QDebug>
+#include <QFileInfo>
+#include <QtEndian>
+#include <limits>
+
+static const char kMagic[8] = {'S', 'U', 'B', 'U', 'N', 'D', 'L', 'E'};
+static const quint32 kFormatVersion = 1;
+static const int kIndexRecordSize = 32;
+
+static quint16 read16(const uchar* p) { return qFromLittleEndian<quint16>(p); }
+static quint32 read32(const uchar* p) { return qFromLittleEndian<quint32>(p); }
+static quint64 read64(const uchar* p) { return qFromLittleEndian<quint64>(p); }
+
+template<typename T>
+static void append(QByteArray& out, T value)
+{
+    char buf[sizeof(T)];
+    qToLittleEndian(value, buf);
+    out.append(buf, sizeof(T));
+}
+
+static bool fail(QString* error, const QString& message)
+{
+    if(error)
+        *error = message;
+    return false;
+}
+
+// Rejects names that would escape the extraction directory.
+static bool isSafeName(const QString& name)
+{
+    if(name.isEmpty() || name.startsWith('/') || name.contains(':') || name.contains('\\'))
+        return false;
+    for(const auto& part : name.split('/'))
+    {
+        if(part.isEmpty() || part == "." || part == "..")
+            return false;
+    }
+    return true;
+}
+
+std::optional<Bundle::Header> Bundle::parseHeader(const QByteArray& data)
+{
+    if(data.size() < kHeaderSize || !data.startsWith(QByteArray(kMagic, sizeof(kMagic))))
+        return std::nullopt;
+    const uchar* p = reinterpret_cast<const uchar*>(data.constData());
+    if(read32(p + 8) != kFormatVersion)
+        return std::nullopt;
+
+    Header header;
+    header.entryCount = read32(p + 12);
+    quint64 manifestOffset = read64(p + 16);
+    quint64 manifestSize = read64(p + 24);
+    quint64 indexOffset = read64(p + 32);
+    quint64 indexSize = read64(p + 40);
+    quint64 dataOffset = read64(p + 48);
+    quint64 fileSize = read64(p + 56);
+
+    // Sections follow each other in this order; anything else is not written by us.
+    if(fileSize > quint64(std::numeric_limits<qint64>::max())
+       || manifestOffset != quint64(kHeaderSize)
+       || manifestSize > fileSize - manifestOffset
+       || indexOffset != manifestOffset + manifestSize
+       || indexSize > fileSize - indexOffset
+       || dataOffset != indexOffset + indexSize)
+        return std::nullopt;
+
+    header.manifestOffset = qint64(manifestOffset);
+    header.manifestSize = qint64(manifestSize);
+    header.indexOffset = qint64(indexOffset);
+    header.indexSize = qint64(indexSize);
+    header.dataOffset = qint64(dataOffset);
+    header.fileSize = qint64(fileSize);
+    return header;
+}
+
+bool Bundle::open(const QString& path)
+{
+    close();
+    m_file.setFileName(path);
+    if(!m_file.open(QFile::ReadOnly))
+    {
+        m_error = m_file.errorString();
+        return false;
+    }
+
+    auto header = parseHeader(m_file.read(kHeaderSize));
+    if(!header)
+    {
+        close();
+        m_error = "Not a SimpleUpdater bundle: " + path;
+        return false;
+    }
+    m_header = *header;
+
+    m_size = m_file.size();
+    if(m_size != m_header.fileSize)
+    {
+        close();
+        m_error = QString("Bundle size %1 does not match its header (%2): %3")
+                      .arg(m_size).arg(header->fileSize).arg(path);
+        return false;
+    }
+
+    m_data = m_file.map(0, m_size);
+    if(!m_data)
+    {
+        close();
+        m_error = "Cannot map " + path;
+        return false;
+    }
+
+    if(!readIndex())
+    {
+        QString error = m_error;
+        close();
+        m_error = error;
+        return false;
+    }
+    return true;
+}
+
+void Bundle::close()
+{
+    if(m_data)
+        m_file.unmap(const_cast<uchar*>(m_data));
+    m_data = nullptr;
+    m_size = 0;
+    m_file.close();
+    m_header = {};
+    m_entries.clear();
+    m_index.clear();
+    m_error.clear();
+}
+
+bool Bundle::readIndex()
+{
+    const uchar* p = m_data + m_header.indexOffset;
+    const uchar* end = p + m_header.indexSize;
+    for(quint32 i = 0; i < m_header.entryCount; ++i)
+    {
+        if(end - p < kIndexRecordSize)
+            return fail(&m_error, "Corrupt bundle index");
+
+        quint64 offset = read64(p);
+        quint64 compressedSize = read64(p + 8);
+        quint64 size = read64(p + 16);
+        quint16 nameLength = read16(p + 28);
+        if(end - p < kIndexRecordSize + nameLength)
+            return fail(&m_error, "Corrupt bundle index");
+
+        Entry entry;
+        entry.name = QString::fromUtf8(reinterpret_cast<const char*>(p + kIndexRecordSize), nameLength);
+        entry.method = read16(p + 24);
+        entry.flags = read16(p + 26);
+        if(offset < quint64(m_header.dataOffset) || offset > quint64(m_size)
+           || compressedSize > quint64(m_size) - offset
+           || size > quint64(std::numeric_limits<qint64>::max()))
+            return fail(&m_error, "Entry data out of range: " + entry.name);
+        entry.offset = qint64(offset);
+        entry.compressedSize = qint64(compressedSize);
+        entry.size = qint64(size);
+
+        if(!isSafeName(entry.name))
+            return fail(&m_error, "Unsafe path in bundle: " + entry.name);
+        if(entry.method != DeflateBlob::kStored && entry.method != DeflateBlob::kDeflated)
+            return fail(&m_error, QString("Unsupported compression method %1: %2").arg(entry.method).arg(entry.name));
+        if(m_index.contains(entry.name))
+            return fail(&m_error, "Duplicate path in bundle: " + entry.name);
+
+        m_index.insert(entry.name, m_entries.size());
+        m_entries.append(entry);
+        p += kIndexRecordSize + nameLength;
+    }
+    if(p != end)
+        return fail(&m_error, "Corrupt bundle index");
+    return true;
+}
+
+QByteArray Bundle::manifestJson() const
+{
+    if(!m_data)
+        return {};
+    return QByteArray(reinterpret_cast<const char*>(m_data + m_header.manifestOffset),
+                      m_header.manifestSize);
+}
+
+const Bundle::Entry* Bundle::entry(const QString& name) const
+{
+    auto it = m_index.constFind(name);
+    return it == m_index.constEnd() ? nullptr : &m_entries[it.value()];
+}
+
+bool Bundle::extract(const Entry& entry, const QString& destPath, QByteArray* sha256,
+                     QString* error) const
+{
+    DeflateBlob blob;
+    blob.data = m_data + entry.offset;
+    blob.compressedSize = entry.compressedSize;
+    blob.size = entry.size;
+    blob.method = entry.method;
+    return extractBlob(blob, entry.name, destPath, entry.flags & kExecutable, sha256, nullptr, error);
+}
+
+QString generateBundle(const QDir& releaseDir, const Manifest& release)
+{
+    QFile manifestFile(releaseDir.filePath("manifest.json"));
+    if(!manifestFile.open(QFile::ReadOnly))
+    {
+        qCritical().noquote() << "Cannot read" << manifestFile.fileName() << manifestFile.errorString();
+        return {};
+    }
+    QByteArray manifestJson = manifestFile.readAll();
+
+    QStringList files = release.files.keys();
+    files.sort();
+
+    QDir parentDir(releaseDir.absolutePath());
+    parentDir.cdUp();
+    QString bundlePath = parentDir.filePath(releaseDir.dirName() + "_" + release.version.toString()
+                                            + ".subundle");
+    QString tmpPath = bundlePath + ".tmp";
+    QFile out(tmpPath);
+    if(!out.open(QFile::ReadWrite | QFile::Truncate))
+    {
+        qCritical().noquote() << "Cannot write" << tmpPath << out.errorString();
+        return {};
+    }
+    auto failWrite = [&](const QString& message) {
+        qCritical().noquote() << message;
+        out.close();
+        QFile::remove(tmpPath);
+        return QString();
+    };
+
+    // The index has a fixed size per entry, so the data can be written before it.
+    const qint64 manifestOffset = Bundle::kHeaderSize;
+    const qint64 indexOffset = manifestOffset + manifestJson.size();
+    qint64 indexSize = 0;
+    for(const auto& relPath : files)
+        indexSize += kIndexRecordSize + relPath.toUtf8().size();
+    const qint64 dataOffset = indexOffset + indexSize;
+
+    if(!out.seek(manifestOffset) || out.write(manifestJson) != manifestJson.size()
+       || !out.seek(dataOffset))
+        return failWrite("Cannot write " + tmpPath);
+
+    QByteArray index;
+    qint64 totalSize = 0;
+    for(const auto& relPath : files)
+    {
+        QString absPath = releaseDir.absoluteFilePath(relPath);
+        qint64 offset = out.pos();
+        qint64 compressedSize = 0;
+        auto method = writeBlob(absPath, out, &compressedSize);
+        if(!method)
+            return failWrite("Cannot add " + absPath + " to the bundle");
+
+        QByteArray name = relPath.toUtf8();
+        QFileInfo info(absPath);
+        append<quint64>(index, quint64(offset));
+        append<quint64>(index, quint64(compressedSize));
+        append<quint64>(index, quint64(info.size()));
+        append<quint16>(index, *method);
+#ifdef Q_OS_WIN
+        append<quint16>(index, 0);
+#else
+        append<quint16>(index, info.isExecutable() ? Bundle::kExecutable : 0);
+#endif
+        append<quint16>(index, quint16(name.size()));
+        append<quint16>(index, 0);
+        index += name;
+        totalSize += info.size();
+    }
+
+    QByteArray header(kMagic, sizeof(kMagic));
+    append<quint32>(header, kFormatVersion);
+    append<quint32>(header, quint32(files.size()));
+    append<quint64>(header, quint64(manifestOffset));
+    append<quint64>(header, quint64(manifestJson.size()));
+    append<quint64>(header, quint64(indexOffset));
+    append<quint64>(header, quint64(indexSize));
+    append<quint64>(header, quint64(dataOffset));
+    append<quint64>(header, quint64(out.size()));
+
+    if(!out.seek(indexOffset) || out.write(index) != index.size()
+       || !out.seek(0) || out.write(header) != header.size())
+        return failWrite("Cannot write " + tmpPath);
+    qint64 bundleSize = out.size();
+    out.close();
+
+    if(QFile::exists(bundlePath) && !QFile::remove(bundlePath))
+        return failWrite("Cannot remove old bundle: " + bundlePath);
+    if(!QFile::rename(tmpPath, bundlePath))
+        return failWrite("Cannot rename " + tmpPath + " to " + bundlePath);
+
+    qInfo().noquote() << QString("Bundle written: %1 (%2 files, %3 KB of %4 KB)")
+                             .arg(bundlePath).arg(files.size())
+                             .arg(bundleSize / 1024).arg(totalSize / 1024);
+    return bundlePath;
+}
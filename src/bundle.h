@@ -0,0 +1,98 @@
+#ifndef BUNDLE_H
+#define BUNDLE_H
+
+#include "deflateblob.h"
+
+#include <QByteArray>
+#include <QDir>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <optional>
+
+struct Manifest;
+
+// SimpleUpdater's own release package (.subundle). A fixed header is followed by the
+// release's manifest.json, an index of the files and then each file compressed on its
+// own, sorted by path. Everything needed to plan an update sits in the first bytes of
+// the file, so over HTTP the header, manifest and index are fetched first and then only
+// the entries the update needs, by range. All integers are little endian.
+//
+//   header   "SUBUNDLE", u32 format version, u32 entry count, then u64 offset and size
+//            of the manifest, u64 offset and size of the index, u64 offset of the data
+//            and u64 total file size (64 bytes)
+//   index    per entry: u64 offset, u64 compressed size, u64 size, u16 method, u16 flags,
+//            u16 name length, u16 reserved, then the UTF-8 path
+class Bundle {
+public:
+    static constexpr int kHeaderSize = 64;
+    static constexpr quint16 kExecutable = 0x1;
+
+    struct Header {
+        quint32 entryCount = 0;
+        qint64 manifestOffset = 0;
+        qint64 manifestSize = 0;
+        qint64 indexOffset = 0;
+        qint64 indexSize = 0;
+        qint64 dataOffset = 0;
+        qint64 fileSize = 0;
+    };
+
+    struct Entry {
+        QString name;
+        qint64 offset = 0;
+        qint64 compressedSize = 0;
+        qint64 size = 0;
+        quint16 method = 0;
+        quint16 flags = 0;
+    };
+
+    static bool isBundlePath(const QString& path)
+    {
+        return path.endsWith(".subundle", Qt::CaseInsensitive);
+    }
+
+    // Parses the first kHeaderSize bytes of a bundle. nullopt if they are not one, or if
+    // the sections are out of order or out of range.
+    static std::optional<Header> parseHeader(const QByteArray& data);
+
+    Bundle() = default;
+    Bundle(const Bundle&) = delete;
+    Bundle& operator=(const Bundle&) = delete;
+
+    // Maps the file and reads its header and index. Entry data is only touched when it
+    // is extracted, so a partially downloaded bundle can be opened as long as the first
+    // dataOffset bytes are in place.
+    bool open(const QString& path);
+    void close();
+    QString errorString() const { return m_error; }
+    const Header& header() const { return m_header; }
+
+    QByteArray manifestJson() const;
+    const QList<Entry>& entries() const { return m_entries; }
+    // nullptr if there is no entry of that name.
+    const Entry* entry(const QString& name) const;
+
+    // Decompress entry to destPath. With sha256 set, the SHA-256 of the output is stored
+    // there. May be called from several threads at once.
+    bool extract(const Entry& entry, const QString& destPath, QByteArray* sha256 = nullptr,
+                 QString* error = nullptr) const;
+
+private:
+    bool readIndex();
+
+    QFile m_file;
+    const uchar* m_data = nullptr;
+    qint64 m_size = 0;
+    Header m_header;
+    QList<Entry> m_entries;
+    QHash<QString, int> m_index;
+    QString m_error;
+};
+
+// Write the files of a freshly generated release into a bundle next to releaseDir,
+// named <release>_<version>.subundle. Returns the bundle path, empty on failure.
+QString generateBundle(const QDir& releaseDir, const Manifest& release);
+
+#endif // BUNDLE_H
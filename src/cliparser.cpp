@@ -1,4 +1,5 @@
 #include "cliparser.h"
+#include "bundle.h"
 #include "platform/platform.h"
 
 #include <QApplication>
@@ -26,6 +27,22 @@ static std::optional<CliResult> parseGenerate(const QStringList& args)
                                      "d.d.d");
     parser.addOption(minVersionOpt);
 
+    QCommandLineOption deltaFromOpt(QStringList() << "delta-from",
+                                    "Also write a delta package against an older release "
+                                    "(release directory or its manifest.json).",
+                                    "path");
+    parser.addOption(deltaFromOpt);
+
+    QCommandLineOption blockChecksumsOpt(QStringList() << "block-checksums",
+                                         "Store block checksums for files of at least this many MiB, "
+                                         "so URL updates fetch only changed ranges.",
+                                         "MiB");
+    parser.addOption(blockChecksumsOpt);
+
+    QCommandLineOption bundleOpt(QStringList() << "bundle",
+                                 "Also pack the release into <directory>_<version>.subundle next to it.");
+    parser.addOption(bundleOpt);
+
     parser.addHelpOption();
     parser.addPositionalArgument("directory", "Directory to generate the manifest for.", "[directory]");
 
@@ -79,10 +96,38 @@ static std::optional<CliResult> parseGenerate(const QStringList& args)
         minVersion = v;
     }
 
+    std::optional<QString> deltaFrom;
+    if(parser.isSet(deltaFromOpt))
+    {
+        QString path = parser.value(deltaFromOpt);
+        if(!QFileInfo::exists(path))
+        {
+            qCritical().noquote() << "Delta base does not exist:" << path;
+            return std::nullopt;
+        }
+        deltaFrom = path;
+    }
+
+    qint64 blockChecksumMinSize = 0;
+    if(parser.isSet(blockChecksumsOpt))
+    {
+        bool ok = false;
+        qint64 mib = parser.value(blockChecksumsOpt).toLongLong(&ok);
+        if(!ok || mib <= 0)
+        {
+            qCritical().noquote() << "Invalid --block-checksums value:" << parser.value(blockChecksumsOpt);
+            return std::nullopt;
+        }
+        blockChecksumMinSize = mib * 1024 * 1024;
+    }
+
     GenerateConfig gen;
     gen.directory = directory;
     gen.appExe = appExe;
     gen.minVersion = minVersion;
+    gen.deltaFrom = deltaFrom;
+    gen.blockChecksumMinSize = blockChecksumMinSize;
+    gen.bundle = parser.isSet(bundleOpt);
 
     CliResult result;
     result.mode = AppMode::Generate;
@@ -113,6 +158,33 @@ static std::optional<CliResult> parseUpdate(const QStringList& args)
                                    "Continue a self-update in progress (internal use).");
     parser.addOption(continueOpt);
 
+    QCommandLineOption lockWaitOpt(QStringList() << "lock-wait",
+                                   "Wait up to this many seconds for locked files to be released "
+                                   "before asking the user.",
+                                   "seconds");
+    parser.addOption(lockWaitOpt);
+
+    QCommandLineOption sweepEmptyDirsOpt(QStringList() << "sweep-empty-dirs",
+                                         "Remove every empty directory in the target, not only "
+                                         "those emptied by this update.");
+    parser.addOption(sweepEmptyDirsOpt);
+
+    QCommandLineOption swapApplyOpt(QStringList() << "swap-apply",
+                                    "Build the complete new tree next to the target and swap the "
+                                    "two directories in one step.");
+    parser.addOption(swapApplyOpt);
+
+    QCommandLineOption slotsOpt(QStringList() << "slots",
+                                "Install into the inactive one of <target>/slots/A and slots/B "
+                                "and then point <target>/current at it.");
+    parser.addOption(slotsOpt);
+
+    QCommandLineOption durabilityOpt(QStringList() << "durability",
+                                     "How hard to flush writes to disk: none, batch (default) "
+                                     "or strict.",
+                                     "level", "batch");
+    parser.addOption(durabilityOpt);
+
     parser.addHelpOption();
     parser.process(args);
 
@@ -124,7 +196,15 @@ static std::optional<CliResult> parseUpdate(const QStringList& args)
 
     QString sourceValue = parser.value(sourceOpt);
 
-    if(!isUrl(sourceValue))
+    if(Bundle::isBundlePath(sourceValue) && !isUrl(sourceValue))
+    {
+        if(!QFileInfo(sourceValue).isFile())
+        {
+            qCritical().noquote() << "Source bundle does not exist or is not accessible:" << sourceValue;
+            return std::nullopt;
+        }
+    }
+    else if(!isUrl(sourceValue))
     {
         QDir srcDir(sourceValue);
         if(!srcDir.exists())
@@ -149,11 +229,42 @@ static std::optional<CliResult> parseUpdate(const QStringList& args)
         targetDir = QDir(QApplication::applicationDirPath());
     }
 
+    int lockWaitSeconds = 0;
+    if(parser.isSet(lockWaitOpt))
+    {
+        bool ok = false;
+        lockWaitSeconds = parser.value(lockWaitOpt).toInt(&ok);
+        if(!ok || lockWaitSeconds < 0)
+        {
+            qCritical().noquote() << "Invalid --lock-wait value:" << parser.value(lockWaitOpt);
+            return std::nullopt;
+        }
+    }
+
+    Durability durability;
+    QString durabilityValue = parser.value(durabilityOpt);
+    if(durabilityValue == "none")
+        durability = Durability::None;
+    else if(durabilityValue == "batch")
+        durability = Durability::Batch;
+    else if(durabilityValue == "strict")
+        durability = Durability::Strict;
+    else
+    {
+        qCritical().noquote() << "Invalid --durability value:" << durabilityValue;
+        return std::nullopt;
+    }
+
     UpdateConfig upd;
     upd.source = sourceValue;
     upd.targetDir = targetDir;
     upd.forceUpdate = parser.isSet(forceOpt);
     upd.continueUpdate = parser.isSet(continueOpt);
+    upd.lockWaitSeconds = lockWaitSeconds;
+    upd.sweepEmptyDirs = parser.isSet(sweepEmptyDirsOpt);
+    upd.swapApply = parser.isSet(swapApplyOpt);
+    upd.slotLayout = parser.isSet(slotsOpt);
+    upd.durability = durability;
 
     CliResult result;
     result.mode = AppMode::Update;
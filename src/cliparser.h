@@ -1,6 +1,8 @@
 #ifndef CLIPARSER_H
 #define CLIPARSER_H
 
+#include "durability.h"
+
 #include <QDir>
 #include <QStringList>
 #include <QVersionNumber>
@@ -11,6 +13,9 @@ struct GenerateConfig {
     QDir directory;
     QString appExe;
     std::optional<QVersionNumber> minVersion;
+    std::optional<QString> deltaFrom;
+    qint64 blockChecksumMinSize = 0;
+    bool bundle = false;  // also write a .subundle of the release
 };
 
 struct UpdateConfig {
@@ -18,6 +23,11 @@ struct UpdateConfig {
     QDir targetDir;
     bool forceUpdate;
     bool continueUpdate;
+    int lockWaitSeconds = 0;  // 0: prompt immediately when files are locked
+    bool sweepEmptyDirs = false;
+    bool swapApply = false;
+    bool slotLayout = false;  // targetDir holds slots/A, slots/B and a "current" symlink
+    Durability durability = Durability::Batch;
 };
 
 struct InstallConfig {
@@ -0,0 +1,177 @@
+#include "deflateblob.h"
+
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QScopeGuard>
+
+#include <zlib.h>
+
+static const qint64 kChunkSize = 256 * 1024;
+
+static bool fail(QString* error, const QString& message)
+{
+    if(error)
+        *error = message;
+    return false;
+}
+
+bool inflateBlob(const DeflateBlob& blob, const QString& name,
+                 const std::function<bool(const char*, qint64)>& sink,
+                 quint32* crc32, QString* error)
+{
+    uLong crc = ::crc32(0L, Z_NULL, 0);
+    qint64 total = 0;
+
+    if(blob.method == DeflateBlob::kStored)
+    {
+        if(blob.compressedSize != blob.size)
+            return fail(error, "Corrupt stored entry: " + name);
+        for(qint64 pos = 0; pos < blob.size; pos += kChunkSize)
+        {
+            qint64 length = qMin(kChunkSize, blob.size - pos);
+            if(crc32)
+                crc = ::crc32(crc, blob.data + pos, uInt(length));
+            if(!sink(reinterpret_cast<const char*>(blob.data + pos), length))
+                return fail(error, "Cannot write " + name);
+        }
+        total = blob.size;
+    }
+    else if(blob.method == DeflateBlob::kDeflated)
+    {
+        z_stream stream{};
+        if(inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+            return fail(error, "Cannot initialize zlib");
+        auto cleanup = qScopeGuard([&stream]() { inflateEnd(&stream); });
+
+        QByteArray out(kChunkSize, Qt::Uninitialized);
+        const uchar* in = blob.data;
+        qint64 remainingIn = blob.compressedSize;
+        int ret = Z_OK;
+        while(ret != Z_STREAM_END)
+        {
+            if(stream.avail_in == 0 && remainingIn > 0)
+            {
+                uInt length = uInt(qMin<qint64>(remainingIn, 1 << 30));
+                stream.next_in = const_cast<Bytef*>(in);
+                stream.avail_in = length;
+                in += length;
+                remainingIn -= length;
+            }
+            stream.next_out = reinterpret_cast<Bytef*>(out.data());
+            stream.avail_out = uInt(kChunkSize);
+
+            // With room for output, Z_BUF_ERROR means the compressed data ended early.
+            ret = inflate(&stream, Z_NO_FLUSH);
+            if(ret != Z_OK && ret != Z_STREAM_END)
+                return fail(error, "Corrupt compressed data: " + name);
+
+            qint64 produced = kChunkSize - stream.avail_out;
+            total += produced;
+            if(total > blob.size)
+                return fail(error, "Entry larger than recorded: " + name);
+            if(produced > 0)
+            {
+                if(crc32)
+                    crc = ::crc32(crc, reinterpret_cast<const Bytef*>(out.constData()), uInt(produced));
+                if(!sink(out.constData(), produced))
+                    return fail(error, "Cannot write " + name);
+            }
+        }
+    }
+    else
+    {
+        return fail(error, QString("Unsupported compression method %1: %2").arg(blob.method).arg(name));
+    }
+
+    if(total != blob.size)
+        return fail(error, "Entry smaller than recorded: " + name);
+    if(crc32)
+        *crc32 = quint32(crc);
+    return true;
+}
+
+bool extractBlob(const DeflateBlob& blob, const QString& name, const QString& destPath,
+                 bool executable, QByteArray* sha256, quint32* crc32, QString* error)
+{
+    QFile out(destPath);
+    if(!out.open(QFile::WriteOnly | QFile::Truncate))
+        return fail(error, "Cannot create " + destPath + ": " + out.errorString());
+
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    bool ok = inflateBlob(blob, name, [&](const char* chunk, qint64 length) {
+        if(sha256)
+            hash.addData(QByteArrayView(chunk, length));
+        return out.write(chunk, length) == length;
+    }, crc32, error);
+    out.close();
+    if(!ok)
+    {
+        QFile::remove(destPath);
+        return false;
+    }
+
+    if(executable)
+        out.setPermissions(out.permissions() | QFile::ExeOwner | QFile::ExeUser | QFile::ExeGroup | QFile::ExeOther);
+    if(sha256)
+        *sha256 = hash.result();
+    return true;
+}
+
+std::optional<quint16> writeBlob(const QString& srcPath, QFile& out, qint64* compressedSize)
+{
+    QFile in(srcPath);
+    if(!in.open(QFile::ReadOnly))
+    {
+        qWarning() << "Cannot read" << srcPath << in.errorString();
+        return std::nullopt;
+    }
+
+    const qint64 start = out.pos();
+    z_stream stream{};
+    if(deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return std::nullopt;
+    auto cleanup = qScopeGuard([&stream]() { deflateEnd(&stream); });
+
+    QByteArray chunk;
+    QByteArray compressed(kChunkSize, Qt::Uninitialized);
+    int flush = Z_NO_FLUSH;
+    do
+    {
+        chunk = in.read(kChunkSize);
+        if(in.error() != QFile::NoError)
+        {
+            qWarning() << "Cannot read" << srcPath << in.errorString();
+            return std::nullopt;
+        }
+        flush = in.atEnd() ? Z_FINISH : Z_NO_FLUSH;
+        stream.next_in = reinterpret_cast<Bytef*>(chunk.data());
+        stream.avail_in = uInt(chunk.size());
+        do
+        {
+            stream.next_out = reinterpret_cast<Bytef*>(compressed.data());
+            stream.avail_out = uInt(kChunkSize);
+            deflate(&stream, flush);
+            qint64 produced = kChunkSize - stream.avail_out;
+            if(out.write(compressed.constData(), produced) != produced)
+                return std::nullopt;
+        } while(stream.avail_out == 0);
+    } while(flush != Z_FINISH);
+
+    *compressedSize = out.pos() - start;
+    if(*compressedSize < in.size())
+        return DeflateBlob::kDeflated;
+
+    // Already compressed data (archives, images) is kept as is.
+    if(!in.seek(0) || !out.seek(start))
+        return std::nullopt;
+    while(!in.atEnd())
+    {
+        chunk = in.read(kChunkSize);
+        if(in.error() != QFile::NoError || out.write(chunk) != chunk.size())
+            return std::nullopt;
+    }
+    if(!out.resize(out.pos()))
+        return std::nullopt;
+    *compressedSize = in.size();
+    return DeflateBlob::kStored;
+}
@@ -0,0 +1,39 @@
+#ifndef DEFLATEBLOB_H
+#define DEFLATEBLOB_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <functional>
+#include <optional>
+
+// A single file compressed on its own, as in zip archives and bundles, so that any blob
+// can be decompressed without the others. Method numbers are those of the zip format.
+struct DeflateBlob {
+    static constexpr quint16 kStored = 0;
+    static constexpr quint16 kDeflated = 8;
+
+    const uchar* data = nullptr;
+    qint64 compressedSize = 0;
+    qint64 size = 0;
+    quint16 method = kStored;
+};
+
+// Decompress blob, handing the output to sink in chunks. sink returns false to abort.
+// Fails if the data is corrupt or does not decompress to exactly blob.size bytes. With
+// crc32 set, the CRC-32 of the output is stored there.
+bool inflateBlob(const DeflateBlob& blob, const QString& name,
+                 const std::function<bool(const char*, qint64)>& sink,
+                 quint32* crc32, QString* error);
+
+// Decompress blob to destPath, hashing the output with SHA-256 into sha256 if given, so
+// the file need not be read back to be verified. The file is removed on failure.
+bool extractBlob(const DeflateBlob& blob, const QString& name, const QString& destPath,
+                 bool executable, QByteArray* sha256, quint32* crc32, QString* error);
+
+// Compress the file at srcPath with raw deflate and write it to out at its current
+// position. Data that does not shrink is stored instead. Returns the method used, or
+// nullopt on a read or write error.
+std::optional<quint16> writeBlob(const QString& srcPath, QFile& out, qint64* compressedSize);
+
+#endif // DEFLATEBLOB_H
@@ -0,0 +1,173 @@
+#include "directorysnapshot.h"
+#include "platform/platform.h"
+
+#include <QDirIterator>
+#include <QFileInfo>
+
+static QString parentOf(const QString& relPath)
+{
+    qsizetype slash = relPath.lastIndexOf('/');
+    return slash < 0 ? QString() : relPath.left(slash);
+}
+
+DirectorySnapshot DirectorySnapshot::scan(const QDir& root)
+{
+    DirectorySnapshot snapshot;
+    snapshot.m_root = QDir(root.absolutePath());
+
+    bool scanned = Platform::scanDirectoryTree(snapshot.m_root.absolutePath(),
+                                               [&snapshot](const QString& relPath, const DirectoryEntry& entry) {
+        snapshot.insert(relPath, entry);
+    });
+    if(scanned)
+        return snapshot;
+
+    // Whatever the native scanner listed before an error is discarded.
+    snapshot.m_entries.clear();
+    snapshot.m_childCounts.clear();
+
+    QDirIterator it(snapshot.m_root.absolutePath(),
+                    QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot,
+                    QDirIterator::Subdirectories);
+
+    while(it.hasNext())
+    {
+        it.next();
+        QFileInfo info = it.fileInfo();
+
+        DirectoryEntry entry;
+        if(info.isSymLink())
+            entry.type = info.isDir() ? DirectoryEntry::Other : DirectoryEntry::Symlink;
+        else if(info.isDir())
+            entry.type = DirectoryEntry::Directory;
+        else if(info.isFile())
+            entry.type = DirectoryEntry::File;
+        entry.size = entry.type == DirectoryEntry::File ? info.size() : 0;
+        // QDirIterator silently skips the contents of a directory it cannot list.
+        if(entry.type == DirectoryEntry::Directory && !QDir(info.absoluteFilePath()).isReadable())
+        {
+            qWarning() << "Cannot list directory:" << info.absoluteFilePath();
+            snapshot.m_complete = false;
+        }
+
+        snapshot.insert(snapshot.m_root.relativeFilePath(info.absoluteFilePath()), entry);
+    }
+
+    return snapshot;
+}
+
+std::optional<DirectoryEntry> DirectorySnapshot::entry(const QString& relPath) const
+{
+    auto it = m_entries.constFind(relPath);
+    if(it == m_entries.constEnd())
+        return std::nullopt;
+    return it.value();
+}
+
+QStringList DirectorySnapshot::files() const
+{
+    QStringList result;
+    for(auto it = m_entries.constBegin(); it != m_entries.constEnd(); ++it)
+    {
+        if(it->type == DirectoryEntry::File || it->type == DirectoryEntry::Symlink)
+            result.append(it.key());
+    }
+    return result;
+}
+
+QStringList DirectorySnapshot::directories() const
+{
+    QStringList result;
+    for(auto it = m_entries.constBegin(); it != m_entries.constEnd(); ++it)
+    {
+        if(it->type == DirectoryEntry::Directory)
+            result.append(it.key());
+    }
+    return result;
+}
+
+QStringList DirectorySnapshot::others() const
+{
+    QStringList result;
+    for(auto it = m_entries.constBegin(); it != m_entries.constEnd(); ++it)
+    {
+        if(it->type == DirectoryEntry::Other)
+            result.append(it.key());
+    }
+    return result;
+}
+
+bool DirectorySnapshot::isEmptyDirectory(const QString& relPath) const
+{
+    auto it = m_entries.constFind(relPath);
+    return it != m_entries.constEnd() && it->type == DirectoryEntry::Directory
+           && m_childCounts.value(relPath) == 0;
+}
+
+void DirectorySnapshot::insert(const QString& relPath, const DirectoryEntry& entry)
+{
+    auto existing = m_entries.find(relPath);
+    if(existing != m_entries.end())
+    {
+        *existing = entry;
+        return;
+    }
+
+    QString parent = parentOf(relPath);
+    if(!parent.isEmpty() && !m_entries.contains(parent))
+    {
+        DirectoryEntry dir;
+        dir.type = DirectoryEntry::Directory;
+        insert(parent, dir);
+    }
+
+    m_entries.insert(relPath, entry);
+    ++m_childCounts[parent];
+}
+
+void DirectorySnapshot::insertFile(const QString& relPath)
+{
+    QFileInfo info(m_root.filePath(relPath));
+    DirectoryEntry entry;
+    entry.type = info.isSymLink() ? DirectoryEntry::Symlink : DirectoryEntry::File;
+    entry.size = info.size();
+    insert(relPath, entry);
+}
+
+void DirectorySnapshot::remove(const QString& relPath)
+{
+    auto it = m_entries.find(relPath);
+    if(it == m_entries.end())
+        return;
+
+    // Empty directories, the common case when sweeping, need no scan for entries below.
+    if(it->type == DirectoryEntry::Directory && m_childCounts.value(relPath) > 0)
+    {
+        const QString prefix = relPath + '/';
+        QStringList below;
+        for(auto child = m_entries.constBegin(); child != m_entries.constEnd(); ++child)
+        {
+            if(child.key().startsWith(prefix))
+                below.append(child.key());
+        }
+        for(const auto& path : below)
+        {
+            m_entries.remove(path);
+            m_childCounts.remove(path);
+        }
+        it = m_entries.find(relPath);
+    }
+
+    m_entries.erase(it);
+    m_childCounts.remove(relPath);
+    --m_childCounts[parentOf(relPath)];
+}
+
+void DirectorySnapshot::rename(const QString& from, const QString& to)
+{
+    auto existing = entry(from);
+    if(!existing)
+        return;
+    remove(from);
+    insert(to, existing.value());
+}
@@ -0,0 +1,60 @@
+#ifndef DIRECTORYSNAPSHOT_H
+#define DIRECTORYSNAPSHOT_H
+
+#include <QDir>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <optional>
+
+struct DirectoryEntry {
+    // Symlink covers links to files and dangling links. Links to directories are
+    // Other and are never descended into.
+    enum Type : quint8 { File, Directory, Symlink, Other };
+
+    Type type = Other;
+    qint64 size = 0;
+    quint64 inode = 0;  // 0 when the scanner does not report it (QDirIterator fallback)
+};
+
+// Listing of a directory tree taken once and then kept in sync by the code that changes
+// the tree, so later phases of an update do not walk the target again. Paths are
+// relative to root() and use '/' separators.
+class DirectorySnapshot {
+public:
+    DirectorySnapshot() = default;
+
+    static DirectorySnapshot scan(const QDir& root);
+
+    const QDir& root() const { return m_root; }
+    // False if a directory below root could not be listed; its contents are missing.
+    bool isComplete() const { return m_complete; }
+    int size() const { return m_entries.size(); }
+    bool contains(const QString& relPath) const { return m_entries.contains(relPath); }
+    std::optional<DirectoryEntry> entry(const QString& relPath) const;
+
+    // Relative paths of File and Symlink entries.
+    QStringList files() const;
+    QStringList directories() const;
+    // Relative paths of Other entries: symlinks to directories, FIFOs, sockets, devices.
+    QStringList others() const;
+    // True if relPath is a directory with no entries left in the snapshot.
+    bool isEmptyDirectory(const QString& relPath) const;
+
+    // Record an entry; missing parent directories are added as well.
+    void insert(const QString& relPath, const DirectoryEntry& entry);
+    // Record a file that was just written, reading its size from disk.
+    void insertFile(const QString& relPath);
+    // Forget an entry and, for a directory, everything below it.
+    void remove(const QString& relPath);
+    // Move a file entry.
+    void rename(const QString& from, const QString& to);
+
+private:
+    QDir m_root;
+    QHash<QString, DirectoryEntry> m_entries;
+    QHash<QString, int> m_childCounts;  // directory relPath ("" for root) -> direct children
+    bool m_complete = true;
+};
+
+#endif // DIRECTORYSNAPSHOT_H
@@ -1,4 +1,10 @@
 #include "downloadhandler.h"
+#include "bundle.h"
+#include "manifest.h"
+#include "parallelextract.h"
+#ifdef SIMPLEUPDATER_HAVE_ZLIB
+#include "ziparchive.h"
+#endif
 
 #include <QCoreApplication>
 #include <QDir>
@@ -9,13 +15,17 @@
 #include <QNetworkReply>
 #include <QNetworkRequest>
 #include <QProcess>
+#include <QThread>
 #include <QTimer>
 #include <QUrl>
 #include <QUuid>
+#include <algorithm>
 
 static const int kMaxRetries = 3;
 static const int kRetryDelayMs = 2000;
 static const int kTransferTimeoutMs = 30000;
+// Bundle entries closer than this are fetched in one range request, gap included.
+static const qint64 kBundleRangeGap = 64 * 1024;
 
 static bool isTransientError(QNetworkReply::NetworkError error)
 {
@@ -57,19 +67,32 @@ DownloadHandler::~DownloadHandler()
     cleanup();
 }
 
-QString DownloadHandler::downloadAndExtract(const QString& url)
+QString DownloadHandler::downloadAndExtract(const QString& url, const QDir& workDir)
 {
     QString uuid = QUuid::createUuid().toString(QUuid::Id128).left(12);
-    QString tempDirName = "SimpleUpdater_download_" + uuid;
-    QString tempPath = QDir::temp().filePath(tempDirName);
-
-    if(!QDir::temp().mkpath(tempDirName))
+    QString tempDirName = ".SimpleUpdater_download_" + uuid;
+    QString tempPath = workDir.filePath(tempDirName);
+    m_verifiedFiles.clear();
+    m_bundle.reset();
+    m_bundleUrl.clear();
+    m_fetchedBundleEntries.clear();
+
+    if(!workDir.mkpath(tempDirName))
     {
         emit statusMessage("Failed to create temporary directory: " + tempPath);
         return {};
     }
     m_tempDir = tempPath;
 
+    if(Bundle::isBundlePath(url) || Bundle::isBundlePath(QUrl(url).path()))
+    {
+        QString manifestDir = m_tempDir + "/extracted";
+        if(!QDir().mkpath(manifestDir) || !openBundle(url, manifestDir))
+            return {};
+        emit statusMessage("Bundle ready: " + manifestDir);
+        return manifestDir;
+    }
+
     emit statusMessage("Downloading: " + url);
     QString filePath = download(url);
     if(filePath.isEmpty())
@@ -111,6 +134,8 @@ QString DownloadHandler::downloadAndExtract(const QString& url)
 
 void DownloadHandler::cleanup()
 {
+    // Unmapped first: a mapped file cannot be deleted on Windows.
+    m_bundle.reset();
     if(!m_tempDir.isEmpty())
     {
         QDir(m_tempDir).removeRecursively();
@@ -120,7 +145,6 @@ void DownloadHandler::cleanup()
 
 QString DownloadHandler::download(const QString& url)
 {
-    QNetworkAccessManager nam;
     QUrl qurl(url);
 
     if(!qurl.isValid() || qurl.scheme().isEmpty())
@@ -135,6 +159,62 @@ QString DownloadHandler::download(const QString& url)
         filename = "download";
     QString destPath = m_tempDir + "/" + filename;
 
+    QFile outFile(destPath);
+    if(!outFile.open(QIODevice::WriteOnly))
+    {
+        emit statusMessage("Failed to write downloaded file: " + destPath);
+        return {};
+    }
+    bool ok = get(qurl, {}, &outFile, 0, true);
+    outFile.close();
+    if(!ok)
+        return {};
+
+    emit statusMessage("Download complete: " + filename
+                       + " (" + QString::number(QFileInfo(destPath).size() / 1024) + " KB)");
+    return destPath;
+}
+
+bool DownloadHandler::fetchFile(const QUrl& url, const QString& destPath)
+{
+    QDir().mkpath(QFileInfo(destPath).absolutePath());
+    QFile outFile(destPath);
+    if(!outFile.open(QIODevice::WriteOnly))
+    {
+        emit statusMessage("Failed to write downloaded file: " + destPath);
+        return false;
+    }
+    bool ok = get(url, {}, &outFile, 0, false);
+    outFile.close();
+    return ok;
+}
+
+bool DownloadHandler::fetchRanges(const QUrl& url, const QList<QPair<qint64, qint64>>& ranges, QFile& out)
+{
+    for(const auto& range : ranges)
+    {
+        if(range.second <= 0)
+            continue;
+        QByteArray spec = QByteArray::number(range.first) + "-"
+                        + QByteArray::number(range.first + range.second - 1);
+        if(!get(url, spec, &out, range.first, false))
+            return false;
+    }
+    return true;
+}
+
+QNetworkAccessManager* DownloadHandler::network()
+{
+    if(!m_network || m_network->thread() != QThread::currentThread())
+        m_network = std::make_unique<QNetworkAccessManager>();
+    return m_network.get();
+}
+
+bool DownloadHandler::get(const QUrl& url, const QByteArray& range, QFile* sink, qint64 sinkOffset,
+                          bool reportProgress)
+{
+    const int expectedStatus = range.isEmpty() ? 200 : 206;
+
     for(int attempt = 1; attempt <= kMaxRetries; ++attempt)
     {
         if(attempt > 1)
@@ -145,19 +225,63 @@ QString DownloadHandler::download(const QString& url)
             waitLoop.exec();
         }
 
-        QNetworkRequest request(qurl);
-        request.setTransferTimeout(kTransferTimeoutMs);
-
-        QNetworkReply* reply = nam.get(request);
+        if(!sink->seek(sinkOffset) || (range.isEmpty() && !sink->resize(sinkOffset)))
+        {
+            emit statusMessage("Failed to write downloaded file: " + sink->fileName());
+            return false;
+        }
 
-        connect(reply, &QNetworkReply::downloadProgress,
-                this, &DownloadHandler::downloadProgress);
+        QNetworkRequest request(url);
+        request.setTransferTimeout(kTransferTimeoutMs);
+        if(!range.isEmpty())
+            request.setRawHeader("Range", "bytes=" + range);
+
+        QNetworkReply* reply = network()->get(request);
+
+        if(reportProgress)
+            connect(reply, &QNetworkReply::downloadProgress,
+                    this, &DownloadHandler::downloadProgress);
+
+        // Stream the body to disk as it arrives instead of buffering whole files.
+        bool writeFailed = false;
+        auto drain = [&]() {
+            int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+            if(status != expectedStatus || writeFailed)
+                return;
+            QByteArray chunk = reply->readAll();
+            if(sink->write(chunk) != chunk.size())
+            {
+                writeFailed = true;
+                reply->abort();
+            }
+        };
+        connect(reply, &QNetworkReply::readyRead, this, drain);
+
+        // Stop as soon as the headers show the wrong status, so that an error page or a
+        // whole file sent in reply to a range request is not read into memory.
+        bool statusMismatch = false;
+        connect(reply, &QNetworkReply::metaDataChanged, this, [&]() {
+            int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+            bool redirect = status >= 300 && status < 400;
+            if(status != 0 && !redirect && status != expectedStatus)
+            {
+                statusMismatch = true;
+                reply->abort();
+            }
+        });
 
         QEventLoop loop;
         connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
         loop.exec();
 
-        if(reply->error() != QNetworkReply::NoError)
+        if(writeFailed)
+        {
+            emit statusMessage("Failed to write downloaded file: " + sink->fileName());
+            reply->deleteLater();
+            return false;
+        }
+
+        if(!statusMismatch && reply->error() != QNetworkReply::NoError)
         {
             auto replyError = reply->error();
             QString errMsg = reply->errorString();
@@ -174,16 +298,24 @@ QString DownloadHandler::download(const QString& url)
                 emit statusMessage("Download timed out after " + QString::number(kTransferTimeoutMs / 1000) + " seconds.");
             else
                 emit statusMessage("Download failed: " + errMsg);
-            return {};
+            return false;
         }
 
         int statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
-        if(statusCode != 200)
+        if(statusCode != expectedStatus)
         {
+            reply->deleteLater();
+
+            if(!range.isEmpty() && statusCode == 200)
+            {
+                m_noRangeHosts.insert(url.host());
+                emit statusMessage("Server does not support range requests: " + url.toDisplayString());
+                return false;
+            }
+
             bool transient = (statusCode == 408 || statusCode == 429
                               || statusCode == 500 || statusCode == 502
                               || statusCode == 503);
-            reply->deleteLater();
 
             if(transient && attempt < kMaxRetries)
             {
@@ -192,31 +324,124 @@ QString DownloadHandler::download(const QString& url)
             }
 
             emit statusMessage(httpErrorMessage(statusCode));
-            return {};
+            return false;
         }
 
-        QFile outFile(destPath);
-        if(!outFile.open(QIODevice::WriteOnly))
+        drain();
+        reply->deleteLater();
+        if(writeFailed)
         {
-            emit statusMessage("Failed to write downloaded file: " + destPath);
-            reply->deleteLater();
-            return {};
+            emit statusMessage("Failed to write downloaded file: " + sink->fileName());
+            return false;
         }
-        outFile.write(reply->readAll());
-        outFile.close();
-        reply->deleteLater();
-
-        emit statusMessage("Download complete: " + filename
-                           + " (" + QString::number(QFileInfo(destPath).size() / 1024) + " KB)");
-        return destPath;
+        return true;
     }
 
-    return {};
+    return false;
 }
 
 bool DownloadHandler::extractZip(const QString& zipPath, const QString& destDir)
 {
-#ifdef Q_OS_WIN
+#ifdef SIMPLEUPDATER_HAVE_ZLIB
+    ZipArchive archive;
+    if(!archive.open(zipPath))
+    {
+        emit statusMessage("Extraction failed: " + archive.errorString());
+        return false;
+    }
+
+    // manifest.json may sit at the top or in a single folder, as in findManifestRoot.
+    const ZipArchive::Entry* manifestEntry = archive.entry("manifest.json");
+    if(!manifestEntry)
+    {
+        for(const auto& entry : archive.entries())
+        {
+            int slash = entry.name.indexOf('/');
+            if(slash > 0 && entry.name.mid(slash + 1) == "manifest.json")
+            {
+                manifestEntry = &entry;
+                break;
+            }
+        }
+    }
+
+    QDir dest(destDir);
+    QString prefix;
+    QHash<QString, QByteArray> expected;
+    QString error;
+    if(manifestEntry)
+    {
+        prefix = manifestEntry->name;
+        prefix.chop(QStringLiteral("manifest.json").size());
+        QString manifestPath = dest.filePath(manifestEntry->name);
+        dest.mkpath(prefix.isEmpty() ? "." : prefix);
+        if(!archive.extract(*manifestEntry, manifestPath, nullptr, &error))
+        {
+            emit statusMessage("Extraction failed: " + error);
+            return false;
+        }
+        if(auto manifest = readManifest(manifestPath))
+            expected = manifest->files;
+    }
+
+    // Every file the manifest lists is hashed while it is inflated, so a corrupt or
+    // tampered archive is rejected here, before anything is staged. Directories are
+    // created up front; the files are then inflated in parallel, independently of
+    // each other, straight from the mapped archive.
+    QList<ExtractJob> jobs;
+    qint64 totalBytes = 0;
+    for(const auto& entry : archive.entries())
+    {
+        if(&entry == manifestEntry)
+            continue;
+        if(entry.isDirectory())
+        {
+            dest.mkpath(entry.name);
+            continue;
+        }
+        if(entry.isSymlink())
+        {
+            qWarning() << "Skipping symlink in archive:" << entry.name;
+            continue;
+        }
+
+        QString path = dest.filePath(entry.name);
+        dest.mkpath(QFileInfo(entry.name).path());
+        QString relPath = entry.name.startsWith(prefix) ? entry.name.mid(prefix.size()) : QString();
+        QByteArray expectedHash = expected.value(relPath);
+        jobs.append({entry.name, entry.size, [&archive, &entry, path, relPath, expectedHash](QString* error) {
+            QByteArray hash;
+            if(!archive.extract(entry, path, expectedHash.isEmpty() ? nullptr : &hash, error))
+                return false;
+            if(!expectedHash.isEmpty() && hash != expectedHash)
+            {
+                *error = "Archive does not match its manifest: " + relPath;
+                return false;
+            }
+            return true;
+        }});
+        totalBytes += entry.size;
+    }
+
+    qint64 extractedBytes = 0;
+    auto entryDone = [&](const ExtractJob& job, bool ok) {
+        if(!ok)
+            return;
+        QString relPath = job.name.startsWith(prefix) ? job.name.mid(prefix.size()) : QString();
+        if(expected.contains(relPath))
+            m_verifiedFiles.insert(relPath);
+        extractedBytes += job.size;
+        emit downloadProgress(extractedBytes, totalBytes);
+    };
+    if(!runExtractJobs(jobs, entryDone, m_cancelCheck, &error))
+    {
+        emit statusMessage(error.isEmpty() ? QString("Extraction cancelled.") : "Extraction failed: " + error);
+        return false;
+    }
+
+    emit statusMessage(QString("Extracted %1 entries, %2 verified against the manifest")
+                           .arg(archive.entries().size()).arg(m_verifiedFiles.size()));
+#elif defined(Q_OS_WIN)
     QProcess proc;
     proc.setWorkingDirectory(destDir);
     proc.start("powershell", {
@@ -246,6 +471,164 @@ bool DownloadHandler::extractZip(const QString& zipPath, const QString& destDir)
     return true;
 }
 
+bool DownloadHandler::openBundle(const QString& location, const QString& destDir)
+{
+#ifdef SIMPLEUPDATER_HAVE_ZLIB
+    QString path = location;
+    QUrl url(location);
+    if(url.scheme().compare("http", Qt::CaseInsensitive) == 0
+       || url.scheme().compare("https", Qt::CaseInsensitive) == 0)
+    {
+        // Header, manifest and index only; the rest of the file stays a hole until
+        // fetchBundleEntries fills in what the update needs.
+        path = m_tempDir + "/" + QFileInfo(url.path()).fileName();
+        QFile file(path);
+        if(!file.open(QIODevice::ReadWrite))
+        {
+            emit statusMessage("Failed to write downloaded file: " + path);
+            return false;
+        }
+        emit statusMessage("Fetching bundle index: " + location);
+        std::optional<Bundle::Header> header;
+        if(fetchRanges(url, {{0, Bundle::kHeaderSize}}, file) && file.seek(0))
+            header = Bundle::parseHeader(file.read(Bundle::kHeaderSize));
+        if(header && file.resize(header->fileSize)
+           && fetchRanges(url, {{Bundle::kHeaderSize, header->dataOffset - Bundle::kHeaderSize}}, file))
+        {
+            m_bundleUrl = url;
+        }
+        else
+        {
+            file.close();
+            emit statusMessage("Downloading: " + location);
+            path = download(location);
+            if(path.isEmpty())
+                return false;
+        }
+    }
+
+    auto bundle = std::make_unique<Bundle>();
+    if(!bundle->open(path))
+    {
+        emit statusMessage("Cannot open bundle: " + bundle->errorString());
+        return false;
+    }
+
+    QFile manifest(QDir(destDir).filePath("manifest.json"));
+    QByteArray json = bundle->manifestJson();
+    if(!manifest.open(QFile::WriteOnly) || manifest.write(json) != json.size())
+    {
+        emit statusMessage("Failed to write " + manifest.fileName());
+        return false;
+    }
+
+    emit statusMessage(QString("Bundle holds %1 files (%2 KB)")
+                           .arg(bundle->entries().size()).arg(bundle->header().fileSize / 1024));
+    m_bundle = std::move(bundle);
+    return true;
+#else
+    Q_UNUSED(location)
+    Q_UNUSED(destDir)
+    emit statusMessage("This updater was built without zlib and cannot read bundles.");
+    return false;
+#endif
+}
+
+bool DownloadHandler::fetchBundleEntries(const QStringList& relPaths)
+{
+#ifdef SIMPLEUPDATER_HAVE_ZLIB
+    if(!m_bundle)
+        return false;
+    if(m_bundleUrl.isEmpty())
+        return true;
+
+    QList<const Bundle::Entry*> missing;
+    for(const auto& relPath : relPaths)
+    {
+        if(m_fetchedBundleEntries.contains(relPath))
+            continue;
+        const Bundle::Entry* entry = m_bundle->entry(relPath);
+        if(!entry)
+        {
+            emit statusMessage("Bundle has no entry for " + relPath);
+            return false;
+        }
+        missing.append(entry);
+    }
+    if(missing.isEmpty())
+        return true;
+
+    // Entries are stored by path, so files of one directory mostly end up in one request.
+    std::sort(missing.begin(), missing.end(), [](const Bundle::Entry* a, const Bundle::Entry* b) {
+        return a->offset < b->offset;
+    });
+    QList<QPair<qint64, qint64>> ranges;
+    qint64 bytes = 0;
+    for(const auto* entry : missing)
+    {
+        qint64 end = entry->offset + entry->compressedSize;
+        if(!ranges.isEmpty() && entry->offset - (ranges.last().first + ranges.last().second) <= kBundleRangeGap)
+            ranges.last().second = qMax(ranges.last().second, end - ranges.last().first);
+        else
+            ranges.append({entry->offset, entry->compressedSize});
+    }
+    for(const auto& range : ranges)
+        bytes += range.second;
+
+    // Written through a second handle; the bundle's shared mapping sees the new data.
+    QString path = m_tempDir + "/" + QFileInfo(m_bundleUrl.path()).fileName();
+    QFile file(path);
+    if(!file.open(QIODevice::ReadWrite) || !fetchRanges(m_bundleUrl, ranges, file))
+    {
+        emit statusMessage("Failed to fetch bundle entries from " + m_bundleUrl.toDisplayString());
+        return false;
+    }
+    file.close();
+
+    for(const auto* entry : missing)
+        m_fetchedBundleEntries.insert(entry->name);
+    emit statusMessage(QString("Fetched %1 bundle entries in %2 requests (%3 KB)")
+                           .arg(missing.size()).arg(ranges.size()).arg(bytes / 1024));
+    return true;
+#else
+    Q_UNUSED(relPaths)
+    return false;
+#endif
+}
+
+qint64 DownloadHandler::bundleEntrySize(const QString& relPath) const
+{
+#ifdef SIMPLEUPDATER_HAVE_ZLIB
+    const Bundle::Entry* entry = m_bundle ? m_bundle->entry(relPath) : nullptr;
+    return entry ? entry->size : -1;
+#else
+    Q_UNUSED(relPath)
+    return -1;
+#endif
+}
+
+bool DownloadHandler::extractBundleEntry(const QString& relPath, const QString& destPath,
+                                         QByteArray* sha256, QString* error) const
+{
+#ifdef SIMPLEUPDATER_HAVE_ZLIB
+    const Bundle::Entry* entry = m_bundle ? m_bundle->entry(relPath) : nullptr;
+    if(!entry)
+    {
+        if(error)
+            *error = "Bundle has no entry for " + relPath;
+        return false;
+    }
+    return m_bundle->extract(*entry, destPath, sha256, error);
+#else
+    Q_UNUSED(relPath)
+    Q_UNUSED(destPath)
+    Q_UNUSED(sha256)
+    if(error)
+        *error = "This updater was built without zlib and cannot read bundles.";
+    return false;
+#endif
+}
+
 QString DownloadHandler::findManifestRoot(const QString& dir)
 {
     // Check current directory first
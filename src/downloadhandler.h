@@ -2,8 +2,16 @@
 #define DOWNLOADHANDLER_H
 
 #include <QDir>
+#include <QList>
 #include <QObject>
+#include <QPair>
+#include <QSet>
+#include <QUrl>
+#include <functional>
+#include <memory>
 
+class Bundle;
+class QFile;
 class QNetworkAccessManager;
 class QNetworkReply;
 
@@ -13,10 +21,42 @@ public:
     explicit DownloadHandler(QObject* parent = nullptr);
     ~DownloadHandler();
 
-    // Download URL to a temp directory. Extracts .zip if applicable.
+    // Download URL to a temp directory created in workDir. Extracts .zip if applicable.
+    // A .subundle (URL or local path) is not unpacked: only its manifest.json is written
+    // out, and entries are extracted on demand with extractBundleEntry.
     // Returns the local directory path on success, empty string on failure.
     // This is a blocking call (runs its own event loop for network I/O).
-    QString downloadAndExtract(const QString& url);
+    QString downloadAndExtract(const QString& url, const QDir& workDir = QDir::temp());
+
+    // Download a single file to destPath, streaming to disk. Returns true on success.
+    bool fetchFile(const QUrl& url, const QString& destPath);
+
+    // Fetch byte ranges (offset, length) of url with HTTP Range requests, writing each
+    // at its own offset in out. Returns false on error or if ranges are not supported.
+    bool fetchRanges(const QUrl& url, const QList<QPair<qint64, qint64>>& ranges, QFile& out);
+    // False once the host of url has answered a range request with the whole file.
+    bool supportsRanges(const QUrl& url) const { return !m_noRangeHosts.contains(url.host()); }
+
+    // Files of the last extracted archive whose content was hashed against its
+    // manifest.json while being inflated, relative to the manifest's directory. Empty
+    // when extraction went through an external tool.
+    const QSet<QString>& verifiedFiles() const { return m_verifiedFiles; }
+
+    // True if the last source was a bundle.
+    bool isBundle() const { return m_bundle != nullptr; }
+    // Make sure the data of these bundle entries is on disk. A bundle opened from a URL
+    // only holds its header, manifest and index at first; the entries are fetched with
+    // as few range requests as their layout allows.
+    bool fetchBundleEntries(const QStringList& relPaths);
+    // Uncompressed size of a bundle entry, -1 if there is none.
+    qint64 bundleEntrySize(const QString& relPath) const;
+    // Decompress a bundle entry to destPath, with the SHA-256 of its content in sha256.
+    // Safe to call from several threads once the entries are fetched.
+    bool extractBundleEntry(const QString& relPath, const QString& destPath, QByteArray* sha256,
+                            QString* error) const;
+
+    // Polled between archive entries while extracting; returning true stops extraction.
+    void setCancelCheck(std::function<bool()> check) { m_cancelCheck = std::move(check); }
 
     // Clean up the temp directory created by downloadAndExtract.
     void cleanup();
@@ -27,9 +67,22 @@ signals:
 
 private:
     QString m_tempDir;
+    QSet<QString> m_verifiedFiles;
+    std::unique_ptr<Bundle> m_bundle;
+    QUrl m_bundleUrl;                    // empty once the whole bundle is on disk
+    QSet<QString> m_fetchedBundleEntries;
+    std::function<bool()> m_cancelCheck;
+    // One manager for all requests so that ranges of a file share a connection. Made
+    // on first use in the thread that downloads.
+    std::unique_ptr<QNetworkAccessManager> m_network;
+    QSet<QString> m_noRangeHosts;
 
     QString download(const QString& url);
+    QNetworkAccessManager* network();
+    bool get(const QUrl& url, const QByteArray& range, QFile* sink, qint64 sinkOffset,
+             bool reportProgress);
     bool extractZip(const QString& zipPath, const QString& destDir);
+    bool openBundle(const QString& location, const QString& destDir);
     QString findManifestRoot(const QString& dir);
 };
 
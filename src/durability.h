@@ -0,0 +1,12 @@
+#ifndef DURABILITY_H
+#define DURABILITY_H
+
+// How hard the updater works to make its writes survive a power failure.
+//   None    rely on the page cache, as plain copies and renames do
+//   Batch   start write-back while staging, one syncfs before apply, directory syncs
+//           after the renames, and journal flushes every few hundred records
+//   Strict  fdatasync every staged file, sync each directory after its rename and
+//           flush after every journal record
+enum class Durability { None, Batch, Strict };
+
+#endif // DURABILITY_H
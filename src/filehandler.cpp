@@ -1,4 +1,5 @@
 #include "filehandler.h"
+#include "binarypatch.h"
 #include "platform/platform.h"
 
 #include <QCoreApplication>
@@ -6,6 +7,7 @@
 #include <QDirIterator>
 #include <QFile>
 #include <QFileInfo>
+#include <QSet>
 
 FileHandler::FileHandler(QObject* parent)
     : QObject(parent)
@@ -18,6 +20,39 @@ void FileHandler::setLockResolver(LockResolverCallback callback)
     m_lockResolver = std::move(callback);
 }
 
+void FileHandler::setDurability(Durability durability)
+{
+    m_durability = durability;
+}
+
+void FileHandler::flushWritten(const QString& absolutePath)
+{
+    if(m_durability == Durability::Batch)
+        Platform::startWriteback(absolutePath);
+    else if(m_durability == Durability::Strict && !Platform::syncFile(absolutePath))
+        qWarning() << "Failed to sync" << absolutePath;
+}
+
+bool FileHandler::syncStaged(const QDir& dir, const QStringList& relativePaths)
+{
+    if(m_durability != Durability::Batch || relativePaths.isEmpty())
+        return true;
+    if(Platform::syncFilesystem(dir.absolutePath()))
+        return true;
+
+    bool ok = true;
+    for(const auto& relPath : relativePaths)
+    {
+        QString path = dir.filePath(relPath);
+        if(QFileInfo::exists(path) && !Platform::syncFile(path))
+        {
+            qWarning() << "Failed to sync" << path;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
 bool FileHandler::retryWithLockResolver(const QString& absolutePath,
                                         const std::function<bool()>& operation)
 {
@@ -35,7 +70,8 @@ bool FileHandler::retryWithLockResolver(const QString& absolutePath,
 }
 
 FileDiff FileHandler::computeDiff(const QHash<QString, QByteArray>& sourceFiles,
-                                  const QHash<QString, QByteArray>& targetFiles)
+                                  const QHash<QString, QByteArray>& targetFiles,
+                                  const DirectorySnapshot* targetSnapshot)
 {
     FileDiff diff;
 
@@ -49,10 +85,43 @@ FileDiff FileHandler::computeDiff(const QHash<QString, QByteArray>& sourceFiles,
             diff.unchanged.append(it.key());
     }
 
+    // Index target content by hash, preferring paths that are about to be removed so
+    // relocated files are reported as moves.
+    QHash<QByteArray, QString> targetByHash;
     for(auto it = targetFiles.constBegin(); it != targetFiles.constEnd(); ++it)
     {
         if(!sourceFiles.contains(it.key()))
+        {
             diff.toRemove.append(it.key());
+            targetByHash.insert(it.value(), it.key());
+        }
+        else if(!targetByHash.contains(it.value()))
+        {
+            targetByHash.insert(it.value(), it.key());
+        }
+    }
+
+    for(const auto& relPath : diff.toAdd)
+    {
+        auto existing = targetByHash.constFind(sourceFiles.value(relPath));
+        if(existing == targetByHash.constEnd())
+            continue;
+        if(sourceFiles.contains(existing.value()))
+            diff.reused.insert(relPath, existing.value());
+        else
+            diff.moved.insert(relPath, existing.value());
+    }
+
+    // Hashed files not in the source are already in toRemove; what is left are files
+    // that could not be hashed. Leftover .bak files belong to the backup logic.
+    if(targetSnapshot)
+    {
+        for(const auto& relPath : targetSnapshot->files())
+        {
+            if(!targetFiles.contains(relPath) && !sourceFiles.contains(relPath)
+               && !relPath.endsWith(".bak"))
+                diff.stale.append(relPath);
+        }
     }
 
     return diff;
@@ -119,12 +188,210 @@ bool FileHandler::copyFiles(const QDir& source, const QDir& target, const QStrin
         }
 
         QFile::setPermissions(tgtPath, QFileInfo(srcPath).permissions());
+        flushWritten(tgtPath);
         emit progressUpdated(relPath + " (COPY)", true);
     }
 
     return overallSuccess;
 }
 
+bool FileHandler::moveFiles(const QDir& source, const QDir& target, const QStringList& relativePaths)
+{
+    bool overallSuccess = true;
+
+    for(const auto& relPath : relativePaths)
+    {
+        if(checkCancel())
+            return false;
+
+        QString srcPath = source.filePath(relPath);
+        QString tgtPath = target.filePath(relPath);
+
+        QDir tgtDir = QFileInfo(tgtPath).absoluteDir();
+        if(!tgtDir.exists() && !tgtDir.mkpath("."))
+        {
+            qWarning() << "Failed to create target directory:" << tgtDir.absolutePath();
+            emit progressUpdated(relPath + " (MOVE) - cannot create directory", false);
+            overallSuccess = false;
+            continue;
+        }
+
+        if(QFile::exists(tgtPath))
+            QFile::remove(tgtPath);
+
+        if(!QFile::rename(srcPath, tgtPath))
+        {
+            qWarning() << "Failed to move" << srcPath << "to" << tgtPath;
+            emit progressUpdated(relPath + " (MOVE)", false);
+            overallSuccess = false;
+            continue;
+        }
+
+        flushWritten(tgtPath);
+        emit progressUpdated(relPath + " (MOVE)", true);
+    }
+
+    return overallSuccess;
+}
+
+bool FileHandler::stageLocalCopy(const QString& srcPath, const QString& tgtPath, bool allowHardLink)
+{
+    QDir tgtDir = QFileInfo(tgtPath).absoluteDir();
+    if(!tgtDir.exists() && !tgtDir.mkpath("."))
+        return false;
+    if(QFile::exists(tgtPath))
+        QFile::remove(tgtPath);
+
+    // A hardlink adds no data of its own; a reflink and a copy do.
+    if(Platform::cloneFile(srcPath, tgtPath))
+    {
+        flushWritten(tgtPath);
+        return true;
+    }
+    if(allowHardLink && Platform::createHardLink(srcPath, tgtPath))
+        return true;
+
+    bool copied = retryWithLockResolver(srcPath, [&](){
+        return QFile::copy(srcPath, tgtPath);
+    });
+    if(copied)
+    {
+        QFile::setPermissions(tgtPath, QFileInfo(srcPath).permissions());
+        flushWritten(tgtPath);
+    }
+    return copied;
+}
+
+QStringList FileHandler::reuseFiles(const QDir& existingDir, const QDir& target,
+                                    const QHash<QString, QString>& sources, bool move)
+{
+    QStringList failed;
+    const QString label = move ? " (MOVE from " : " (REUSE from ";
+
+    for(auto it = sources.constBegin(); it != sources.constEnd(); ++it)
+    {
+        const QString& relPath = it.key();
+        if(checkCancel()
+           || !stageLocalCopy(existingDir.filePath(it.value()), target.filePath(relPath), move))
+        {
+            failed.append(relPath);
+            continue;
+        }
+        emit progressUpdated(relPath + label + it.value() + ")", true);
+    }
+
+    return failed;
+}
+
+QStringList FileHandler::dedupFiles(const QDir& dir, const QHash<QString, QString>& duplicates)
+{
+    QStringList failed;
+
+    for(auto it = duplicates.constBegin(); it != duplicates.constEnd(); ++it)
+    {
+        const QString& relPath = it.key();
+        if(checkCancel()
+           || !stageLocalCopy(dir.filePath(it.value()), dir.filePath(relPath), false))
+        {
+            failed.append(relPath);
+            continue;
+        }
+        emit progressUpdated(relPath + " (DEDUP of " + it.value() + ")", true);
+    }
+
+    return failed;
+}
+
+QStringList FileHandler::linkFiles(const QDir& existingDir, const QDir& target,
+                                   const QStringList& relativePaths)
+{
+    QStringList failed;
+
+    for(const auto& relPath : relativePaths)
+    {
+        if(checkCancel())
+        {
+            failed.append(relPath);
+            continue;
+        }
+
+        QString srcPath = existingDir.filePath(relPath);
+        QString tgtPath = target.filePath(relPath);
+        QDir tgtDir = QFileInfo(tgtPath).absoluteDir();
+        if(!tgtDir.exists() && !tgtDir.mkpath("."))
+        {
+            failed.append(relPath);
+            continue;
+        }
+
+        // May be left over from an interrupted build of the same tree.
+        QFile::remove(tgtPath);
+
+        if(!Platform::createHardLink(srcPath, tgtPath) && !stageLocalCopy(srcPath, tgtPath, false))
+        {
+            qWarning() << "Failed to link" << srcPath << "to" << tgtPath;
+            failed.append(relPath);
+        }
+    }
+
+    return failed;
+}
+
+QStringList FileHandler::patchFiles(const QDir& baseDir, const QDir& patchDir, const QDir& target,
+                                    const QHash<QString, QString>& patchPaths,
+                                    const QHash<QString, QByteArray>& expectedHashes)
+{
+    QStringList failed;
+
+    for(auto it = patchPaths.constBegin(); it != patchPaths.constEnd(); ++it)
+    {
+        const QString& relPath = it.key();
+        if(checkCancel())
+        {
+            failed.append(relPath);
+            continue;
+        }
+
+        QString basePath = baseDir.filePath(relPath);
+        QString tgtPath = target.filePath(relPath);
+
+        QDir tgtDir = QFileInfo(tgtPath).absoluteDir();
+        if(!tgtDir.exists() && !tgtDir.mkpath("."))
+        {
+            qWarning() << "Failed to create target directory:" << tgtDir.absolutePath();
+            failed.append(relPath);
+            continue;
+        }
+
+        // Only a locked base file is worth resolving; a bad patch just falls back to a copy.
+        QFile base(basePath);
+        bool patched = retryWithLockResolver(basePath, [&](){
+            return base.open(QFile::ReadOnly);
+        });
+        base.close();
+        patched = patched && applyBinaryPatch(basePath, patchDir.filePath(it.value()), tgtPath);
+        if(patched && hashFile(tgtPath) != expectedHashes.value(relPath))
+        {
+            qWarning() << "Patched file does not match manifest hash:" << tgtPath;
+            patched = false;
+        }
+
+        if(!patched)
+        {
+            QFile::remove(tgtPath);
+            emit progressUpdated(relPath + " (PATCH) - falling back to full copy", false);
+            failed.append(relPath);
+            continue;
+        }
+
+        QFile::setPermissions(tgtPath, QFileInfo(basePath).permissions());
+        flushWritten(tgtPath);
+        emit progressUpdated(relPath + " (PATCH)", true);
+    }
+
+    return failed;
+}
+
 bool FileHandler::removeFiles(const QDir& directory, const QStringList& relativePaths)
 {
     bool overallSuccess = true;
@@ -205,6 +472,8 @@ bool FileHandler::renameToBackup(const QDir& directory, const QStringList& relat
             return false;
         }
 
+        if(m_durability == Durability::Strict)
+            Platform::syncDirectory(QFileInfo(bakPath).absolutePath());
         emit progressUpdated(relPath + " (BACKUP)", true);
     }
 
@@ -306,6 +575,51 @@ void FileHandler::removeEmptyDirectories(const QDir& directory)
     }
 }
 
+void FileHandler::removeEmptyDirectories(DirectorySnapshot& snapshot)
+{
+    QStringList dirs = snapshot.directories();
+    std::sort(dirs.begin(), dirs.end(), [](const QString& a, const QString& b){
+        return a.length() > b.length();
+    });
+
+    // Deepest first, so a parent whose last child was just removed is empty by the
+    // time it is reached. rmdir() refuses non-empty directories if the snapshot is stale.
+    for(const auto& relPath : dirs)
+    {
+        if(snapshot.isEmptyDirectory(relPath) && QDir().rmdir(snapshot.root().absoluteFilePath(relPath)))
+            snapshot.remove(relPath);
+    }
+}
+
+QStringList FileHandler::removeEmptyParents(const QDir& directory, const QStringList& removedRelPaths)
+{
+    QSet<QString> parents;
+    for(const auto& relPath : removedRelPaths)
+    {
+        qsizetype slash = relPath.lastIndexOf('/');
+        if(slash > 0)
+            parents.insert(relPath.left(slash));
+    }
+
+    QStringList starts(parents.begin(), parents.end());
+    std::sort(starts.begin(), starts.end(), [](const QString& a, const QString& b){
+        return a.count('/') > b.count('/');
+    });
+
+    // rmdir() fails on a non-empty directory, which is exactly where the walk stops.
+    QStringList removed;
+    for(QString relDir : starts)
+    {
+        while(!relDir.isEmpty() && QDir().rmdir(directory.absoluteFilePath(relDir)))
+        {
+            removed.append(relDir);
+            qsizetype slash = relDir.lastIndexOf('/');
+            relDir = slash < 0 ? QString() : relDir.left(slash);
+        }
+    }
+    return removed;
+}
+
 QByteArray FileHandler::hashFile(const QString& filePath)
 {
     QFile file(filePath);
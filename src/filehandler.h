@@ -1,6 +1,9 @@
 #ifndef FILEHANDLER_H
 #define FILEHANDLER_H
 
+#include "directorysnapshot.h"
+#include "durability.h"
+
 #include <QDir>
 #include <QHash>
 #include <QObject>
@@ -11,6 +14,9 @@ struct FileDiff {
     QStringList toUpdate;   // relative paths in both but hash differs
     QStringList toRemove;   // relative paths in target but not in source
     QStringList unchanged;  // relative paths with matching hashes
+    QHash<QString, QString> moved;   // toAdd path -> toRemove path with identical content
+    QHash<QString, QString> reused;  // toAdd path -> kept target path with identical content
+    QStringList stale;      // unhashed target files (locked, unreadable, symlinks) not in source
 };
 
 class FileHandler : public QObject {
@@ -21,16 +27,64 @@ public:
     explicit FileHandler(QObject* parent = nullptr);
 
     void setLockResolver(LockResolverCallback callback);
-
-    // Compute diff between two file manifests.
+    // How files written by copyFiles, reuseFiles, dedupFiles, linkFiles and patchFiles
+    // are flushed. None by default.
+    void setDurability(Durability durability);
+
+    // Flush a file just written into staging according to the durability level:
+    // start its write-back under Batch, fdatasync it under Strict.
+    void flushWritten(const QString& absolutePath);
+
+    // Make the files staged under dir durable before they are moved into place. Under
+    // Batch this is a single syncfs of dir's filesystem, falling back to syncing each of
+    // relativePaths; under Strict they were synced as they were written.
+    // Returns false if a sync failed.
+    bool syncStaged(const QDir& dir, const QStringList& relativePaths);
+
+    // Compute diff between two file manifests. toAdd entries whose content already
+    // exists in the target under another path are also listed in moved or reused.
+    // With the snapshot targetFiles was hashed from, stale is filled as well.
     static FileDiff computeDiff(const QHash<QString, QByteArray>& sourceFiles,
-                                const QHash<QString, QByteArray>& targetFiles);
+                                const QHash<QString, QByteArray>& targetFiles,
+                                const DirectorySnapshot* targetSnapshot = nullptr);
 
     // Copy specific files from source to target by relative path.
     // Creates subdirectories as needed. Skips the updater's own exe.
     // Emits progressUpdated for each file. Returns false if any file fails.
     bool copyFiles(const QDir& source, const QDir& target, const QStringList& relativePaths);
 
+    // Same as copyFiles, but renames the files out of source, which must be scratch space
+    // such as an extracted download. A rename across filesystems degrades to a copy.
+    // Emits progressUpdated for each file (MOVE). Returns false if any file fails.
+    bool moveFiles(const QDir& source, const QDir& target, const QStringList& relativePaths);
+
+    // Stage files from content that already exists locally. sources maps relativePath in
+    // target -> relativePath in existingDir. With move set the existing file is going away,
+    // so it may be hardlinked; otherwise it is reflinked or copied. Logs MOVE or REUSE.
+    // Returns the relative paths that could not be staged this way.
+    QStringList reuseFiles(const QDir& existingDir, const QDir& target,
+                           const QHash<QString, QString>& sources, bool move);
+
+    // Materialize files in dir that have the same content as another file in dir.
+    // duplicates maps relativePath -> relativePath of the already staged original.
+    // Uses a reflink, else a copy; never a hardlink, since the installed paths must stay
+    // independent files. Logs DEDUP.
+    // Returns the relative paths that could not be materialized.
+    QStringList dedupFiles(const QDir& dir, const QHash<QString, QString>& duplicates);
+
+    // Recreate files from existingDir under target as hardlinks, falling back to a
+    // reflink or copy, so a complete tree can be built next to existingDir cheaply.
+    // Does not log per file. Returns the relative paths that could not be linked.
+    QStringList linkFiles(const QDir& existingDir, const QDir& target, const QStringList& relativePaths);
+
+    // Rebuild files in target from the existing copy in baseDir plus a binary patch.
+    // patchPaths maps relativePath -> patch path relative to patchDir. Every result is
+    // checked against expectedHashes. Returns the relative paths that could not be
+    // rebuilt and need a full copy instead.
+    QStringList patchFiles(const QDir& baseDir, const QDir& patchDir, const QDir& target,
+                           const QHash<QString, QString>& patchPaths,
+                           const QHash<QString, QByteArray>& expectedHashes);
+
     // Remove specific files from a directory by relative path.
     // Emits progressUpdated for each file.
     // Returns false if any file fails to remove.
@@ -55,6 +109,15 @@ public:
     // Remove empty directories recursively (bottom-up). Never removes the root itself.
     void removeEmptyDirectories(const QDir& directory);
 
+    // Same, deciding emptiness from the snapshot instead of listing each directory.
+    // Removed directories are dropped from the snapshot.
+    void removeEmptyDirectories(DirectorySnapshot& snapshot);
+
+    // Remove directories emptied by deleting removedRelPaths: starting at each parent,
+    // walk upward until a directory is not empty. Never lists a directory and never
+    // removes the root. Returns the removed directories, relative to directory.
+    QStringList removeEmptyParents(const QDir& directory, const QStringList& removedRelPaths);
+
     // Hash a single file. Returns empty QByteArray on failure.
     static QByteArray hashFile(const QString& filePath);
 
@@ -74,11 +137,13 @@ signals:
 private:
     std::atomic<bool> m_cancelRequested{false};
     LockResolverCallback m_lockResolver;
+    Durability m_durability = Durability::None;
 
     QString m_selfPath;
 
     bool isSelf(const QString& absolutePath) const;
     bool checkCancel();
+    bool stageLocalCopy(const QString& srcPath, const QString& tgtPath, bool allowHardLink);
     bool retryWithLockResolver(const QString& absolutePath,
                                const std::function<bool()>& operation);
 };
@@ -1,3 +1,5 @@
+#include "applyjournal.h"
+#include "bundle.h"
 #include "cliparser.h"
 #include "mainwindow.h"
 #include "manifest.h"
@@ -52,11 +54,35 @@ int main(int argc, char *argv[])
     if(config->mode == AppMode::Generate)
     {
         auto& gen = config->generate.value();
-        auto manifest = generateManifest(gen.directory, gen.appExe, gen.minVersion);
-        return manifest ? 0 : 1;
+        auto manifest = generateManifest(gen.directory, gen.appExe, gen.minVersion,
+                                         gen.blockChecksumMinSize);
+        if(!manifest)
+            return 1;
+        if(gen.deltaFrom && generateDeltaPackage(gen.directory, *manifest, *gen.deltaFrom).isEmpty())
+            return 1;
+        if(gen.bundle)
+        {
+#ifdef SIMPLEUPDATER_HAVE_ZLIB
+            if(generateBundle(gen.directory, *manifest).isEmpty())
+                return 1;
+#else
+            qCritical().noquote() << "--bundle needs an updater built with zlib.";
+            return 1;
+#endif
+        }
+        return 0;
     }
 
-    MainWindow w(*config);
+    // An apply cut short by a crash or power loss is finished or undone before the
+    // target is looked at, so the update below starts from a consistent tree. If that
+    // fails, no update may run: its backups would replace the only copies of the originals.
+    ApplyJournal::Recovery recovery = ApplyJournal::Recovery::None;
+    if(config->mode == AppMode::Update && !config->update->slotLayout)
+        recovery = ApplyJournal::recover(config->update->targetDir);
+    else if(config->mode == AppMode::Install && config->install->targetDir)
+        recovery = ApplyJournal::recover(*config->install->targetDir);
+
+    MainWindow w(*config, recovery == ApplyJournal::Recovery::Failed);
     g_mainWindow = &w;
     w.show();
     int ret = a.exec();
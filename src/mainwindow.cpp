@@ -1,4 +1,6 @@
 #include "mainwindow.h"
+#include "applyjournal.h"
+#include "bundle.h"
 #include "updatecontroller.h"
 #include <QApplication>
 #include <QFileDialog>
@@ -34,7 +36,7 @@ QString MainWindow::exeDisplayName(const QString& appExe)
     return name;
 }
 
-MainWindow::MainWindow(const CliResult& config, QWidget* parent)
+MainWindow::MainWindow(const CliResult& config, bool recoveryFailed, QWidget* parent)
     : QMainWindow(parent)
     , m_controller(new UpdateController(this))
 {
@@ -51,13 +53,19 @@ MainWindow::MainWindow(const CliResult& config, QWidget* parent)
     else
     {
         auto& upd = config.update.value();
-        if(isUrl(upd.source))
+        // A local bundle goes through the download handler too, which reads it in place.
+        if(isUrl(upd.source) || Bundle::isBundlePath(upd.source))
             m_controller->setSourceUrl(upd.source);
         else
             m_controller->setSourceDir(QDir(upd.source));
         m_controller->setTargetDir(upd.targetDir);
         m_controller->setForceUpdate(upd.forceUpdate);
         m_controller->setContinueUpdate(upd.continueUpdate);
+        m_controller->setLockWait(upd.lockWaitSeconds);
+        m_controller->setSweepEmptyDirs(upd.sweepEmptyDirs);
+        m_controller->setSwapApply(upd.swapApply);
+        m_controller->setSlotLayout(upd.slotLayout);
+        m_controller->setDurability(upd.durability);
     }
 
     m_controller->prepare();
@@ -517,7 +525,20 @@ MainWindow::MainWindow(const CliResult& config, QWidget* parent)
         }
     });
 
-    if(!isInstall && config.update->continueUpdate)
+    if(recoveryFailed)
+    {
+        headerTitle->setText(tr("Operation Failed"));
+        headerSubtitle->setText(tr("An interrupted update could not be recovered."));
+        stackedWidget->setCurrentIndex(2);
+        continueButton->setVisible(false);
+        updateLaterButton->setVisible(false);
+        cancelButton->setVisible(false);
+        quitButton->setVisible(true);
+        logMessage("AN INTERRUPTED UPDATE COULD NOT BE RECOVERED", Qt::red);
+        logMessage("Restore the .bak files in the target by hand, or fix the cause and start again. "
+                   "The journal is kept at " + ApplyJournal::pathFor(m_controller->targetDir()), Qt::red);
+    }
+    else if(!isInstall && config.update->continueUpdate)
     {
         headerTitle->setText(tr("Updating..."));
         headerSubtitle->setText(tr("Please wait..."));
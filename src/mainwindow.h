@@ -17,7 +17,9 @@ class MainWindow : public QMainWindow
     Q_OBJECT
 
 public:
-    MainWindow(const CliResult& config, QWidget* parent = nullptr);
+    // With recoveryFailed the window only reports the failed recovery of an interrupted
+    // update and never starts a new one.
+    MainWindow(const CliResult& config, bool recoveryFailed = false, QWidget* parent = nullptr);
     ~MainWindow();
 
 private:
@@ -31,6 +31,20 @@ static bool shouldSkipFile(const QString& fileName)
         || fileName == "updateInfo.ini";
 }
 
+// A path from the manifest that stays inside the directory it is resolved against.
+static bool isSafeRelativePath(const QString& path)
+{
+    QString normalized = QString(path).replace('\\', '/');
+    if(normalized.isEmpty() || normalized.startsWith('/') || normalized.contains(':'))
+        return false;
+    for(const auto& part : normalized.split('/'))
+    {
+        if(part.isEmpty() || part == "." || part == "..")
+            return false;
+    }
+    return true;
+}
+
 std::optional<Manifest> readManifest(const QString& jsonPath)
 {
     QFile file(jsonPath);
@@ -129,28 +143,50 @@ std::optional<Manifest> readManifest(const QString& jsonPath)
         manifest.files.insert(it.key(), QByteArray::fromBase64(it.value().toString().toLatin1()));
     }
 
+    QJsonObject patchesObj = root["patches"].toObject();
+    for(auto it = patchesObj.constBegin(); it != patchesObj.constEnd(); ++it)
+    {
+        if(!manifest.files.contains(it.key()))
+            continue;
+        for(const auto& entry : it.value().toArray())
+        {
+            QJsonObject obj = entry.toObject();
+            if(!obj["from"].isString() || !obj["patch"].isString())
+                continue;
+            if(!isSafeRelativePath(obj["patch"].toString()))
+            {
+                qWarning() << "Ignoring patch outside the release:" << obj["patch"].toString()
+                           << "in" << jsonPath;
+                continue;
+            }
+            FilePatch patch;
+            patch.baseHash = QByteArray::fromBase64(obj["from"].toString().toLatin1());
+            patch.patchPath = obj["patch"].toString();
+            manifest.patches[it.key()].append(patch);
+        }
+    }
+
+    QJsonObject blocksObj = root["blocks"].toObject();
+    for(auto it = blocksObj.constBegin(); it != blocksObj.constEnd(); ++it)
+    {
+        QJsonObject obj = it.value().toObject();
+        BlockChecksums sums;
+        sums.blockSize = obj["block_size"].toInt();
+        sums.fileSize = obj["size"].toInteger();
+        sums.sums = QByteArray::fromBase64(obj["sums"].toString().toLatin1());
+        if(!manifest.files.contains(it.key()) || sums.blockSize <= 0
+           || sums.sums.size() % BlockChecksums::kSumSize != 0)
+            continue;
+        manifest.blocks.insert(it.key(), sums);
+    }
+
     return manifest;
 }
 
-bool writeManifest(const QString& jsonPath, const Manifest& manifest)
+// Always synced: manifests and delta descriptors are written by the generate command,
+// which does not take --durability.
+static bool writeJsonAtomically(const QString& jsonPath, const QJsonObject& root)
 {
-    QJsonObject root;
-    root["version"] = manifest.version.toString();
-    root["app_exe"] = manifest.appExe;
-
-    if(manifest.minVersion)
-        root["min_version"] = manifest.minVersion->toString();
-
-    QJsonArray changelogArray;
-    for(const auto& line : manifest.changelog.split('\n'))
-        changelogArray.append(line);
-    root["changelog"] = changelogArray;
-
-    QJsonObject filesObj;
-    for(auto it = manifest.files.constBegin(); it != manifest.files.constEnd(); ++it)
-        filesObj.insert(it.key(), QString::fromLatin1(it.value().toBase64()));
-    root["files"] = filesObj;
-
     QJsonDocument doc(root);
     QByteArray jsonData = doc.toJson(QJsonDocument::Indented);
 
@@ -168,6 +204,9 @@ bool writeManifest(const QString& jsonPath, const Manifest& manifest)
         QFile::remove(tmpPath);
         return false;
     }
+    // The rename must not be able to reach the disk before the data it points at.
+    tmpFile.flush();
+    Platform::syncFile(tmpFile.handle());
     tmpFile.close();
 
     if(QFile::exists(jsonPath) && !QFile::remove(jsonPath))
@@ -181,37 +220,370 @@ bool writeManifest(const QString& jsonPath, const Manifest& manifest)
         qWarning() << "Cannot rename" << tmpPath << "to" << jsonPath;
         return false;
     }
+    Platform::syncDirectory(QFileInfo(jsonPath).absolutePath());
 
     return true;
 }
 
-QHash<QString, QByteArray> hashDirectory(const QDir& directory)
+bool writeManifest(const QString& jsonPath, const Manifest& manifest)
 {
-    QHash<QString, QByteArray> files;
+    QJsonObject root;
+    root["version"] = manifest.version.toString();
+    root["app_exe"] = manifest.appExe;
 
-    QDirIterator it(directory.absolutePath(),
-                    QDir::Files | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot,
-                    QDirIterator::Subdirectories);
+    if(manifest.minVersion)
+        root["min_version"] = manifest.minVersion->toString();
 
-    while(it.hasNext())
+    QJsonArray changelogArray;
+    for(const auto& line : manifest.changelog.split('\n'))
+        changelogArray.append(line);
+    root["changelog"] = changelogArray;
+
+    QJsonObject filesObj;
+    for(auto it = manifest.files.constBegin(); it != manifest.files.constEnd(); ++it)
+        filesObj.insert(it.key(), QString::fromLatin1(it.value().toBase64()));
+    root["files"] = filesObj;
+
+    if(!manifest.patches.isEmpty())
     {
-        it.next();
-        QFileInfo info = it.fileInfo();
+        QJsonObject patchesObj;
+        for(auto it = manifest.patches.constBegin(); it != manifest.patches.constEnd(); ++it)
+        {
+            QJsonArray entries;
+            for(const auto& patch : it.value())
+            {
+                QJsonObject obj;
+                obj["from"] = QString::fromLatin1(patch.baseHash.toBase64());
+                obj["patch"] = patch.patchPath;
+                entries.append(obj);
+            }
+            patchesObj.insert(it.key(), entries);
+        }
+        root["patches"] = patchesObj;
+    }
 
-        if(info.isSymLink())
+    if(!manifest.blocks.isEmpty())
+    {
+        QJsonObject blocksObj;
+        for(auto it = manifest.blocks.constBegin(); it != manifest.blocks.constEnd(); ++it)
         {
-            qWarning() << "Skipping symlink:" << info.absoluteFilePath();
+            QJsonObject obj;
+            obj["block_size"] = it.value().blockSize;
+            obj["size"] = it.value().fileSize;
+            obj["sums"] = QString::fromLatin1(it.value().sums.toBase64());
+            blocksObj.insert(it.key(), obj);
+        }
+        root["blocks"] = blocksObj;
+    }
+
+    return writeJsonAtomically(jsonPath, root);
+}
+
+static QJsonArray toJsonArray(const QStringList& list)
+{
+    QJsonArray array;
+    for(const auto& s : list)
+        array.append(s);
+    return array;
+}
+
+static QStringList toStringList(const QJsonValue& value)
+{
+    QStringList list;
+    for(const auto& v : value.toArray())
+        if(v.isString())
+            list << v.toString();
+    return list;
+}
+
+std::optional<DeltaDescriptor> readDeltaDescriptor(const QString& jsonPath)
+{
+    QFile file(jsonPath);
+    if(!file.open(QFile::ReadOnly))
+    {
+        qWarning() << "Cannot open delta descriptor:" << jsonPath << file.errorString();
+        return std::nullopt;
+    }
+
+    QJsonParseError parseError;
+    QJsonDocument doc = QJsonDocument::fromJson(file.readAll(), &parseError);
+    file.close();
+
+    if(parseError.error != QJsonParseError::NoError || !doc.isObject())
+    {
+        qWarning() << "Invalid delta descriptor:" << jsonPath << parseError.errorString();
+        return std::nullopt;
+    }
+
+    QJsonObject root = doc.object();
+    DeltaDescriptor delta;
+    delta.baseVersion = QVersionNumber::fromString(root["base_version"].toString());
+    delta.version = QVersionNumber::fromString(root["version"].toString());
+    if(delta.baseVersion.isNull() || delta.version.isNull())
+    {
+        qWarning() << "Delta descriptor missing 'base_version' or 'version':" << jsonPath;
+        return std::nullopt;
+    }
+
+    delta.added = toStringList(root["added"]);
+    delta.updated = toStringList(root["updated"]);
+    delta.removed = toStringList(root["removed"]);
+
+    QJsonObject baseObj = root["base_files"].toObject();
+    for(auto it = baseObj.constBegin(); it != baseObj.constEnd(); ++it)
+        delta.baseFiles.insert(it.key(), QByteArray::fromBase64(it.value().toString().toLatin1()));
+
+    return delta;
+}
+
+bool writeDeltaDescriptor(const QString& jsonPath, const DeltaDescriptor& delta)
+{
+    QJsonObject root;
+    root["base_version"] = delta.baseVersion.toString();
+    root["version"] = delta.version.toString();
+    root["added"] = toJsonArray(delta.added);
+    root["updated"] = toJsonArray(delta.updated);
+    root["removed"] = toJsonArray(delta.removed);
+
+    QJsonObject baseObj;
+    for(auto it = delta.baseFiles.constBegin(); it != delta.baseFiles.constEnd(); ++it)
+        baseObj.insert(it.key(), QString::fromLatin1(it.value().toBase64()));
+    root["base_files"] = baseObj;
+
+    return writeJsonAtomically(jsonPath, root);
+}
+
+std::optional<Manifest> loadDeltaBase(const QString& path, const QString& appExe)
+{
+    QFileInfo info(path);
+    if(info.isFile())
+        return readManifest(info.absoluteFilePath());
+
+    QDir baseDir(path);
+    if(!baseDir.exists())
+    {
+        qCritical().noquote() << "Delta base does not exist:" << path;
+        return std::nullopt;
+    }
+
+    if(baseDir.exists("manifest.json"))
+        return readManifest(baseDir.absoluteFilePath("manifest.json"));
+
+    auto version = Platform::readExeVersion(baseDir.absoluteFilePath(appExe));
+    if(!version)
+    {
+        qCritical().noquote() << "Cannot read version of delta base from:"
+                              << baseDir.absoluteFilePath(appExe);
+        return std::nullopt;
+    }
+
+    Manifest base;
+    base.version = version.value();
+    base.appExe = appExe;
+    base.files = hashDirectory(baseDir);
+    return base;
+}
+
+static bool writePatchFile(const QString& path, const QByteArray& data)
+{
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QFile file(path);
+    if(!file.open(QFile::WriteOnly | QFile::Truncate))
+    {
+        qCritical().noquote() << "Cannot write patch file:" << path << file.errorString();
+        return false;
+    }
+    bool ok = file.write(data) == data.size();
+    file.close();
+    return ok;
+}
+
+// Returns a patch for relPath when it is worth shipping instead of the full file.
+// Both files and the block index are held in memory while diffing; larger files are
+// shipped in full.
+static const qint64 kMaxPatchInputSize = 512LL * 1024 * 1024;
+
+// The file's content, mapped rather than read where possible. Valid while file is open.
+static QByteArray mapContent(QFile& file)
+{
+    if(file.size() == 0)
+        return QByteArray();
+    if(const uchar* data = file.map(0, file.size()))
+        return QByteArray::fromRawData(reinterpret_cast<const char*>(data), static_cast<qsizetype>(file.size()));
+    return file.readAll();
+}
+
+static QByteArray makeWorthwhilePatch(const QString& basePath, const QString& newPath,
+                                      const QByteArray& expectedBaseHash)
+{
+    QFile baseFile(basePath);
+    QFile newFile(newPath);
+    if(!baseFile.open(QFile::ReadOnly) || !newFile.open(QFile::ReadOnly))
+        return {};
+    if(baseFile.size() > kMaxPatchInputSize || newFile.size() > kMaxPatchInputSize)
+    {
+        qInfo().noquote() << "Not diffing" << newPath << "- larger than"
+                          << kMaxPatchInputSize / (1024 * 1024) << "MiB, shipped in full";
+        return {};
+    }
+
+    QByteArray baseData = mapContent(baseFile);
+    QByteArray newData = mapContent(newFile);
+    if(QCryptographicHash::hash(baseData, QCryptographicHash::Sha256) != expectedBaseHash)
+        return {};
+
+    QByteArray patch = createBinaryPatch(baseData, newData);
+    if(patch.size() >= newData.size() / 2)
+        return {};
+    return patch;
+}
+
+bool writeDeltaPackage(const QDir& releaseDir, const Manifest& release,
+                       const Manifest& base, const QDir& outputDir,
+                       const QString& baseDir)
+{
+    DeltaDescriptor delta;
+    delta.baseVersion = base.version;
+    delta.version = release.version;
+
+    for(auto it = release.files.constBegin(); it != release.files.constEnd(); ++it)
+    {
+        if(!base.files.contains(it.key()))
+            delta.added << it.key();
+        else if(base.files.value(it.key()) != it.value())
+        {
+            delta.updated << it.key();
+            delta.baseFiles.insert(it.key(), base.files.value(it.key()));
+        }
+    }
+    for(auto it = base.files.constBegin(); it != base.files.constEnd(); ++it)
+    {
+        if(!release.files.contains(it.key()))
+        {
+            delta.removed << it.key();
+            delta.baseFiles.insert(it.key(), it.value());
+        }
+    }
+    delta.added.sort();
+    delta.updated.sort();
+    delta.removed.sort();
+
+    if(!outputDir.exists() && !QDir().mkpath(outputDir.absolutePath()))
+    {
+        qCritical().noquote() << "Cannot create delta package directory:" << outputDir.absolutePath();
+        return false;
+    }
+
+    Manifest packaged = release;
+    packaged.patches.clear();
+
+    QStringList fullFiles = delta.added;
+    for(const auto& relPath : delta.updated)
+    {
+        QByteArray patch;
+        if(!baseDir.isEmpty())
+            patch = makeWorthwhilePatch(QDir(baseDir).filePath(relPath), releaseDir.filePath(relPath),
+                                        delta.baseFiles.value(relPath));
+        if(patch.isEmpty())
+        {
+            fullFiles << relPath;
             continue;
         }
 
-        if(shouldSkipFile(info.fileName()))
+        FilePatch filePatch;
+        filePatch.baseHash = delta.baseFiles.value(relPath);
+        filePatch.patchPath = ".patches/" + relPath + ".patch";
+        if(!writePatchFile(outputDir.filePath(filePatch.patchPath), patch))
+            return false;
+        packaged.patches[relPath].append(filePatch);
+    }
+
+    for(const auto& relPath : fullFiles)
+    {
+        QString srcPath = releaseDir.filePath(relPath);
+        QString dstPath = outputDir.filePath(relPath);
+        QDir().mkpath(QFileInfo(dstPath).absolutePath());
+        if(QFile::exists(dstPath))
+            QFile::remove(dstPath);
+        if(!QFile::copy(srcPath, dstPath))
+        {
+            qCritical().noquote() << "Cannot copy" << srcPath << "into delta package";
+            return false;
+        }
+        QFile::setPermissions(dstPath, QFileInfo(srcPath).permissions());
+    }
+
+    if(!writeManifest(outputDir.filePath("manifest.json"), packaged))
+        return false;
+
+    return writeDeltaDescriptor(outputDir.filePath("delta.json"), delta);
+}
+
+QString generateDeltaPackage(const QDir& releaseDir, const Manifest& release,
+                             const QString& deltaFrom)
+{
+    auto base = loadDeltaBase(deltaFrom, release.appExe);
+    if(!base)
+    {
+        qCritical().noquote() << "Cannot load delta base:" << deltaFrom;
+        return {};
+    }
+
+    if(QVersionNumber::compare(base->version, release.version) >= 0)
+    {
+        qCritical().noquote()
+            << "Delta base version" << base->version.toString()
+            << "is not older than release version" << release.version.toString();
+        return {};
+    }
+
+    QDir parentDir(releaseDir.absolutePath());
+    parentDir.cdUp();
+    QString packageName = releaseDir.dirName() + "_delta_" + base->version.toString();
+    QDir packageDir(parentDir.filePath(packageName));
+    if(packageDir.exists())
+        packageDir.removeRecursively();
+
+    QString baseDir = QFileInfo(deltaFrom).isDir() ? deltaFrom : QString();
+    if(!writeDeltaPackage(releaseDir, release, base.value(), packageDir, baseDir))
+    {
+        packageDir.removeRecursively();
+        return {};
+    }
+
+    return packageDir.absolutePath();
+}
+
+QHash<QString, QByteArray> hashDirectory(const QDir& directory, QStringList* failedPaths)
+{
+    return hashDirectory(DirectorySnapshot::scan(directory), failedPaths);
+}
+
+QHash<QString, QByteArray> hashDirectory(const DirectorySnapshot& snapshot, QStringList* failedPaths)
+{
+    QHash<QString, QByteArray> files;
+    const QDir& root = snapshot.root();
+
+    for(const auto& relPath : snapshot.files())
+    {
+        QString absPath = root.absoluteFilePath(relPath);
+        if(snapshot.entry(relPath)->type == DirectoryEntry::Symlink)
+        {
+            qWarning() << "Skipping symlink:" << absPath;
             continue;
+        }
 
-        QByteArray hash = hashFile(info.absoluteFilePath());
+        if(shouldSkipFile(QFileInfo(relPath).fileName()))
+            continue;
+
+        QByteArray hash = hashFile(absPath);
         if(hash.isEmpty())
+        {
+            if(failedPaths)
+                failedPaths->append(absPath);
             continue;
+        }
 
-        QString relPath = directory.relativeFilePath(info.absoluteFilePath());
         files.insert(relPath, hash);
     }
 
@@ -219,7 +591,8 @@ QHash<QString, QByteArray> hashDirectory(const QDir& directory)
 }
 
 std::optional<Manifest> generateManifest(const QDir& directory, const QString& appExe,
-                                         const std::optional<QVersionNumber>& minVersion)
+                                         const std::optional<QVersionNumber>& minVersion,
+                                         qint64 blockChecksumMinSize)
 {
     if(!directory.exists(appExe))
     {
@@ -245,6 +618,7 @@ std::optional<Manifest> generateManifest(const QDir& directory, const QString& a
     }
 
     QHash<QString, QByteArray> files;
+    QHash<QString, BlockChecksums> blocks;
     QDirIterator it(directory.absolutePath(),
                     QDir::Files | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot,
                     QDirIterator::Subdirectories);
@@ -272,6 +646,18 @@ std::optional<Manifest> generateManifest(const QDir& directory, const QString& a
 
         QString relPath = directory.relativeFilePath(info.absoluteFilePath());
         files.insert(relPath, hash);
+
+        if(blockChecksumMinSize > 0 && info.size() >= blockChecksumMinSize)
+        {
+            auto sums = computeBlockChecksums(info.absoluteFilePath(), blockSizeFor(info.size()));
+            if(!sums)
+            {
+                qCritical().noquote() << "Cannot checksum blocks of" << info.absoluteFilePath()
+                                      << "- aborting generation";
+                return std::nullopt;
+            }
+            blocks.insert(relPath, sums.value());
+        }
     }
 
     if(minVersion && QVersionNumber::compare(*minVersion, version.value()) > 0)
@@ -287,6 +673,7 @@ std::optional<Manifest> generateManifest(const QDir& directory, const QString& a
     manifest.minVersion = minVersion;
     manifest.appExe = appExe;
     manifest.files = files;
+    manifest.blocks = blocks;
 
     if(!writeManifest(manifestPath, manifest))
     {
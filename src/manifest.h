@@ -1,18 +1,40 @@
 #ifndef MANIFEST_H
 #define MANIFEST_H
 
+#include "binarypatch.h"
+#include "directorysnapshot.h"
+
 #include <QDir>
 #include <QHash>
 #include <QString>
 #include <QVersionNumber>
 #include <optional>
 
+// Binary patch that rebuilds a file's new content from a known older version of it.
+struct FilePatch {
+    QByteArray baseHash;  // sha256 of the file the patch applies to (raw bytes)
+    QString patchPath;    // patch file, relative to the source root
+};
+
 struct Manifest {
     QVersionNumber version;
     std::optional<QVersionNumber> minVersion;
     QString appExe;
     QString changelog;
     QHash<QString, QByteArray> files;  // relativePath -> sha256 hash (raw bytes)
+    QHash<QString, QList<FilePatch>> patches;  // relativePath -> patches producing files[relativePath]
+    QHash<QString, BlockChecksums> blocks;     // relativePath -> block checksums for range fetching
+};
+
+// Describes a version-to-version delta package (delta.json). The package carries the
+// full manifest.json of the new version plus only the added and updated files.
+struct DeltaDescriptor {
+    QVersionNumber baseVersion;
+    QVersionNumber version;
+    QStringList added;
+    QStringList updated;
+    QStringList removed;
+    QHash<QString, QByteArray> baseFiles;  // updated/removed relativePath -> base sha256
 };
 
 // Read manifest from manifest.json. Returns nullopt on failure, logs reason.
@@ -22,12 +44,40 @@ std::optional<Manifest> readManifest(const QString& jsonPath);
 bool writeManifest(const QString& jsonPath, const Manifest& manifest);
 
 // Generate manifest by scanning directory. Hashes all files, auto-detects version from appExe.
+// Files of at least blockChecksumMinSize bytes also get block checksums (0 disables).
 // Returns nullopt on any failure (file unreadable, version undetectable).
 std::optional<Manifest> generateManifest(const QDir& directory, const QString& appExe,
-                                         const std::optional<QVersionNumber>& minVersion);
+                                         const std::optional<QVersionNumber>& minVersion,
+                                         qint64 blockChecksumMinSize = 0);
+
+// Read/write delta.json. Same conventions as the manifest functions.
+std::optional<DeltaDescriptor> readDeltaDescriptor(const QString& jsonPath);
+bool writeDeltaDescriptor(const QString& jsonPath, const DeltaDescriptor& delta);
+
+// Load the base release of a delta from a manifest.json path or a release directory.
+// A directory without manifest.json is hashed and versioned from appExe.
+std::optional<Manifest> loadDeltaBase(const QString& path, const QString& appExe);
+
+// Write a delta package into outputDir: manifest.json, delta.json and the files that
+// were added or changed between base and release, copied from releaseDir. When baseDir
+// holds the base release, changed files ship as binary patches under .patches/ instead
+// whenever the patch is less than half the size of the file.
+bool writeDeltaPackage(const QDir& releaseDir, const Manifest& release,
+                       const Manifest& base, const QDir& outputDir,
+                       const QString& baseDir = {});
+
+// Build the delta package for a freshly generated release next to releaseDir,
+// named <release>_delta_<baseVersion>. Returns the package path, empty on failure.
+QString generateDeltaPackage(const QDir& releaseDir, const Manifest& release,
+                             const QString& deltaFrom);
 
 // Scan a directory and hash all files, returning relativePath -> sha256 map.
-// Skips manifest.json, manifest.json.tmp, updateInfo.ini, and symlinks.
-QHash<QString, QByteArray> hashDirectory(const QDir& directory);
+// Skips manifest.json, manifest.json.tmp, updateInfo.ini, and symlinks. Absolute paths
+// of files that could not be read (e.g. locked) are appended to failedPaths if given.
+QHash<QString, QByteArray> hashDirectory(const QDir& directory, QStringList* failedPaths = nullptr);
+
+// Same as above for the files of an existing snapshot, without listing the tree again.
+QHash<QString, QByteArray> hashDirectory(const DirectorySnapshot& snapshot,
+                                         QStringList* failedPaths = nullptr);
 
 #endif // MANIFEST_H
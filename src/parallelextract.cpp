@@ -0,0 +1,68 @@
+#include "parallelextract.h"
+
+#include <QMutex>
+#include <QThread>
+#include <QThreadPool>
+#include <algorithm>
+#include <atomic>
+
+bool runExtractJobs(QList<ExtractJob> jobs,
+                    const std::function<void(const ExtractJob& job, bool ok)>& done,
+                    const std::function<bool()>& cancelled, QString* error,
+                    int threadCount)
+{
+    if(jobs.isEmpty())
+        return true;
+
+    std::stable_sort(jobs.begin(), jobs.end(), [](const ExtractJob& a, const ExtractJob& b) {
+        return a.size > b.size;
+    });
+    const QList<ExtractJob>& ordered = jobs;
+
+    // Workers take the next job from a shared counter instead of being handed a fixed
+    // share, so the largest-first order holds across all of them.
+    std::atomic<int> next{0};
+    std::atomic<bool> stop{false};
+    QMutex mutex;
+    QString firstError;
+
+    auto worker = [&]() {
+        for(int i = next++; i < ordered.size(); i = next++)
+        {
+            if(stop || (cancelled && cancelled()))
+            {
+                stop = true;
+                return;
+            }
+
+            QString jobError;
+            bool ok = ordered.at(i).run(&jobError);
+
+            QMutexLocker locker(&mutex);
+            if(done)
+                done(ordered.at(i), ok);
+            if(!ok)
+            {
+                if(firstError.isEmpty())
+                    firstError = jobError.isEmpty() ? "Cannot extract " + ordered.at(i).name : jobError;
+                stop = true;
+                return;
+            }
+        }
+    };
+
+    int threads = threadCount > 0 ? threadCount : QThread::idealThreadCount();
+    threads = qBound(1, threads, int(jobs.size()));
+
+    // A pool of our own: the caller may itself be running on the global pool.
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+    for(int i = 1; i < threads; ++i)
+        pool.start(worker);
+    worker();
+    pool.waitForDone();
+
+    if(error && !firstError.isEmpty())
+        *error = firstError;
+    return !stop;
+}
@@ -0,0 +1,26 @@
+#ifndef PARALLELEXTRACT_H
+#define PARALLELEXTRACT_H
+
+#include <QList>
+#include <QString>
+#include <functional>
+
+// One archive entry to decompress. run must not depend on any other job: jobs run on
+// several threads at once and in no fixed order.
+struct ExtractJob {
+    QString name;
+    qint64 size = 0;  // decompressed size, used to schedule the job
+    std::function<bool(QString* error)> run;
+};
+
+// Run jobs on a private pool of worker threads, largest first, so that one big entry
+// started last does not leave the other cores idle at the end. done is called once per
+// finished job, serialized, from the worker that ran it. After the first failure or
+// once cancelled returns true no further job is started. Returns true if every job
+// ran and succeeded; error holds the first failure.
+bool runExtractJobs(QList<ExtractJob> jobs,
+                    const std::function<void(const ExtractJob& job, bool ok)>& done,
+                    const std::function<bool()>& cancelled, QString* error,
+                    int threadCount = 0);
+
+#endif // PARALLELEXTRACT_H
@@ -1,6 +1,8 @@
 #include "platform.h"
 
+#include <QDebug>
 #include <QDir>
+#include <QElapsedTimer>
 #include <QFile>
 #include <QFileInfo>
 #include <QProcess>
@@ -10,7 +12,20 @@
 #include <QTextStream>
 
 #include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <poll.h>
 #include <signal.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
 
 namespace Platform {
 
@@ -140,71 +155,486 @@ std::optional<QVersionNumber> readExeVersion(const QString& exePath)
     return ver;
 }
 
-QList<LockedProcess> findLockingProcesses(const QStringList& absolutePaths)
+static QString processName(quint64 pid)
 {
-    QList<LockedProcess> result;
-    if(absolutePaths.isEmpty())
-        return result;
+    QFile commFile(QString("/proc/%1/comm").arg(pid));
+    if(commFile.open(QFile::ReadOnly))
+        return QString::fromUtf8(commFile.readAll()).trimmed();
+    return QString::number(pid);
+}
 
-    QSet<QString> pathSet(absolutePaths.begin(), absolutePaths.end());
-    QSet<quint64> seenPids;
+// Files mmap'ed by a process (shared libraries, mapped data), from /proc/<pid>/maps.
+// The device number in maps is the superblock's and can differ from st_dev (btrfs
+// subvolumes, overlayfs), so map_files/<range> is stat'ed once per distinct file to get
+// the real identity; where map_files is not readable the maps values are used as-is.
+static QList<QPair<quint64, quint64>> mappedFiles(unsigned long long pid)
+{
+    QList<QPair<quint64, quint64>> result;
 
-    QDir procDir("/proc");
-    auto entries = procDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    char path[64];
+    std::snprintf(path, sizeof(path), "/proc/%llu/maps", pid);
+    QFile maps(QString::fromLatin1(path));
+    if(!maps.open(QFile::ReadOnly))
+        return result;
+    const QByteArray content = maps.readAll();
+    maps.close();
+
+    std::snprintf(path, sizeof(path), "/proc/%llu/map_files", pid);
+    int mapFilesDir = ::open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
 
-    for(const auto& entry : entries)
+    QSet<QPair<quint64, quint64>> seen;
+    qsizetype lineStart = 0;
+    while(lineStart < content.size())
     {
+        qsizetype lineEnd = content.indexOf('\n', lineStart);
+        if(lineEnd < 0)
+            lineEnd = content.size();
+        QByteArrayView line(content.constData() + lineStart, lineEnd - lineStart);
+        lineStart = lineEnd + 1;
+
+        // address perms offset dev inode [path]
+        QByteArrayView fields[5];
+        int count = 0;
+        qsizetype pos = 0;
+        while(count < 5 && pos <= line.size())
+        {
+            qsizetype space = line.indexOf(' ', pos);
+            if(space < 0)
+                space = line.size();
+            fields[count++] = line.sliced(pos, space - pos);
+            pos = space + 1;
+        }
+        if(count < 5)
+            continue;
+
         bool ok = false;
-        quint64 pid = entry.toULongLong(&ok);
-        if(!ok)
+        quint64 inode = fields[4].toULongLong(&ok);
+        qsizetype colon = fields[3].indexOf(':');
+        if(!ok || inode == 0 || colon < 0)
             continue;
 
-        QString fdDir = QString("/proc/%1/fd").arg(pid);
-        QDir fd(fdDir);
-        if(!fd.exists())
+        bool majorOk = false;
+        bool minorOk = false;
+        uint major = fields[3].first(colon).toUInt(&majorOk, 16);
+        uint minor = fields[3].sliced(colon + 1).toUInt(&minorOk, 16);
+        if(!majorOk || !minorOk)
             continue;
 
-        auto fds = fd.entryList(QDir::NoDotAndDotDot);
-        for(const auto& fdEntry : fds)
+        QPair<quint64, quint64> id(makedev(major, minor), inode);
+        if(seen.contains(id))
+            continue;
+        seen.insert(id);
+
+        if(mapFilesDir >= 0)
         {
-            QFileInfo fi(fdDir + "/" + fdEntry);
-            if(!fi.isSymLink())
+            struct stat st;
+            if(::fstatat(mapFilesDir, fields[0].toByteArray().constData(), &st, 0) == 0)
+                id = QPair<quint64, quint64>(st.st_dev, st.st_ino);
+        }
+        result.append(id);
+    }
+
+    if(mapFilesDir >= 0)
+        ::close(mapFilesDir);
+    return result;
+}
+
+LockSnapshot LockSnapshot::capture()
+{
+    LockSnapshot snapshot;
+
+    DIR* proc = ::opendir("/proc");
+    if(!proc)
+        return snapshot;
+
+    while(dirent* entry = ::readdir(proc))
+    {
+        char* end = nullptr;
+        unsigned long long pid = std::strtoull(entry->d_name, &end, 10);
+        if(end == entry->d_name || *end != '\0')
+            continue;
+
+        // stat() through the fd symlinks yields the open file's identity directly,
+        // without resolving and comparing path strings.
+        char fdPath[64];
+        std::snprintf(fdPath, sizeof(fdPath), "/proc/%llu/fd", pid);
+        DIR* fds = ::opendir(fdPath);
+        if(!fds)
+            continue; // exited, or owned by another user; its maps are unreadable too
+
+        const int fdDir = ::dirfd(fds);
+        while(dirent* fdEntry = ::readdir(fds))
+        {
+            if(fdEntry->d_name[0] == '.')
                 continue;
 
-            if(pathSet.contains(fi.symLinkTarget()) && !seenPids.contains(pid))
-            {
-                seenPids.insert(pid);
+            struct stat st;
+            if(::fstatat(fdDir, fdEntry->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode))
+                continue;
 
-                QString name = QString::number(pid);
-                QFile commFile(QString("/proc/%1/comm").arg(pid));
-                if(commFile.open(QFile::ReadOnly))
-                {
-                    name = QString::fromUtf8(commFile.readAll()).trimmed();
-                    commFile.close();
-                }
+            QPair<quint64, quint64> id(st.st_dev, st.st_ino);
+            if(!snapshot.m_pidsByFile.contains(id, pid))
+                snapshot.m_pidsByFile.insert(id, pid);
+        }
+        ::closedir(fds);
 
-                LockedProcess lp;
-                lp.pid = pid;
-                lp.name = name;
-                result.append(lp);
-                break;
-            }
+        for(const auto& id : mappedFiles(pid))
+        {
+            if(!snapshot.m_pidsByFile.contains(id, pid))
+                snapshot.m_pidsByFile.insert(id, pid);
+        }
+    }
+
+    ::closedir(proc);
+    return snapshot;
+}
+
+QList<LockedProcess> LockSnapshot::lockersOf(const QStringList& absolutePaths) const
+{
+    QList<LockedProcess> result;
+    QSet<quint64> seenPids;
+
+    for(const auto& path : absolutePaths)
+    {
+        struct stat st;
+        if(::stat(QFile::encodeName(path).constData(), &st) != 0)
+            continue;
+
+        const auto pids = m_pidsByFile.values(QPair<quint64, quint64>(st.st_dev, st.st_ino));
+        for(quint64 pid : pids)
+        {
+            if(seenPids.contains(pid))
+                continue;
+            seenPids.insert(pid);
+
+            LockedProcess lp;
+            lp.pid = pid;
+            lp.name = processName(pid);
+            result.append(lp);
         }
     }
 
     return result;
 }
 
+QList<LockedProcess> findLockingProcesses(const QStringList& absolutePaths)
+{
+    if(absolutePaths.isEmpty())
+        return {};
+    return LockSnapshot::capture().lockersOf(absolutePaths);
+}
+
 bool killProcess(quint64 pid)
 {
     return ::kill(static_cast<pid_t>(pid), SIGKILL) == 0;
 }
 
+bool killProcessesAndWait(const QList<quint64>& pids, int timeoutMs)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    // A pidfd becomes readable the moment its process exits, so every kill is waited on
+    // at once with poll(). Kernels without pidfd support (< 5.3) fall back to probing.
+    QList<pollfd> waits;
+    QList<pid_t> probed;
+    bool allSignalled = true;
+    for(quint64 pid : pids)
+    {
+        int pidfd = -1;
+#ifdef SYS_pidfd_open
+        pidfd = static_cast<int>(::syscall(SYS_pidfd_open, static_cast<pid_t>(pid), 0));
+#endif
+        if(pidfd >= 0)
+        {
+            bool signalled = false;
+#ifdef SYS_pidfd_send_signal
+            signalled = ::syscall(SYS_pidfd_send_signal, pidfd, SIGKILL, nullptr, 0) == 0;
+#endif
+            // A process that could not be signalled (EPERM) is not waited on: it would
+            // only run out the timeout.
+            if(!signalled && ::kill(static_cast<pid_t>(pid), SIGKILL) != 0 && errno != ESRCH)
+            {
+                allSignalled = false;
+                ::close(pidfd);
+                continue;
+            }
+            waits.append({pidfd, POLLIN, 0});
+        }
+        else if(::kill(static_cast<pid_t>(pid), SIGKILL) == 0)
+        {
+            probed.append(static_cast<pid_t>(pid));
+        }
+        else if(errno != ESRCH)
+        {
+            allSignalled = false;
+        }
+    }
+
+    while(!waits.isEmpty())
+    {
+        qint64 remaining = timeoutMs - timer.elapsed();
+        if(remaining <= 0)
+            break;
+        if(::poll(waits.data(), static_cast<nfds_t>(waits.size()), static_cast<int>(remaining)) < 0
+           && errno != EINTR)
+            break;
+
+        for(qsizetype i = waits.size() - 1; i >= 0; --i)
+        {
+            if(waits[i].revents != 0)
+            {
+                ::close(waits[i].fd);
+                waits.removeAt(i);
+            }
+        }
+    }
+
+    while(!probed.isEmpty() && timer.elapsed() < timeoutMs)
+    {
+        probed.removeIf([](pid_t pid) { return ::kill(pid, 0) != 0 && errno == ESRCH; });
+        if(!probed.isEmpty())
+            ::usleep(10 * 1000);
+    }
+
+    bool allExited = allSignalled && waits.isEmpty() && probed.isEmpty();
+    for(const auto& w : waits)
+        ::close(w.fd);
+    return allExited;
+}
+
+bool waitForLockRelease(const QList<quint64>& pids, const QStringList& paths, int timeoutMs,
+                        const std::function<bool()>& cancelled)
+{
+    static const int kCancelCheckMs = 250;
+
+    QList<pollfd> fds;
+    for(quint64 pid : pids)
+    {
+#ifdef SYS_pidfd_open
+        int pidfd = static_cast<int>(::syscall(SYS_pidfd_open, static_cast<pid_t>(pid), 0));
+        if(pidfd >= 0)
+            fds.append({pidfd, POLLIN, 0});
+#else
+        Q_UNUSED(pid);
+#endif
+    }
+
+    int inotifyFd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(inotifyFd >= 0)
+    {
+        for(const auto& path : paths)
+        {
+            ::inotify_add_watch(inotifyFd, QFile::encodeName(path).constData(),
+                                IN_CLOSE | IN_DELETE_SELF | IN_MOVE_SELF);
+        }
+        fds.append({inotifyFd, POLLIN, 0});
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    bool woken = false;
+    while(!woken)
+    {
+        qint64 remaining = timeoutMs - timer.elapsed();
+        if(remaining <= 0 || (cancelled && cancelled()))
+            break;
+
+        int slice = static_cast<int>(qMin<qint64>(remaining, kCancelCheckMs));
+        if(fds.isEmpty())
+        {
+            ::usleep(slice * 1000);
+            continue;
+        }
+        woken = ::poll(fds.data(), static_cast<nfds_t>(fds.size()), slice) > 0;
+    }
+
+    for(const auto& p : fds)
+        ::close(p.fd);
+    return woken;
+}
+
+// Record layout returned by getdents64(2); glibc does not export it.
+struct LinuxDirent64 {
+    quint64 d_ino;
+    qint64 d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+
+static bool statEntry(int dirFd, const char* name, bool follow, struct stat* st, quint64* size)
+{
+#ifdef STATX_TYPE
+    struct statx stx;
+    int flags = AT_NO_AUTOMOUNT | AT_STATX_DONT_SYNC | (follow ? 0 : AT_SYMLINK_NOFOLLOW);
+    if(::statx(dirFd, name, flags, STATX_TYPE | STATX_SIZE | STATX_INO, &stx) != 0)
+        return false;
+    st->st_mode = stx.stx_mode;
+    st->st_ino = stx.stx_ino;
+    *size = stx.stx_size;
+    return true;
+#else
+    if(::fstatat(dirFd, name, st, follow ? 0 : AT_SYMLINK_NOFOLLOW) != 0)
+        return false;
+    *size = static_cast<quint64>(st->st_size);
+    return true;
+#endif
+}
+
+// Returns false when part of the level could not be read. Entries removed while the
+// scan runs (ENOENT) are not an error.
+static bool scanLevel(int dirFd, const QString& prefix,
+                      const std::function<void(const QString&, const DirectoryEntry&)>& visit)
+{
+    static const int kBufferSize = 64 * 1024;
+    QByteArray buffer(kBufferSize, Qt::Uninitialized);
+
+    while(true)
+    {
+        long bytes = ::syscall(SYS_getdents64, dirFd, buffer.data(), kBufferSize);
+        if(bytes == 0)
+            return true;
+        if(bytes < 0)
+            return errno == ENOENT;
+
+        for(long offset = 0; offset < bytes;)
+        {
+            const auto* dirent = reinterpret_cast<const LinuxDirent64*>(buffer.constData() + offset);
+            offset += dirent->d_reclen;
+
+            const char* name = dirent->d_name;
+            if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+                continue;
+
+            QString relPath = prefix + QFile::decodeName(name);
+            DirectoryEntry entry;
+            entry.inode = dirent->d_ino;
+
+            // Directories are known from d_type alone; everything else needs statx for its
+            // size, or for filesystems that report DT_UNKNOWN.
+            unsigned char type = dirent->d_type;
+            struct stat st;
+            quint64 size = 0;
+            if(type != DT_DIR)
+            {
+                if(!statEntry(dirFd, name, false, &st, &size))
+                {
+                    if(errno == ENOENT)
+                        continue;
+                    return false;
+                }
+                type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG
+                     : S_ISLNK(st.st_mode) ? DT_LNK : DT_UNKNOWN;
+            }
+
+            if(type == DT_REG)
+            {
+                entry.type = DirectoryEntry::File;
+                entry.size = static_cast<qint64>(size);
+            }
+            else if(type == DT_LNK)
+            {
+                quint64 targetSize = 0;
+                bool toDir = statEntry(dirFd, name, true, &st, &targetSize) && S_ISDIR(st.st_mode);
+                entry.type = toDir ? DirectoryEntry::Other : DirectoryEntry::Symlink;
+            }
+            else if(type == DT_DIR)
+            {
+                entry.type = DirectoryEntry::Directory;
+                visit(relPath, entry);
+
+                int childFd = ::openat(dirFd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+                if(childFd < 0)
+                {
+                    if(errno == ENOENT)
+                        continue;
+                    return false;
+                }
+                bool complete = scanLevel(childFd, relPath + '/', visit);
+                ::close(childFd);
+                if(!complete)
+                    return false;
+                continue;
+            }
+
+            visit(relPath, entry);
+        }
+    }
+}
+
+bool scanDirectoryTree(const QString& root,
+                       const std::function<void(const QString&, const DirectoryEntry&)>& visit)
+{
+    int rootFd = ::open(QFile::encodeName(root).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(rootFd < 0)
+        return false;
+
+    bool complete = scanLevel(rootFd, QString(), visit);
+    int error = errno;
+    ::close(rootFd);
+    if(!complete)
+        qWarning().noquote() << "Directory scan of" << root << "failed:" << qt_error_string(error);
+    return complete;
+}
+
 bool isFileLockError()
 {
     return errno == ETXTBSY || errno == EBUSY;
 }
 
+bool syncFile(int fd)
+{
+    return ::fdatasync(fd) == 0;
+}
+
+bool syncFile(const QString& path)
+{
+    int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return false;
+    bool synced = ::fdatasync(fd) == 0;
+    ::close(fd);
+    return synced;
+}
+
+void startWriteback(const QString& path)
+{
+    int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return;
+    ::sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+    ::close(fd);
+}
+
+bool syncFilesystem(const QString& path)
+{
+    int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return false;
+    bool synced = ::syncfs(fd) == 0;
+    ::close(fd);
+    return synced;
+}
+
+bool syncDirectory(const QString& path)
+{
+    int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(fd < 0)
+        return false;
+    bool synced = ::fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+}
+
+std::optional<quint64> deviceId(const QString& path)
+{
+    struct stat st;
+    if(::stat(QFile::encodeName(path).constData(), &st) != 0)
+        return std::nullopt;
+    return quint64(st.st_dev);
+}
+
 bool renameSelfForUpdate(const QString& selfPath)
 {
     QString oldPath = selfPath + "_old";
@@ -230,4 +660,80 @@ bool setExecutablePermission(const QString& path)
                                              | QFileDevice::ExeOther);
 }
 
+bool createHardLink(const QString& existingPath, const QString& newPath)
+{
+    return ::link(QFile::encodeName(existingPath).constData(),
+                  QFile::encodeName(newPath).constData()) == 0;
+}
+
+bool cloneFile(const QString& existingPath, const QString& newPath)
+{
+    int src = ::open(QFile::encodeName(existingPath).constData(), O_RDONLY | O_CLOEXEC);
+    if(src < 0)
+        return false;
+
+    struct stat st;
+    if(::fstat(src, &st) != 0)
+    {
+        ::close(src);
+        return false;
+    }
+
+    QByteArray dstName = QFile::encodeName(newPath);
+    int dst = ::open(dstName.constData(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, st.st_mode & 07777);
+    if(dst < 0)
+    {
+        ::close(src);
+        return false;
+    }
+
+    bool cloned = ::ioctl(dst, FICLONE, src) == 0;
+    ::close(dst);
+    ::close(src);
+    if(!cloned)
+        ::unlink(dstName.constData());
+    return cloned;
+}
+
+bool exchangePaths(const QString& first, const QString& second)
+{
+#ifdef SYS_renameat2
+    // Called through syscall() because older glibc has no renameat2() wrapper.
+    return ::syscall(SYS_renameat2, AT_FDCWD, QFile::encodeName(first).constData(),
+                     AT_FDCWD, QFile::encodeName(second).constData(), RENAME_EXCHANGE) == 0;
+#else
+    Q_UNUSED(first);
+    Q_UNUSED(second);
+    errno = ENOSYS;
+    return false;
+#endif
+}
+
+bool replaceSymlink(const QString& linkPath, const QString& target)
+{
+    QByteArray link = QFile::encodeName(linkPath);
+    QByteArray tmp = link + ".tmp";
+    ::unlink(tmp.constData());
+    if(::symlink(QFile::encodeName(target).constData(), tmp.constData()) != 0)
+        return false;
+
+    // rename() replaces the old link itself, not the directory it points to.
+    if(::rename(tmp.constData(), link.constData()) != 0)
+    {
+        ::unlink(tmp.constData());
+        return false;
+    }
+    return true;
+}
+
+std::optional<QString> readSymlink(const QString& linkPath)
+{
+    QByteArray target(PATH_MAX, Qt::Uninitialized);
+    ssize_t length = ::readlink(QFile::encodeName(linkPath).constData(), target.data(), target.size());
+    if(length < 0 || length >= target.size())
+        return std::nullopt;
+    target.truncate(length);
+    return QFile::decodeName(target);
+}
+
 } // namespace Platform
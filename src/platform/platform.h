@@ -1,9 +1,14 @@
 #pragma once
 
+#include "directorysnapshot.h"
+
 #include <QList>
+#include <QMultiHash>
+#include <QPair>
 #include <QString>
 #include <QStringList>
 #include <QVersionNumber>
+#include <functional>
 #include <optional>
 
 namespace Platform {
@@ -21,13 +26,86 @@ struct LockedProcess {
     QString name;
 };
 
+// Point-in-time view of the files held open by running processes. On Linux capture()
+// walks /proc once and indexes every open or mmap'ed file (fd and maps) by
+// (device, inode), so lockers of any
+// number of paths can be looked up without another scan. On Windows nothing is indexed
+// and lookups query the Restart Manager.
+class LockSnapshot {
+public:
+    static LockSnapshot capture();
+    QList<LockedProcess> lockersOf(const QStringList& absolutePaths) const;
+
+private:
+    QMultiHash<QPair<quint64, quint64>, quint64> m_pidsByFile;
+};
+
+// Equivalent to LockSnapshot::capture().lockersOf(absolutePaths).
 QList<LockedProcess> findLockingProcesses(const QStringList& absolutePaths);
 bool killProcess(quint64 pid);
 
+// Forcefully terminate all pids and wait until every one of them has exited, up to
+// timeoutMs in total. Returns true when all are gone.
+bool killProcessesAndWait(const QList<quint64>& pids, int timeoutMs);
+
+// Block until one of pids exits or one of paths is closed, moved or deleted, for at
+// most timeoutMs. cancelled is checked periodically. Returns true when woken by an
+// event; the caller rechecks which locks remain. Windows only watches the processes.
+bool waitForLockRelease(const QList<quint64>& pids, const QStringList& paths, int timeoutMs,
+                        const std::function<bool()>& cancelled);
+
 bool isFileLockError();
 
+// Flush a file's data to stable storage. fd is QFileDevice::handle().
+bool syncFile(int fd);
+bool syncFile(const QString& path);
+
+// Start writing a file's dirty pages back without waiting for it (sync_file_range on
+// Linux), so that a later sync has little left to do. No-op where unsupported.
+void startWriteback(const QString& path);
+
+// Flush everything dirty on the filesystem holding path in one call (syncfs). Returns
+// false where that is not available; callers then sync their files one by one.
+bool syncFilesystem(const QString& path);
+
+// Make creations, renames and deletions of entries in directory durable.
+bool syncDirectory(const QString& path);
+
+// Identifies the filesystem holding path (st_dev on Linux, the volume serial number on
+// Windows). Renames only stay renames between paths with the same id. nullopt if path
+// cannot be inspected.
+std::optional<quint64> deviceId(const QString& path);
+
+// Walk the tree under root with the platform's bulk directory APIs, calling visit for
+// every entry (parents before children) with its path relative to root. Returns false
+// if no native scanner is available, root cannot be opened or any directory or entry
+// below it cannot be read; entries already visited are then incomplete and callers
+// start over with QDirIterator.
+bool scanDirectoryTree(const QString& root,
+                       const std::function<void(const QString&, const DirectoryEntry&)>& visit);
+
 bool renameSelfForUpdate(const QString& selfPath);
 bool cleanupOldSelf(const QString& selfPath);
 bool setExecutablePermission(const QString& path);
 
+// Create newPath as a hardlink to existingPath. Fails across filesystems.
+bool createHardLink(const QString& existingPath, const QString& newPath);
+
+// Create newPath as a copy-on-write clone (reflink) of existingPath. Returns false when
+// the filesystem does not support it; newPath is not left behind in that case.
+bool cloneFile(const QString& existingPath, const QString& newPath);
+
+// Atomically exchange two existing paths on the same filesystem, e.g. a directory and
+// a replacement built next to it. Returns false where no atomic exchange is available.
+bool exchangePaths(const QString& first, const QString& second);
+
+// Point the symlink linkPath at target (stored as given, so it may be relative), creating
+// it if needed. An existing link is replaced by a single rename on Linux; Windows has
+// to remove it first.
+bool replaceSymlink(const QString& linkPath, const QString& target);
+
+// The target stored in the symlink linkPath, as written (possibly relative) on Linux.
+// Windows returns the resolved absolute target. nullopt if linkPath is not a symlink.
+std::optional<QString> readSymlink(const QString& linkPath);
+
 } // namespace Platform
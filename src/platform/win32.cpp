@@ -1,6 +1,7 @@
 #include "platform.h"
 
 #include <windows.h>
+#include <io.h>
 #include <RestartManager.h>
 #include <shobjidl.h>
 #include <shlguid.h>
@@ -245,6 +246,16 @@ QList<LockedProcess> findLockingProcesses(const QStringList& absolutePaths)
     return result;
 }
 
+LockSnapshot LockSnapshot::capture()
+{
+    return {};
+}
+
+QList<LockedProcess> LockSnapshot::lockersOf(const QStringList& absolutePaths) const
+{
+    return findLockingProcesses(absolutePaths);
+}
+
 bool killProcess(quint64 pid)
 {
     HANDLE hProcess = OpenProcess(PROCESS_TERMINATE, FALSE, static_cast<DWORD>(pid));
@@ -256,12 +267,141 @@ bool killProcess(quint64 pid)
     return ok != 0;
 }
 
+bool killProcessesAndWait(const QList<quint64>& pids, int timeoutMs)
+{
+    QList<HANDLE> handles;
+    for(quint64 pid : pids)
+    {
+        HANDLE hProcess = OpenProcess(PROCESS_TERMINATE | SYNCHRONIZE, FALSE, static_cast<DWORD>(pid));
+        if(!hProcess)
+            continue;
+        if(TerminateProcess(hProcess, 1))
+            handles.append(hProcess);
+        else
+            CloseHandle(hProcess);
+    }
+    auto closeHandles = qScopeGuard([&handles] {
+        for(HANDLE h : handles)
+            CloseHandle(h);
+    });
+
+    // WaitForMultipleObjects takes at most MAXIMUM_WAIT_OBJECTS handles per call.
+    ULONGLONG deadline = GetTickCount64() + static_cast<ULONGLONG>(timeoutMs);
+    for(qsizetype i = 0; i < handles.size(); i += MAXIMUM_WAIT_OBJECTS)
+    {
+        DWORD count = static_cast<DWORD>(qMin<qsizetype>(MAXIMUM_WAIT_OBJECTS, handles.size() - i));
+        ULONGLONG now = GetTickCount64();
+        DWORD remaining = now < deadline ? static_cast<DWORD>(deadline - now) : 0;
+        if(WaitForMultipleObjects(count, handles.data() + i, TRUE, remaining) == WAIT_TIMEOUT)
+            return false;
+    }
+    return true;
+}
+
+bool waitForLockRelease(const QList<quint64>& pids, const QStringList& paths, int timeoutMs,
+                        const std::function<bool()>& cancelled)
+{
+    // Windows has no notification for another process closing a file; the Restart
+    // Manager reports processes, so waiting for one of them to exit is what we can do.
+    Q_UNUSED(paths);
+    static const DWORD kCancelCheckMs = 250;
+
+    QList<HANDLE> handles;
+    for(quint64 pid : pids)
+    {
+        if(handles.size() == MAXIMUM_WAIT_OBJECTS)
+            break;
+        HANDLE hProcess = OpenProcess(SYNCHRONIZE, FALSE, static_cast<DWORD>(pid));
+        if(hProcess)
+            handles.append(hProcess);
+    }
+    auto closeHandles = qScopeGuard([&handles] {
+        for(HANDLE h : handles)
+            CloseHandle(h);
+    });
+
+    ULONGLONG deadline = GetTickCount64() + static_cast<ULONGLONG>(timeoutMs);
+    while(true)
+    {
+        ULONGLONG now = GetTickCount64();
+        if(now >= deadline || (cancelled && cancelled()))
+            return false;
+
+        DWORD slice = static_cast<DWORD>(qMin<ULONGLONG>(deadline - now, kCancelCheckMs));
+        if(handles.isEmpty())
+        {
+            Sleep(slice);
+            continue;
+        }
+        DWORD result = WaitForMultipleObjects(static_cast<DWORD>(handles.size()), handles.data(), FALSE, slice);
+        if(result < WAIT_OBJECT_0 + handles.size())
+            return true;
+    }
+}
+
+bool scanDirectoryTree(const QString&,
+                       const std::function<void(const QString&, const DirectoryEntry&)>&)
+{
+    return false;
+}
+
 bool isFileLockError()
 {
     DWORD err = GetLastError();
     return err == ERROR_SHARING_VIOLATION || err == ERROR_LOCK_VIOLATION;
 }
 
+bool syncFile(int fd)
+{
+    HANDLE handle = reinterpret_cast<HANDLE>(_get_osfhandle(fd));
+    return handle != INVALID_HANDLE_VALUE && FlushFileBuffers(handle);
+}
+
+bool syncFile(const QString& path)
+{
+    // FlushFileBuffers needs a handle with write access.
+    HANDLE handle = CreateFileW(reinterpret_cast<const wchar_t*>(QDir::toNativeSeparators(path).utf16()),
+                                GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(handle == INVALID_HANDLE_VALUE)
+        return false;
+    bool synced = FlushFileBuffers(handle);
+    CloseHandle(handle);
+    return synced;
+}
+
+void startWriteback(const QString&)
+{
+}
+
+bool syncFilesystem(const QString&)
+{
+    // Flushing a whole volume requires administrator rights.
+    return false;
+}
+
+bool syncDirectory(const QString&)
+{
+    // NTFS journals directory metadata itself; there is no directory handle to flush.
+    return true;
+}
+
+std::optional<quint64> deviceId(const QString& path)
+{
+    // Backup semantics are needed to open a directory.
+    HANDLE handle = CreateFileW(reinterpret_cast<const wchar_t*>(QDir::toNativeSeparators(path).utf16()),
+                                0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+    if(handle == INVALID_HANDLE_VALUE)
+        return std::nullopt;
+    BY_HANDLE_FILE_INFORMATION info;
+    bool ok = GetFileInformationByHandle(handle, &info);
+    CloseHandle(handle);
+    if(!ok)
+        return std::nullopt;
+    return quint64(info.dwVolumeSerialNumber);
+}
+
 bool renameSelfForUpdate(const QString& selfPath)
 {
     QString oldPath = selfPath + "_old";
@@ -283,4 +423,51 @@ bool setExecutablePermission(const QString&)
     return true;
 }
 
+bool createHardLink(const QString& existingPath, const QString& newPath)
+{
+    return CreateHardLinkW(reinterpret_cast<const wchar_t*>(QDir::toNativeSeparators(newPath).utf16()),
+                           reinterpret_cast<const wchar_t*>(QDir::toNativeSeparators(existingPath).utf16()),
+                           nullptr) != 0;
+}
+
+bool cloneFile(const QString&, const QString&)
+{
+    // Block cloning is only available on ReFS; callers fall back to a hardlink or copy.
+    return false;
+}
+
+bool exchangePaths(const QString&, const QString&)
+{
+    // No atomic directory exchange; callers apply file by file instead.
+    return false;
+}
+
+bool replaceSymlink(const QString& linkPath, const QString& target)
+{
+    std::wstring link = QDir::toNativeSeparators(linkPath).toStdWString();
+    std::wstring tmp = link + L".tmp";
+    RemoveDirectoryW(tmp.c_str());
+    if(!CreateSymbolicLinkW(tmp.c_str(), QDir::toNativeSeparators(target).toStdWString().c_str(),
+                            SYMBOLIC_LINK_FLAG_DIRECTORY | SYMBOLIC_LINK_FLAG_ALLOW_UNPRIVILEGED_CREATE))
+        return false;
+
+    // MoveFileEx cannot replace a directory link, so there is a short window without one.
+    RemoveDirectoryW(link.c_str());
+    if(!MoveFileW(tmp.c_str(), link.c_str()))
+    {
+        RemoveDirectoryW(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::optional<QString> readSymlink(const QString& linkPath)
+{
+    QFileInfo info(linkPath);
+    if(!info.isSymLink())
+        return std::nullopt;
+    // The raw target is not available through Qt before 6.6.
+    return info.symLinkTarget();
+}
+
 } // namespace Platform
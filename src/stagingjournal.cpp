@@ -0,0 +1,120 @@
+#include "stagingjournal.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QFileInfo>
+
+QString StagingJournal::keyFor(const Manifest& manifest)
+{
+    QStringList paths = manifest.files.keys();
+    paths.sort();
+
+    QCryptographicHash digest(QCryptographicHash::Sha256);
+    for(const auto& relPath : paths)
+    {
+        digest.addData(relPath.toUtf8());
+        digest.addData(QByteArrayView("\0", 1));
+        digest.addData(manifest.files.value(relPath));
+    }
+
+    QString version = manifest.version.isNull() ? "0" : manifest.version.toString();
+    return version + '_' + QString::fromLatin1(digest.result().toHex().left(16));
+}
+
+bool StagingJournal::open(const QString& path, const QString& key)
+{
+    m_file.close();
+    m_file.setFileName(path);
+    m_entries.clear();
+    m_resumed = false;
+    bool partialTail = false;
+
+    if(m_file.open(QFile::ReadOnly))
+    {
+        m_resumed = m_file.readLine().trimmed() == key.toUtf8();
+        while(m_resumed && !m_file.atEnd())
+        {
+            QByteArray line = m_file.readLine();
+            if(!line.endsWith('\n'))
+            {
+                partialTail = true;
+                break;
+            }
+            line.chop(1);
+
+            QList<QByteArray> fields = line.split(' ');
+            if(fields.size() < 4)
+                continue;
+
+            Entry entry;
+            entry.hash = QByteArray::fromHex(fields[0]);
+            bool sizeOk = false, mtimeOk = false;
+            entry.size = fields[1].toLongLong(&sizeOk);
+            entry.mtimeMs = fields[2].toLongLong(&mtimeOk);
+            // The path is everything after the third space and may contain spaces itself.
+            qsizetype pathStart = fields[0].size() + fields[1].size() + fields[2].size() + 3;
+            if(sizeOk && mtimeOk)
+                m_entries.insert(QString::fromUtf8(line.mid(pathStart)), entry);
+        }
+        m_file.close();
+    }
+
+    QIODevice::OpenMode mode = QFile::WriteOnly | QFile::Truncate;
+    if(m_resumed)
+        mode = QFile::Append;
+    if(!m_file.open(mode))
+    {
+        qWarning() << "Cannot write staging journal:" << path << m_file.errorString();
+        return false;
+    }
+    if(!m_resumed)
+        m_file.write(key.toUtf8() + '\n');
+    else if(partialTail)
+        m_file.write("\n");
+    m_file.flush();
+    return true;
+}
+
+QStringList StagingJournal::stagedFiles(const QDir& stagingDir,
+                                        const QHash<QString, QByteArray>& expectedHashes) const
+{
+    QStringList result;
+    for(auto it = m_entries.constBegin(); it != m_entries.constEnd(); ++it)
+    {
+        if(expectedHashes.value(it.key()) != it->hash)
+            continue;
+
+        QFileInfo info(stagingDir.filePath(it.key()));
+        if(info.isFile() && info.size() == it->size
+           && info.lastModified().toMSecsSinceEpoch() == it->mtimeMs)
+            result.append(it.key());
+    }
+    return result;
+}
+
+void StagingJournal::record(const QDir& stagingDir, const QString& relPath, const QByteArray& hash)
+{
+    if(!m_file.isOpen())
+        return;
+
+    QFileInfo info(stagingDir.filePath(relPath));
+    Entry entry;
+    entry.hash = hash;
+    entry.size = info.size();
+    entry.mtimeMs = info.lastModified().toMSecsSinceEpoch();
+    m_entries.insert(relPath, entry);
+
+    m_file.write(hash.toHex() + ' ' + QByteArray::number(entry.size) + ' '
+                 + QByteArray::number(entry.mtimeMs) + ' ' + relPath.toUtf8() + '\n');
+    m_file.flush();
+}
+
+void StagingJournal::remove()
+{
+    m_file.close();
+    if(!m_file.fileName().isEmpty())
+        QFile::remove(m_file.fileName());
+    m_entries.clear();
+    m_resumed = false;
+}
@@ -0,0 +1,57 @@
+#ifndef STAGINGJOURNAL_H
+#define STAGINGJOURNAL_H
+
+#include "manifest.h"
+
+#include <QDir>
+#include <QFile>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+
+// Append-only record of staged files that were verified against the source manifest.
+// It lives next to the staging directory so that an update interrupted by a crash,
+// a failure or the user can reuse what was already staged when it is run again.
+//
+// Format: the key on the first line, then one "<sha256 hex> <size> <mtime ms> <path>"
+// line per file. A partially written last line is ignored.
+class StagingJournal {
+public:
+    StagingJournal() = default;
+    StagingJournal(const StagingJournal&) = delete;
+    StagingJournal& operator=(const StagingJournal&) = delete;
+
+    // Identifies one release: its version plus a digest of every path and hash.
+    static QString keyFor(const Manifest& manifest);
+
+    // Load the journal at path if it was written for key, otherwise start it afresh.
+    // Returns false if the journal cannot be written; staging then simply is not resumable.
+    bool open(const QString& path, const QString& key);
+
+    // True if open() found a journal for the same key, i.e. the staging directory next
+    // to it belongs to this release and may be reused.
+    bool isResumed() const { return m_resumed; }
+
+    // Recorded files whose copy in stagingDir still has the recorded size and
+    // modification time and whose recorded hash is still the expected one.
+    QStringList stagedFiles(const QDir& stagingDir, const QHash<QString, QByteArray>& expectedHashes) const;
+
+    // Append a verified file, written through immediately.
+    void record(const QDir& stagingDir, const QString& relPath, const QByteArray& hash);
+
+    // Delete the journal file once the staging directory is gone.
+    void remove();
+
+private:
+    struct Entry {
+        QByteArray hash;
+        qint64 size = -1;
+        qint64 mtimeMs = 0;
+    };
+
+    QFile m_file;
+    QHash<QString, Entry> m_entries;
+    bool m_resumed = false;
+};
+
+#endif // STAGINGJOURNAL_H
@@ -1,12 +1,66 @@
 #include "updatecontroller.h"
+#include "applyjournal.h"
 #include "downloadhandler.h"
+#include "parallelextract.h"
 #include "platform/platform.h"
+#include "stagingjournal.h"
 
 #include <QCoreApplication>
-#include <QDirIterator>
 #include <QFileInfo>
 #include <QProcess>
-#include <QThread>
+#include <QSet>
+#include <algorithm>
+#include <functional>
+
+static const QString kSlotsDir = "slots";
+static const QString kCurrentLink = "current";
+// Holds staging when the target's parent is on another filesystem. Never part of the tree.
+static const QString kInTargetStagingDir = ".simpleupdater";
+static const QString kStagingPrefix = ".staging_";
+
+// fsync the directories holding relPaths under root, and every directory between them
+// and root, so that renamed and newly created entries survive a power failure.
+static void syncDirectories(const QDir& root, const QStringList& relPaths)
+{
+    const QString rootPath = root.absolutePath();
+    QSet<QString> dirs{rootPath};
+    for(const auto& relPath : relPaths)
+    {
+        QString dir = QFileInfo(root.filePath(relPath)).absolutePath();
+        while(dir.size() > rootPath.size() && !dirs.contains(dir))
+        {
+            dirs.insert(dir);
+            dir = QFileInfo(dir).absolutePath();
+        }
+    }
+    for(const auto& dir : dirs)
+    {
+        if(!Platform::syncDirectory(dir))
+            qWarning() << "Failed to sync directory" << dir;
+    }
+}
+
+// Staging directories and journals in parentDir left by updates to other releases. Only
+// the one named keepName can ever be resumed; the rest would otherwise stay forever.
+// Returns how many were removed.
+static int removeStaleStaging(const QDir& parentDir, const QString& keepName)
+{
+    int removed = 0;
+    const auto names = parentDir.entryList({kStagingPrefix + "*"},
+                                           QDir::Dirs | QDir::Files | QDir::Hidden | QDir::NoDotAndDotDot);
+    for(const auto& name : names)
+    {
+        if(name == keepName || name == keepName + ".journal")
+            continue;
+        QString path = parentDir.filePath(name);
+        bool ok = QFileInfo(path).isDir() ? QDir(path).removeRecursively() : QFile::remove(path);
+        if(ok)
+            ++removed;
+        else
+            qWarning() << "Cannot remove leftover staging" << path;
+    }
+    return removed;
+}
 
 UpdateController::UpdateController(QObject* parent)
     : QObject(parent)
@@ -18,14 +72,20 @@ UpdateController::UpdateController(QObject* parent)
     m_fileHandler->setLockResolver([this](const QString& absolutePath) -> bool {
         return resolveFileLock(absolutePath);
     });
+    m_fileHandler->setDurability(m_durability);
 }
 
-void UpdateController::setSourceDir(const QDir& dir) { m_sourceDir = dir; m_sourceUrl.clear(); }
-void UpdateController::setSourceUrl(const QString& url) { m_sourceUrl = url; }
-void UpdateController::setTargetDir(const QDir& dir) { m_targetDir = dir; }
+void UpdateController::setSourceDir(const QDir& dir) { m_sourceDir = dir; m_sourceUrl.clear(); m_remoteManifestUrl.clear(); }
+void UpdateController::setSourceUrl(const QString& url) { m_sourceUrl = url; m_remoteManifestUrl.clear(); }
+void UpdateController::setTargetDir(const QDir& dir) { m_targetDir = dir; m_slotRoot.reset(); }
 void UpdateController::setForceUpdate(bool force) { m_forceUpdate = force; }
 void UpdateController::setInstallMode(bool install) { m_installMode = install; }
 void UpdateController::setContinueUpdate(bool continueUpdate) { m_continueUpdate = continueUpdate; }
+void UpdateController::setLockWait(int seconds) { m_lockWaitMs = qint64(seconds) * 1000; }
+void UpdateController::setSweepEmptyDirs(bool sweep) { m_sweepEmptyDirs = sweep; }
+void UpdateController::setSwapApply(bool swap) { m_swapApply = swap; }
+void UpdateController::setSlotLayout(bool enabled) { m_slotLayout = enabled; }
+void UpdateController::setDurability(Durability durability) { m_durability = durability; m_fileHandler->setDurability(durability); }
 
 bool UpdateController::resolveSource()
 {
@@ -39,9 +99,14 @@ bool UpdateController::resolveSource()
                 this, &UpdateController::downloadProgress);
         connect(m_downloadHandler, &DownloadHandler::statusMessage,
                 this, [this](const QString& msg){ emit statusMessage(msg, Qt::cyan); });
+        m_downloadHandler->setCancelCheck([this]() { return m_fileHandler->isCancelled(); });
     }
 
-    QString localPath = m_downloadHandler->downloadAndExtract(m_sourceUrl);
+    // Downloaded next to where staging will be, so that staging moves the extracted
+    // files instead of copying them.
+    QDir workDir = m_slotLayout ? QDir((m_slotRoot ? *m_slotRoot : m_targetDir).filePath(kSlotsDir))
+                                : stagingParent();
+    QString localPath = m_downloadHandler->downloadAndExtract(m_sourceUrl, workDir);
     if(localPath.isEmpty())
     {
         emit error("Failed to download update package from: " + m_sourceUrl);
@@ -49,6 +114,13 @@ bool UpdateController::resolveSource()
     }
 
     m_sourceDir = QDir(localPath);
+
+    // A URL pointing at manifest.json means the release is served as loose files;
+    // they are fetched individually (and by range where block checksums allow it).
+    QUrl url(m_sourceUrl);
+    if(QFileInfo(url.path()).fileName() == "manifest.json")
+        m_remoteManifestUrl = url;
+
     return true;
 }
 
@@ -90,6 +162,14 @@ void UpdateController::prepare()
         return;
     }
 
+    // Everything up to the final switch reads the active slot through the link, so
+    // versions, shortcuts and the launched app all use the stable "current" path.
+    if(m_slotLayout && !m_slotRoot)
+    {
+        m_slotRoot = m_targetDir;
+        m_targetDir = QDir(m_slotRoot->filePath(kCurrentLink));
+    }
+
     auto srcManifest = readManifest(m_sourceDir.filePath("manifest.json"));
     if(srcManifest)
     {
@@ -102,6 +182,11 @@ void UpdateController::prepare()
         m_sourceManifest = m;
     }
 
+    m_delta.reset();
+    QString deltaPath = m_sourceDir.filePath("delta.json");
+    if(QFile::exists(deltaPath))
+        m_delta = readDeltaDescriptor(deltaPath);
+
     m_targetVersion = QVersionNumber();
 
     if(m_targetDir.exists() && !m_sourceManifest.appExe.isEmpty())
@@ -138,75 +223,43 @@ void UpdateController::prepare()
 void UpdateController::hashTargetWithLockRetry()
 {
     m_targetFiles.clear();
+    m_targetSnapshot = DirectorySnapshot::scan(m_targetDir);
     if(!m_targetDir.exists())
         return;
+    // Neither hashed nor listed as stale, and never linked into a new tree.
+    m_targetSnapshot.remove(kInTargetStagingDir);
 
-    m_targetFiles = hashDirectory(m_targetDir);
+    // Files that cannot be read on the first pass are usually locked; after the user
+    // deals with the lock only those are hashed again.
+    QStringList unhashed;
+    m_targetFiles = hashDirectory(m_targetSnapshot, &unhashed);
 
-    while(true)
+    while(!unhashed.isEmpty())
     {
-        QStringList unhashed;
-        QDirIterator it(m_targetDir.absolutePath(),
-                        QDir::Files | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot,
-                        QDirIterator::Subdirectories);
-        while(it.hasNext())
-        {
-            it.next();
-            QFileInfo info = it.fileInfo();
-            if(info.isSymLink())
-                continue;
-
-            QString fileName = info.fileName();
-            if(fileName == "manifest.json" || fileName == "manifest.json.tmp"
-               || fileName == "updateInfo.ini")
-                continue;
-
-            QString relPath = m_targetDir.relativeFilePath(info.absoluteFilePath());
-            if(!m_targetFiles.contains(relPath))
-                unhashed << info.absoluteFilePath();
-        }
-
-        if(unhashed.isEmpty())
-            break;
-
-        auto locked = Platform::findLockingProcesses(unhashed);
+        auto locked = findLockers(unhashed);
         if(locked.isEmpty())
             break;
 
-        QStringList descriptions;
-        for(const auto& p : locked)
-            descriptions << QString("%1 (PID %2)").arg(p.name).arg(p.pid);
-
-        emit processLockDetected(descriptions);
-
-        LockAction action;
-        {
-            QMutexLocker locker(&m_lockMutex);
-            m_lockResponse = LockAction::Retry;
-            m_lockCondition.wait(&m_lockMutex);
-            action = m_lockResponse;
-        }
-
-        if(action == LockAction::Cancel)
-        {
-            m_fileHandler->cancel();
+        if(promptForLocks(locked, unhashed) == LockAction::Cancel)
             break;
-        }
 
-        if(action == LockAction::KillAll)
+        QStringList stillUnhashed;
+        for(const auto& absPath : unhashed)
         {
-            for(const auto& p : locked)
-                Platform::killProcess(p.pid);
-            QThread::msleep(500);
+            QByteArray hash = FileHandler::hashFile(absPath);
+            if(!hash.isEmpty())
+                m_targetFiles.insert(m_targetDir.relativeFilePath(absPath), hash);
+            else if(QFileInfo::exists(absPath))
+                stillUnhashed << absPath;
         }
-
-        m_targetFiles = hashDirectory(m_targetDir);
+        unhashed = stillUnhashed;
     }
 }
 
 void UpdateController::execute()
 {
     m_fileHandler->resetCancel();
+    m_lockSnapshot.reset();
 
     if(!m_sourceUrl.isEmpty())
     {
@@ -221,7 +274,17 @@ void UpdateController::execute()
 
     emit statusMessage("SCANNING TARGET...", Qt::green);
     hashTargetWithLockRetry();
-    m_diff = FileHandler::computeDiff(m_sourceManifest.files, m_targetFiles);
+    if(!m_targetSnapshot.isComplete())
+        emit statusMessage("Some directories in the target could not be listed, "
+                           "their files are left as they are", Qt::yellow);
+    // Cancelled at a lock prompt during the scan: the target was only partly hashed.
+    if(m_fileHandler->isCancelled())
+    {
+        emit statusMessage("CANCELLED", Qt::yellow);
+        emit updateFinished(false);
+        return;
+    }
+    m_diff = FileHandler::computeDiff(m_sourceManifest.files, m_targetFiles, &m_targetSnapshot);
 
     QString selfPath = QCoreApplication::applicationFilePath();
     QString selfRelPath = m_targetDir.relativeFilePath(selfPath);
@@ -233,6 +296,28 @@ void UpdateController::execute()
         {
             emit statusMessage("Self-update detected, relaunching...", Qt::yellow);
 
+            QString srcSelfPath = m_sourceDir.filePath(selfRelPath);
+            bool fetched = true;
+            if(!m_remoteManifestUrl.isEmpty())
+            {
+                fetched = m_downloadHandler->fetchFile(remoteFileUrl(selfRelPath), srcSelfPath);
+            }
+            else if(isBundleSource())
+            {
+                QString error;
+                QDir().mkpath(QFileInfo(srcSelfPath).absolutePath());
+                fetched = m_downloadHandler->fetchBundleEntries({selfRelPath})
+                          && m_downloadHandler->extractBundleEntry(selfRelPath, srcSelfPath, nullptr, &error);
+                if(!error.isEmpty())
+                    qWarning().noquote() << error;
+            }
+            if(!fetched)
+            {
+                emit statusMessage("Failed to download new updater", Qt::red);
+                emit updateFinished(false);
+                return;
+            }
+
             if(!Platform::renameSelfForUpdate(selfPath))
             {
                 emit statusMessage("Failed to rename updater for self-update", Qt::red);
@@ -240,7 +325,6 @@ void UpdateController::execute()
                 return;
             }
 
-            QString srcSelfPath = m_sourceDir.filePath(selfRelPath);
             if(!QFile::copy(srcSelfPath, selfPath))
             {
                 qWarning() << "Failed to copy new updater from" << srcSelfPath << "to" << selfPath;
@@ -290,20 +374,72 @@ void UpdateController::execute()
         return;
     }
 
+    // Moved and reused files are staged from the target itself, a delta need not ship them.
+    QStringList filesFromSource = filesToStage;
+    filesFromSource.removeIf([this](const QString& relPath) {
+        return m_diff.moved.contains(relPath) || m_diff.reused.contains(relPath);
+    });
+
+    if(m_delta && !checkDeltaApplies(filesFromSource))
+    {
+        emit statusMessage("DELTA PACKAGE DOES NOT APPLY - USE THE FULL RELEASE", Qt::red);
+        emit updateFinished(false);
+        return;
+    }
+
+    // Nothing in the active slot is replaced, so running processes cannot get in the way.
+    if(!m_slotRoot && !preflightLocks())
+    {
+        emit statusMessage("CANCELLED", Qt::yellow);
+        emit updateFinished(false);
+        return;
+    }
+
     int totalSteps = filesToStage.count()
                    + m_diff.toUpdate.count()
                    + filesToStage.count()
-                   + m_diff.toRemove.count();
+                   + m_diff.toRemove.count()
+                   + m_diff.stale.count();
     emit progressRangeChanged(0, totalSteps);
 
     emit statusMessage("STAGING FILES...", Qt::green);
 
-    QDir parentDir(m_targetDir);
-    parentDir.cdUp();
-    QString stagingName = ".staging_" + QString::number(QCoreApplication::applicationPid());
+    // Keyed by release rather than by process, so an interrupted update can resume.
+    QString stagingKey = StagingJournal::keyFor(m_sourceManifest);
+    QDir parentDir;
+    QString stagingName = kStagingPrefix + stagingKey;
+    if(m_slotRoot)
+    {
+        QFileInfo current(m_targetDir.absolutePath());
+        if(current.exists() && !current.isSymLink())
+        {
+            emit statusMessage(m_targetDir.absolutePath() + " is not a symlink to a slot", Qt::red);
+            emit updateFinished(false);
+            return;
+        }
+        parentDir = QDir(m_slotRoot->filePath(kSlotsDir));
+        stagingName = inactiveSlot();
+    }
+    else
+    {
+        parentDir = stagingParent();
+        if(parentDir.absolutePath().startsWith(m_targetDir.absolutePath() + '/'))
+            emit statusMessage("The target's parent is on another filesystem or not writable, "
+                               "staging inside the target", Qt::cyan);
+    }
     QDir stagingDir(parentDir.filePath(stagingName));
+    parentDir.mkpath(".");
+    if(!m_slotRoot)
+    {
+        int removed = removeStaleStaging(parentDir, stagingName);
+        if(removed > 0)
+            emit statusMessage(QString("Removed %1 leftover staging entries of other releases").arg(removed),
+                               Qt::cyan);
+    }
 
-    if(stagingDir.exists())
+    StagingJournal journal;
+    journal.open(stagingDir.absolutePath() + ".journal", stagingKey);
+    if(!journal.isResumed() && stagingDir.exists())
         stagingDir.removeRecursively();
     if(!parentDir.mkpath(stagingName))
     {
@@ -312,38 +448,225 @@ void UpdateController::execute()
         return;
     }
 
-    if(!m_fileHandler->copyFiles(m_sourceDir, stagingDir, filesToStage))
+    QSet<QString> alreadyStaged;
+    if(journal.isResumed())
+        alreadyStaged = resumeStaging(stagingDir, filesToStage, journal);
+
+    QStringList filesToCopy;
+    for(const auto& relPath : filesToStage)
+    {
+        if(!alreadyStaged.contains(relPath))
+            filesToCopy.append(relPath);
+    }
+
+    // A bundle carries full files only; its manifest lists no patches to look for.
+    QHash<QString, QString> patchPaths;
+    for(const auto& relPath : m_diff.toUpdate)
+    {
+        if(alreadyStaged.contains(relPath) || isBundleSource())
+            continue;
+        for(const auto& patch : m_sourceManifest.patches.value(relPath))
+        {
+            if(patch.baseHash == m_targetFiles.value(relPath))
+            {
+                patchPaths.insert(relPath, patch.patchPath);
+                break;
+            }
+        }
+    }
+
+    // A patch that cannot be fetched is left out; its file is downloaded in full.
+    if(!m_remoteManifestUrl.isEmpty())
+    {
+        for(auto it = patchPaths.begin(); it != patchPaths.end();)
+        {
+            if(m_downloadHandler->fetchFile(remoteFileUrl(it.value()), m_sourceDir.filePath(it.value())))
+                ++it;
+            else
+                it = patchPaths.erase(it);
+        }
+    }
+
+    if(!patchPaths.isEmpty())
+    {
+        const QStringList failed = m_fileHandler->patchFiles(m_targetDir, m_sourceDir, stagingDir,
+                                                             patchPaths, m_sourceManifest.files);
+        const QSet<QString> unpatched(failed.begin(), failed.end());
+        filesToCopy.removeIf([&](const QString& relPath) {
+            return patchPaths.contains(relPath) && !unpatched.contains(relPath);
+        });
+    }
+
+    for(bool move : {true, false})
+    {
+        QHash<QString, QString> sources;
+        const auto& candidates = move ? m_diff.moved : m_diff.reused;
+        for(const auto& relPath : filesToCopy)
+        {
+            auto candidate = candidates.constFind(relPath);
+            if(candidate != candidates.constEnd())
+                sources.insert(relPath, candidate.value());
+        }
+        if(sources.isEmpty())
+            continue;
+
+        const QStringList failed = m_fileHandler->reuseFiles(m_targetDir, stagingDir, sources, move);
+        const QSet<QString> notReused(failed.begin(), failed.end());
+        filesToCopy.removeIf([&](const QString& relPath) {
+            return sources.contains(relPath) && !notReused.contains(relPath);
+        });
+    }
+
+    // Stage each distinct content once; other paths with the same hash are linked to it.
+    QHash<QString, QString> duplicates;
+    {
+        QHash<QByteArray, QString> firstByHash;
+        for(const auto& relPath : alreadyStaged)
+            firstByHash.insert(m_sourceManifest.files.value(relPath), relPath);
+
+        QStringList ordered = filesToCopy;
+        ordered.sort();
+        for(const auto& relPath : ordered)
+        {
+            QByteArray hash = m_sourceManifest.files.value(relPath);
+            if(hash.isEmpty())
+                continue;
+            auto first = firstByHash.constFind(hash);
+            if(first == firstByHash.constEnd())
+            {
+                firstByHash.insert(hash, relPath);
+                continue;
+            }
+            duplicates.insert(relPath, first.value());
+        }
+        filesToCopy.removeIf([&duplicates](const QString& relPath) { return duplicates.contains(relPath); });
+    }
+
+    // Files whose content was already hashed while being unpacked into staging.
+    QSet<QString> preverified;
+    bool staged = stageFromSource(stagingDir, filesToCopy, preverified);
+
+    QSet<QString> deduped;
+    if(staged && !duplicates.isEmpty())
+    {
+        QStringList notDeduped = m_fileHandler->dedupFiles(stagingDir, duplicates);
+        const QSet<QString> failed(notDeduped.begin(), notDeduped.end());
+        qint64 savedBytes = 0;
+        for(auto it = duplicates.constBegin(); it != duplicates.constEnd(); ++it)
+        {
+            if(failed.contains(it.key()))
+                continue;
+            deduped.insert(it.key());
+            savedBytes += QFileInfo(stagingDir.filePath(it.key())).size();
+        }
+        emit statusMessage(QString("Deduplicated %1 files, saved %2 KB")
+                               .arg(deduped.size()).arg(savedBytes / 1024), Qt::cyan);
+
+        if(!notDeduped.isEmpty() && !m_fileHandler->isCancelled())
+        {
+            staged = stageFromSource(stagingDir, notDeduped, preverified);
+        }
+    }
+    if(!staged)
     {
         if(m_fileHandler->isCancelled())
             emit statusMessage("CANCELLED", Qt::yellow);
         else
             emit statusMessage("STAGING FAILED", Qt::red);
-        stagingDir.removeRecursively();
         emit updateFinished(false);
         return;
     }
 
+    // Before anything is journaled as staged: the journal vouches for file contents.
+    if(!m_fileHandler->syncStaged(stagingDir, filesToStage))
+        emit statusMessage("Could not flush staged files to disk", Qt::yellow);
+
     emit statusMessage("VERIFYING STAGED FILES...", Qt::green);
 
     QHash<QString, QByteArray> stagedExpected;
     for(const auto& relPath : filesToStage)
     {
-        if(m_sourceManifest.files.contains(relPath))
+        // Deduplicated files share content with an original that is verified here.
+        if(m_sourceManifest.files.contains(relPath) && !deduped.contains(relPath)
+           && !alreadyStaged.contains(relPath) && !preverified.contains(relPath))
             stagedExpected.insert(relPath, m_sourceManifest.files.value(relPath));
     }
 
+    QStringList mismatches;
     if(!stagedExpected.isEmpty())
+        mismatches = m_fileHandler->verifyFiles(stagingDir, stagedExpected);
+    const QSet<QString> mismatched(mismatches.begin(), mismatches.end());
+
+    // Whatever did verify is kept for the next run, even if this one stops here.
+    for(const auto& relPath : filesToStage)
     {
-        QStringList mismatches = m_fileHandler->verifyFiles(stagingDir, stagedExpected);
-        if(!mismatches.isEmpty())
+        QByteArray hash = m_sourceManifest.files.value(relPath);
+        bool verified = stagedExpected.contains(relPath)
+                        ? !mismatched.contains(relPath)
+                        : preverified.contains(relPath)
+                              || (deduped.contains(relPath) && !mismatched.contains(duplicates.value(relPath)));
+        if(verified && !hash.isEmpty())
+            journal.record(stagingDir, relPath, hash);
+    }
+
+    if(!mismatches.isEmpty())
+    {
+        for(const auto& f : mismatches)
+        {
+            emit statusMessage("Staging mismatch: " + f, Qt::red);
+            QFile::remove(stagingDir.filePath(f));
+        }
+        emit statusMessage("STAGING VERIFICATION FAILED", Qt::red);
+        emit updateFinished(false);
+        return;
+    }
+
+    if(m_slotRoot)
+    {
+        if(!applyBySlotSwitch(stagingDir))
         {
-            for(const auto& f : mismatches)
-                emit statusMessage("Staging mismatch: " + f, Qt::red);
-            emit statusMessage("STAGING VERIFICATION FAILED", Qt::red);
-            stagingDir.removeRecursively();
             emit updateFinished(false);
             return;
         }
+        journal.remove();
+        finishUpdate();
+        return;
+    }
+
+    if(m_swapApply)
+    {
+        std::optional<bool> swapped = applyBySwap(stagingDir);
+        if(swapped.has_value())
+        {
+            if(!swapped.value())
+            {
+                if(m_fileHandler->isCancelled())
+                    emit statusMessage("CANCELLED", Qt::yellow);
+                emit updateFinished(false);
+                return;
+            }
+            journal.remove();
+            finishUpdate();
+            return;
+        }
+        emit statusMessage("Cannot swap the target directory, applying file by file", Qt::yellow);
+    }
+
+    // Lets the next start finish or undo this apply if the process dies part way.
+    // Not fatal: staging falls back into the target when its parent is read-only, and
+    // the journal lives in that parent. A failure here is still rolled back from .bak.
+    ApplyJournal applyJournal(m_durability);
+    if(!applyJournal.begin(m_targetDir, stagingDir, m_diff.toUpdate, m_diff.toAdd))
+    {
+        // Backing up now would overwrite the .bak files that journal still needs.
+        if(QFile::exists(ApplyJournal::pathFor(m_targetDir)))
+        {
+            emit statusMessage("AN EARLIER INTERRUPTED UPDATE WAS NOT RECOVERED", Qt::red);
+            emit updateFinished(false);
+            return;
+        }
+        emit statusMessage("Cannot write the apply journal, an interrupted apply will not be "
+                           "recovered on the next start", Qt::yellow);
     }
 
     if(!m_diff.toUpdate.isEmpty())
@@ -352,23 +675,27 @@ void UpdateController::execute()
         if(!m_fileHandler->renameToBackup(m_targetDir, m_diff.toUpdate))
         {
             emit statusMessage("BACKUP FAILED", Qt::red);
-            stagingDir.removeRecursively();
+            applyJournal.finish();
             emit updateFinished(false);
             return;
         }
+        applyJournal.backupsDone();
         emit statusMessage("BACKUP SUCCESS", Qt::green);
     }
 
     emit statusMessage("APPLYING UPDATE...", Qt::green);
-    if(!applyStaged(stagingDir, filesToStage))
+    if(!applyStaged(stagingDir, filesToStage, applyJournal))
     {
         emit statusMessage("APPLY FAILED - ROLLING BACK...", Qt::red);
-        m_fileHandler->restoreFromBackup(m_targetDir, m_diff.toUpdate);
-        stagingDir.removeRecursively();
+        if(!applyJournal.rollBack(m_targetDir))
+            m_fileHandler->restoreFromBackup(m_targetDir, m_diff.toUpdate);
         emit updateFinished(false);
         return;
     }
 
+    for(const auto& relPath : filesToStage)
+        m_targetSnapshot.insertFile(relPath);
+
     emit statusMessage("VERIFYING TARGET...", Qt::green);
     {
         QStringList mismatches = m_fileHandler->verifyFiles(m_targetDir, m_sourceManifest.files);
@@ -377,95 +704,334 @@ void UpdateController::execute()
             for(const auto& f : mismatches)
                 emit statusMessage("Target mismatch: " + f, Qt::red);
             emit statusMessage("TARGET VERIFICATION FAILED - ROLLING BACK...", Qt::red);
-            m_fileHandler->removeFiles(m_targetDir, m_diff.toAdd);
-            m_fileHandler->restoreFromBackup(m_targetDir, m_diff.toUpdate);
-            stagingDir.removeRecursively();
+            if(!applyJournal.rollBack(m_targetDir))
+            {
+                m_fileHandler->removeFiles(m_targetDir, m_diff.toAdd);
+                m_fileHandler->restoreFromBackup(m_targetDir, m_diff.toUpdate);
+            }
             emit updateFinished(false);
             return;
         }
     }
+    applyJournal.commit();
 
+    QStringList removedPaths = m_diff.toRemove;
     if(!m_diff.toRemove.isEmpty())
     {
         emit statusMessage("REMOVING OBSOLETE FILES...", Qt::green);
 
-        QString newBaseName = m_sourceManifest.appExe.isEmpty()
-            ? QString() : QFileInfo(m_sourceManifest.appExe).completeBaseName();
-
-        for(const auto& relPath : m_diff.toRemove)
-        {
-            if(relPath.endsWith(".exe", Qt::CaseInsensitive))
-            {
-                QString oldBaseName = QFileInfo(relPath).completeBaseName();
-                if(!newBaseName.isEmpty() && oldBaseName.compare(newBaseName, Qt::CaseInsensitive) != 0)
-                {
-                    QString newAbsPath = m_targetDir.absoluteFilePath(m_sourceManifest.appExe);
-                    Platform::migrateShortcuts(QFileInfo(relPath).fileName(),
-                                              newAbsPath, newBaseName);
-                }
-                else
-                    Platform::removeShortcut(oldBaseName);
-            }
-        }
+        migrateShortcuts(m_diff.toRemove);
         m_fileHandler->removeFiles(m_targetDir, m_diff.toRemove);
+        for(const auto& relPath : m_diff.toRemove)
+            m_targetSnapshot.remove(relPath);
     }
 
     {
         emit statusMessage("CLEANING STALE FILES...", Qt::green);
 
-        QDirIterator staleIt(m_targetDir.absolutePath(),
-                             QDir::Files | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot,
-                             QDirIterator::Subdirectories);
-
-        while(staleIt.hasNext())
+        migrateShortcuts(m_diff.stale);
+        for(const auto& relPath : m_diff.stale)
         {
-            staleIt.next();
-            QString absPath = staleIt.filePath();
-            QString relPath = m_targetDir.relativeFilePath(absPath);
-
-            if(absPath.endsWith(".bak"))
-                continue;
+            QString absPath = m_targetDir.absoluteFilePath(relPath);
 
-            if(!m_sourceManifest.files.contains(relPath))
+            bool removed = false;
+            while(true)
             {
-                if(relPath.endsWith(".exe", Qt::CaseInsensitive))
-                {
-                    QString oldBaseName = QFileInfo(relPath).completeBaseName();
-                    QString newBaseName = m_sourceManifest.appExe.isEmpty()
-                        ? QString() : QFileInfo(m_sourceManifest.appExe).completeBaseName();
-
-                    if(!newBaseName.isEmpty() && oldBaseName.compare(newBaseName, Qt::CaseInsensitive) != 0)
-                    {
-                        QString newAbsPath = m_targetDir.absoluteFilePath(m_sourceManifest.appExe);
-                        Platform::migrateShortcuts(QFileInfo(relPath).fileName(),
-                                                  newAbsPath, newBaseName);
-                    }
-                    else
-                    {
-                        Platform::removeShortcut(oldBaseName);
-                    }
-                }
-
-                bool removed = false;
-                while(true)
-                {
-                    if(QFile::remove(absPath)) { removed = true; break; }
-                    if(!Platform::isFileLockError() || !resolveFileLock(absPath)) break;
-                }
-                if(removed)
-                    emit progressUpdated(relPath + " (STALE)", true);
-                else
-                    emit progressUpdated(relPath + " (STALE) - cannot remove", false);
+                if(QFile::remove(absPath)) { removed = true; break; }
+                if(!Platform::isFileLockError() || !resolveFileLock(absPath)) break;
+            }
+            // Already gone since the scan, e.g. the previous updater binary.
+            bool vanished = !removed && !QFileInfo::exists(absPath) && !QFileInfo(absPath).isSymLink();
+            if(removed)
+                emit progressUpdated(relPath + " (STALE)", true);
+            else if(!vanished)
+                emit progressUpdated(relPath + " (STALE) - cannot remove", false);
+
+            if(removed || vanished)
+            {
+                m_targetSnapshot.remove(relPath);
+                removedPaths.append(relPath);
             }
         }
 
-        m_fileHandler->removeEmptyDirectories(m_targetDir);
+        if(m_sweepEmptyDirs)
+        {
+            m_fileHandler->removeEmptyDirectories(m_targetSnapshot);
+        }
+        else
+        {
+            for(const auto& relDir : m_fileHandler->removeEmptyParents(m_targetDir, removedPaths))
+                m_targetSnapshot.remove(relDir);
+        }
     }
 
     m_fileHandler->cleanupBackups(m_targetDir, m_diff.toUpdate);
     if(stagingDir.exists())
         stagingDir.removeRecursively();
+    journal.remove();
+    applyJournal.finish();
+
+    finishUpdate();
+}
+
+std::optional<bool> UpdateController::applyBySwap(const QDir& stagingDir)
+{
+    // A directory cannot be exchanged with one inside it.
+    if(stagingDir.absolutePath().startsWith(m_targetDir.absolutePath() + '/'))
+        return std::nullopt;
+
+    emit statusMessage("BUILDING NEW TREE...", Qt::green);
+    if(!linkKeptFiles(stagingDir))
+        return m_fileHandler->isCancelled() ? std::optional<bool>(false) : std::nullopt;
+    QFile::setPermissions(stagingDir.absolutePath(), QFileInfo(m_targetDir.absolutePath()).permissions());
+
+    emit statusMessage("SWAPPING TARGET...", Qt::green);
+    if(!Platform::exchangePaths(stagingDir.absolutePath(), m_targetDir.absolutePath()))
+    {
+        // The per-file apply moves files out of these directories, whatever their mode.
+        for(const auto& relDir : m_targetSnapshot.directories())
+        {
+            QString path = stagingDir.filePath(relDir);
+            if(QFileInfo(path).isDir())
+                QFile::setPermissions(path, QFile::permissions(path) | QFile::WriteOwner | QFile::ExeOwner);
+        }
+        return std::nullopt;
+    }
+    if(m_durability != Durability::None)
+        Platform::syncDirectory(QFileInfo(m_targetDir.absolutePath()).absolutePath());
+    emit progressUpdated(m_targetDir.dirName() + " (SWAP)", true);
+
+    // From here on the staging path holds the previous tree.
+    emit statusMessage("VERIFYING TARGET...", Qt::green);
+    QStringList mismatches = m_fileHandler->verifyFiles(m_targetDir, m_sourceManifest.files);
+    if(!mismatches.isEmpty())
+    {
+        for(const auto& f : mismatches)
+            emit statusMessage("Target mismatch: " + f, Qt::red);
+        emit statusMessage("TARGET VERIFICATION FAILED - ROLLING BACK...", Qt::red);
+        // Leave both trees in place if the previous one cannot be swapped back.
+        if(Platform::exchangePaths(stagingDir.absolutePath(), m_targetDir.absolutePath()))
+            stagingDir.removeRecursively();
+        else
+            qCritical() << "Failed to swap back, previous tree kept at" << stagingDir.absolutePath();
+        return false;
+    }
+
+    migrateShortcuts(m_diff.toRemove + m_diff.stale);
+    stagingDir.removeRecursively();
+    return true;
+}
+
+QSet<QString> UpdateController::resumeStaging(const QDir& stagingDir, const QStringList& filesToStage,
+                                             StagingJournal& journal)
+{
+    QStringList recorded = journal.stagedFiles(stagingDir, m_sourceManifest.files);
+    QSet<QString> verified(recorded.begin(), recorded.end());
+
+    // Files copied before an interruption but never verified are hashed instead of fetched again.
+    QHash<QString, QByteArray> unrecorded;
+    for(const auto& relPath : filesToStage)
+    {
+        QByteArray hash = m_sourceManifest.files.value(relPath);
+        if(!hash.isEmpty() && !verified.contains(relPath) && QFileInfo(stagingDir.filePath(relPath)).isFile())
+            unrecorded.insert(relPath, hash);
+    }
+    QStringList mismatches = m_fileHandler->verifyFiles(stagingDir, unrecorded);
+    for(auto it = unrecorded.constBegin(); it != unrecorded.constEnd(); ++it)
+    {
+        if(mismatches.contains(it.key()))
+            continue;
+        journal.record(stagingDir, it.key(), it.value());
+        verified.insert(it.key());
+    }
+
+    QSet<QString> staged;
+    for(const auto& relPath : filesToStage)
+    {
+        if(!verified.contains(relPath))
+            continue;
+        staged.insert(relPath);
+        emit progressUpdated(relPath + " (RESUMED)", true);
+    }
+    if(!staged.isEmpty())
+        emit statusMessage(QString("Resuming staging: %1 of %2 files already staged")
+                               .arg(staged.size()).arg(filesToStage.size()), Qt::cyan);
+    return staged;
+}
+
+bool UpdateController::applyBySlotSwitch(const QDir& slotDir)
+{
+    emit statusMessage("BUILDING SLOT " + slotDir.dirName() + "...", Qt::green);
+    if(!linkKeptFiles(slotDir))
+    {
+        if(m_fileHandler->isCancelled())
+            emit statusMessage("CANCELLED", Qt::yellow);
+        else
+            emit statusMessage("FAILED TO BUILD SLOT", Qt::red);
+        return false;
+    }
+
+    emit statusMessage("VERIFYING SLOT...", Qt::green);
+    QStringList mismatches = m_fileHandler->verifyFiles(slotDir, m_sourceManifest.files);
+    if(!mismatches.isEmpty())
+    {
+        for(const auto& f : mismatches)
+            emit statusMessage("Slot mismatch: " + f, Qt::red);
+        emit statusMessage("SLOT VERIFICATION FAILED", Qt::red);
+        return false;
+    }
+
+    // Relative, so the whole installation can be moved.
+    QString linkTarget = kSlotsDir + '/' + slotDir.dirName();
+    emit statusMessage("SWITCHING TO SLOT " + slotDir.dirName() + "...", Qt::green);
+    if(!Platform::replaceSymlink(m_targetDir.absolutePath(), linkTarget))
+    {
+        emit statusMessage("Failed to point " + m_targetDir.absolutePath() + " at " + linkTarget, Qt::red);
+        return false;
+    }
+    if(m_durability != Durability::None)
+        Platform::syncDirectory(m_slotRoot->absolutePath());
+    emit progressUpdated(kCurrentLink + " -> " + linkTarget + " (SWITCH)", true);
+
+    migrateShortcuts(m_diff.toRemove + m_diff.stale);
+    return true;
+}
+
+// Staging must be on the target's filesystem for the apply to be renames rather than
+// copies. The parent is preferred, leaving the tree itself alone; a target that is a
+// mount point, or whose parent cannot be written, stages in a hidden directory inside.
+QDir UpdateController::stagingParent() const
+{
+    QDir parentDir(m_targetDir);
+    parentDir.cdUp();
+
+    auto targetDevice = Platform::deviceId(m_targetDir.absolutePath());
+    bool sameDevice = !targetDevice || targetDevice == Platform::deviceId(parentDir.absolutePath());
+    if(sameDevice && QFileInfo(parentDir.absolutePath()).isWritable())
+        return parentDir;
+    return QDir(m_targetDir.filePath(kInTargetStagingDir));
+}
+
+// The slot "current" does not point at; A for a first install.
+QString UpdateController::inactiveSlot() const
+{
+    QString active = QFileInfo(m_targetDir.absolutePath()).canonicalFilePath();
+    QString slotA = QDir(m_slotRoot->filePath(kSlotsDir + "/A")).canonicalPath();
+    return !active.isEmpty() && active == slotA ? "B" : "A";
+}
+
+bool UpdateController::linkKeptFiles(const QDir& treeDir)
+{
+    // Anything the new tree cannot carry over would vanish from the target with it.
+    if(!m_targetSnapshot.isComplete())
+    {
+        emit statusMessage("Cannot build a new tree: the target was not fully listed", Qt::yellow);
+        return false;
+    }
+
+    // treeDir already holds every added and updated file.
+    QSet<QString> replaced;
+    for(const auto& list : {m_diff.toAdd, m_diff.toUpdate, m_diff.toRemove, m_diff.stale})
+        replaced.unite(QSet<QString>(list.begin(), list.end()));
+
+    QStringList kept;
+    for(const auto& relPath : m_targetSnapshot.files())
+    {
+        if(!replaced.contains(relPath))
+            kept.append(relPath);
+    }
+
+    // Other entries are symlinks to directories, which are recreated, or FIFOs, sockets
+    // and devices, which are not.
+    QHash<QString, QString> keptLinks;
+    for(const auto& relPath : m_targetSnapshot.others())
+    {
+        if(replaced.contains(relPath) || m_sourceManifest.files.contains(relPath))
+            continue;
+        auto target = Platform::readSymlink(m_targetDir.filePath(relPath));
+        if(!target)
+        {
+            emit statusMessage("Cannot build a new tree: cannot recreate special file " + relPath, Qt::yellow);
+            return false;
+        }
+        keptLinks.insert(relPath, *target);
+    }
+
+    QStringList notLinked = m_fileHandler->linkFiles(m_targetDir, treeDir, kept);
+    if(!notLinked.isEmpty())
+    {
+        if(!m_fileHandler->isCancelled())
+        {
+            for(const auto& f : notLinked)
+                emit statusMessage("Cannot link unchanged file: " + f, Qt::red);
+        }
+        return false;
+    }
+
+    for(auto it = keptLinks.constBegin(); it != keptLinks.constEnd(); ++it)
+    {
+        QString linkPath = treeDir.filePath(it.key());
+        if(!treeDir.mkpath(QFileInfo(it.key()).path()) || !Platform::replaceSymlink(linkPath, it.value()))
+        {
+            emit statusMessage("Cannot link unchanged file: " + it.key(), Qt::red);
+            return false;
+        }
+    }
+
+    QStringList directories = m_targetSnapshot.directories();
+    if(!m_sweepEmptyDirs)
+    {
+        for(const auto& relDir : directories)
+        {
+            if(m_targetSnapshot.isEmptyDirectory(relDir))
+                treeDir.mkpath(relDir);
+        }
+    }
+    // mkpath used the umask; the modes are set last, so a read-only directory is filled
+    // before it becomes read-only. Deepest first, while the parents are still searchable.
+    std::sort(directories.begin(), directories.end(), std::greater<QString>());
+    for(const auto& relDir : directories)
+    {
+        QString treePath = treeDir.filePath(relDir);
+        QFile::Permissions permissions = QFileInfo(m_targetDir.filePath(relDir)).permissions();
+        if(QFileInfo(treePath).isDir() && !QFile::setPermissions(treePath, permissions))
+            qWarning() << "Cannot copy permissions of directory" << relDir;
+    }
+
+    // The tree is about to become the target in a single rename or symlink switch.
+    if(m_durability != Durability::None)
+        syncDirectories(treeDir, kept + keptLinks.keys() + m_sourceManifest.files.keys());
 
+    emit statusMessage(QString("Linked %1 unchanged files").arg(kept.size()), Qt::cyan);
+    return true;
+}
+
+void UpdateController::migrateShortcuts(const QStringList& removedRelPaths)
+{
+    QString newBaseName = m_sourceManifest.appExe.isEmpty()
+        ? QString() : QFileInfo(m_sourceManifest.appExe).completeBaseName();
+
+    for(const auto& relPath : removedRelPaths)
+    {
+        if(!relPath.endsWith(".exe", Qt::CaseInsensitive))
+            continue;
+
+        QString oldBaseName = QFileInfo(relPath).completeBaseName();
+        if(!newBaseName.isEmpty() && oldBaseName.compare(newBaseName, Qt::CaseInsensitive) != 0)
+        {
+            QString newAbsPath = m_targetDir.absoluteFilePath(m_sourceManifest.appExe);
+            Platform::migrateShortcuts(QFileInfo(relPath).fileName(),
+                                      newAbsPath, newBaseName);
+        }
+        else
+        {
+            Platform::removeShortcut(oldBaseName);
+        }
+    }
+}
+
+void UpdateController::finishUpdate()
+{
     if(!m_sourceManifest.appExe.isEmpty())
     {
         QString absPath = m_targetDir.absoluteFilePath(m_sourceManifest.appExe);
@@ -493,11 +1059,220 @@ void UpdateController::execute()
     }
 
     cleanupDownload();
+    m_targetDir.rmdir(kInTargetStagingDir);  // only if staging was placed there and is now empty
     emit updateFinished(true);
 }
 
-bool UpdateController::applyStaged(const QDir& stagingDir, const QStringList& filesToStage)
+bool UpdateController::checkDeltaApplies(const QStringList& filesToStage)
 {
+    if(m_targetVersion != m_delta->baseVersion)
+    {
+        emit statusMessage(QString("Delta package requires version %1, installed version is %2")
+                               .arg(m_delta->baseVersion.toString(),
+                                    m_targetVersion.isNull() ? "unknown" : m_targetVersion.toString()),
+                           Qt::red);
+        return false;
+    }
+
+    QStringList shipped = m_delta->added + m_delta->updated;
+    QSet<QString> inPackage(shipped.begin(), shipped.end());
+
+    bool applies = true;
+    for(const auto& relPath : filesToStage)
+    {
+        bool shipsFullFile = QFile::exists(m_sourceDir.filePath(relPath));
+        bool baseMatches = !m_delta->baseFiles.contains(relPath)
+                           || m_delta->baseFiles.value(relPath) == m_targetFiles.value(relPath);
+        if(!inPackage.contains(relPath) || (!shipsFullFile && !baseMatches))
+        {
+            emit statusMessage("Target differs from delta base: " + relPath, Qt::red);
+            applies = false;
+        }
+    }
+    return applies;
+}
+
+QUrl UpdateController::remoteFileUrl(const QString& relPath) const
+{
+    QUrl relative;
+    relative.setPath(relPath);
+    return m_remoteManifestUrl.resolved(relative);
+}
+
+bool UpdateController::stageFromSource(const QDir& stagingDir, const QStringList& relPaths,
+                                       QSet<QString>& preverified)
+{
+    if(!m_remoteManifestUrl.isEmpty())
+        return stageRemoteFiles(stagingDir, relPaths);
+    if(isBundleSource())
+        return stageBundleFiles(stagingDir, relPaths, preverified);
+    if(m_sourceUrl.isEmpty())
+        return m_fileHandler->copyFiles(m_sourceDir, stagingDir, relPaths);
+
+    // Extracted by this process on the staging filesystem; nothing else reads it.
+    if(!m_fileHandler->moveFiles(m_sourceDir, stagingDir, relPaths))
+        return false;
+    // Moved unchanged out of an archive whose entries were hashed against the manifest
+    // while being inflated; verifying them again would only re-read what was just written.
+    for(const auto& relPath : relPaths)
+    {
+        if(m_downloadHandler->verifiedFiles().contains(relPath))
+            preverified.insert(relPath);
+    }
+    return true;
+}
+
+bool UpdateController::isBundleSource() const
+{
+    return m_downloadHandler && !m_sourceUrl.isEmpty() && m_downloadHandler->isBundle();
+}
+
+bool UpdateController::stageBundleFiles(const QDir& stagingDir, const QStringList& relPaths,
+                                        QSet<QString>& preverified)
+{
+    if(!m_downloadHandler->fetchBundleEntries(relPaths))
+        return false;
+
+    // Entries go straight from the bundle into staging, hashed on the way out, spread
+    // over all cores. Directories first, so workers never race to create them.
+    const DownloadHandler* source = m_downloadHandler;
+    FileHandler* fileHandler = m_fileHandler;
+    QList<ExtractJob> jobs;
+    for(const auto& relPath : relPaths)
+    {
+        QString outPath = stagingDir.filePath(relPath);
+        QDir().mkpath(QFileInfo(outPath).absolutePath());
+        QByteArray expectedHash = m_sourceManifest.files.value(relPath);
+        jobs.append({relPath, source->bundleEntrySize(relPath), [=](QString* error) {
+            QByteArray hash;
+            if(!source->extractBundleEntry(relPath, outPath, &hash, error))
+                return false;
+            if(hash != expectedHash)
+            {
+                *error = "Bundle entry does not match the manifest: " + relPath;
+                QFile::remove(outPath);
+                return false;
+            }
+            fileHandler->flushWritten(outPath);
+            return true;
+        }});
+    }
+
+    auto entryDone = [&](const ExtractJob& job, bool ok) {
+        emit progressUpdated(job.name + " (EXTRACT)", ok);
+        if(ok)
+            preverified.insert(job.name);
+    };
+    QString error;
+    bool ok = runExtractJobs(jobs, entryDone, [this]() { return m_fileHandler->isCancelled(); }, &error);
+    if(!error.isEmpty())
+        qWarning().noquote() << error;
+    return ok;
+}
+
+bool UpdateController::stageRemoteFiles(const QDir& stagingDir, const QStringList& relPaths)
+{
+    qint64 reusedBytes = 0;
+    qint64 fetchedBytes = 0;
+
+    for(const auto& relPath : relPaths)
+    {
+        if(m_fileHandler->isCancelled())
+            return false;
+
+        QString outPath = stagingDir.filePath(relPath);
+        QDir().mkpath(QFileInfo(outPath).absolutePath());
+
+        bool fetched = false;
+        if(m_sourceManifest.blocks.contains(relPath) && QFileInfo::exists(m_targetDir.filePath(relPath))
+           && m_downloadHandler->supportsRanges(remoteFileUrl(relPath)))
+            fetched = fetchWithBlockReuse(relPath, outPath, &reusedBytes, &fetchedBytes);
+
+        if(!fetched)
+        {
+            fetched = m_downloadHandler->fetchFile(remoteFileUrl(relPath), outPath);
+            if(fetched)
+                fetchedBytes += QFileInfo(outPath).size();
+        }
+
+        emit progressUpdated(relPath + " (FETCH)", fetched);
+        if(!fetched)
+            return false;
+        m_fileHandler->flushWritten(outPath);
+    }
+
+    emit statusMessage(QString("Fetched %1 KB, reused %2 KB from installed files")
+                           .arg(fetchedBytes / 1024).arg(reusedBytes / 1024), Qt::cyan);
+    return true;
+}
+
+bool UpdateController::fetchWithBlockReuse(const QString& relPath, const QString& outPath,
+                                           qint64* reusedBytes, qint64* fetchedBytes)
+{
+    static const int kMaxRangeRequests = 64;
+
+    const BlockChecksums sums = m_sourceManifest.blocks.value(relPath);
+    QString localPath = m_targetDir.filePath(relPath);
+    QList<qint64> matches = matchBlocks(sums, localPath);
+
+    QList<QPair<qint64, qint64>> missing;
+    qint64 missingBytes = 0;
+    for(int block = 0; block < matches.size(); ++block)
+    {
+        if(matches[block] >= 0)
+            continue;
+        qint64 offset = static_cast<qint64>(block) * sums.blockSize;
+        qint64 length = qMin<qint64>(sums.blockSize, sums.fileSize - offset);
+        if(!missing.isEmpty() && missing.last().first + missing.last().second == offset)
+            missing.last().second += length;
+        else
+            missing.append({offset, length});
+        missingBytes += length;
+    }
+
+    // Not worth the round trips: let the caller fetch the whole file.
+    if(missing.size() > kMaxRangeRequests || missingBytes > sums.fileSize / 2)
+        return false;
+
+    QFile local(localPath);
+    QFile out(outPath);
+    if(!local.open(QFile::ReadOnly) || !out.open(QFile::WriteOnly | QFile::Truncate))
+        return false;
+
+    for(int block = 0; block < matches.size(); ++block)
+    {
+        if(matches[block] < 0)
+            continue;
+        qint64 offset = static_cast<qint64>(block) * sums.blockSize;
+        qint64 length = qMin<qint64>(sums.blockSize, sums.fileSize - offset);
+        if(!local.seek(matches[block]) || !out.seek(offset))
+            return false;
+        QByteArray data = local.read(length);
+        if(data.size() != length || out.write(data) != length)
+            return false;
+    }
+
+    if(!m_downloadHandler->fetchRanges(remoteFileUrl(relPath), missing, out))
+        return false;
+
+    if(!out.resize(sums.fileSize))
+        return false;
+    out.close();
+
+    *reusedBytes += sums.fileSize - missingBytes;
+    *fetchedBytes += missingBytes;
+    return true;
+}
+
+bool UpdateController::applyStaged(const QDir& stagingDir, const QStringList& filesToStage,
+                                   ApplyJournal& journal)
+{
+    // QFile::rename silently copies and deletes across filesystems, e.g. into a mount
+    // point below the target. Such moves are counted per target directory.
+    auto stagingDevice = Platform::deviceId(stagingDir.absolutePath());
+    QHash<QString, bool> crossDeviceDirs;
+    int crossDeviceMoves = 0;
+
     for(const auto& relPath : filesToStage)
     {
         QString srcPath = stagingDir.filePath(relPath);
@@ -511,6 +1286,14 @@ bool UpdateController::applyStaged(const QDir& stagingDir, const QStringList& fi
             return false;
         }
 
+        auto crossDevice = crossDeviceDirs.constFind(tgtDir.absolutePath());
+        if(crossDevice == crossDeviceDirs.constEnd())
+        {
+            auto device = Platform::deviceId(tgtDir.absolutePath());
+            crossDevice = crossDeviceDirs.insert(tgtDir.absolutePath(),
+                                                 stagingDevice && device && stagingDevice != device);
+        }
+
         if(QFile::exists(tgtPath))
         {
             bool removed = false;
@@ -539,8 +1322,32 @@ bool UpdateController::applyStaged(const QDir& stagingDir, const QStringList& fi
             return false;
         }
 
-        emit progressUpdated(relPath + " (APPLY)", true);
+        if(m_durability == Durability::Strict)
+            Platform::syncDirectory(tgtDir.absolutePath());
+        journal.applied(relPath);
+        if(crossDevice.value())
+        {
+            ++crossDeviceMoves;
+            emit progressUpdated(relPath + " (APPLY, copied across filesystems)", true);
+        }
+        else
+        {
+            emit progressUpdated(relPath + " (APPLY)", true);
+        }
+    }
+
+    if(crossDeviceMoves > 0)
+    {
+        qWarning() << crossDeviceMoves << "of" << filesToStage.size()
+                   << "files were copied across filesystems instead of renamed";
+        emit statusMessage(QString("Cross-device moves: %1 of %2 files were copied, not renamed")
+                               .arg(crossDeviceMoves).arg(filesToStage.size()), Qt::yellow);
     }
+
+    // Batch syncs every touched directory once; this also covers directories that
+    // mkpath created above and the .bak renames, which sit next to the files.
+    if(m_durability != Durability::None)
+        syncDirectories(m_targetDir, filesToStage);
     return true;
 }
 
@@ -548,39 +1355,135 @@ bool UpdateController::resolveFileLock(const QString& absolutePath)
 {
     while(true)
     {
-        auto locked = Platform::findLockingProcesses({absolutePath});
+        auto locked = findLockers({absolutePath});
         if(locked.isEmpty())
             return false;
 
-        QStringList descriptions;
-        for(const auto& p : locked)
-            descriptions << QString("%1 (PID %2)").arg(p.name).arg(p.pid);
+        if(promptForLocks(locked, {absolutePath}) == LockAction::Cancel)
+            return false;
 
-        emit processLockDetected(descriptions);
+        auto stillLocked = findLockers({absolutePath});
+        if(stillLocked.isEmpty())
+            return true;
+    }
+}
 
-        LockAction action;
-        {
-            QMutexLocker locker(&m_lockMutex);
-            m_lockResponse = LockAction::Retry;
-            m_lockCondition.wait(&m_lockMutex);
-            action = m_lockResponse;
-        }
+// The updater may map libraries from the target itself; it must never offer to kill itself.
+static QList<Platform::LockedProcess> withoutSelf(QList<Platform::LockedProcess> locked)
+{
+    const quint64 self = static_cast<quint64>(QCoreApplication::applicationPid());
+    locked.removeIf([self](const Platform::LockedProcess& p) { return p.pid == self; });
+    return locked;
+}
 
-        if(action == LockAction::Cancel)
-        {
-            m_fileHandler->cancel();
+bool UpdateController::preflightLocks()
+{
+    if(m_fileHandler->isCancelled())
+        return false;
+
+    QStringList paths;
+    for(const auto& relPath : m_diff.toUpdate + m_diff.toRemove + m_diff.stale)
+        paths << m_targetDir.absoluteFilePath(relPath);
+    if(paths.isEmpty())
+        return true;
+
+    emit statusMessage("CHECKING FOR LOCKED FILES...", Qt::green);
+
+    // Ask once for everything that holds a file we are about to replace or delete, so the
+    // apply phase does not stop half-way for another prompt.
+    while(true)
+    {
+        auto locked = findLockers(paths);
+        if(locked.isEmpty())
+            return true;
+        if(promptForLocks(locked, paths) == LockAction::Cancel)
             return false;
-        }
+    }
+}
 
-        if(action == LockAction::KillAll)
-        {
-            for(const auto& p : locked)
-                Platform::killProcess(p.pid);
-            QThread::msleep(500);
-        }
+bool UpdateController::waitForLockRelease(QList<Platform::LockedProcess> locked, const QStringList& paths)
+{
+    QElapsedTimer timer;
+    timer.start();
 
-        auto stillLocked = Platform::findLockingProcesses({absolutePath});
-        if(stillLocked.isEmpty())
+    while(true)
+    {
+        qint64 remaining = m_lockWaitMs - timer.elapsed();
+        if(remaining <= 0 || m_fileHandler->isCancelled())
+            return false;
+
+        QList<quint64> pids;
+        for(const auto& p : locked)
+            pids << p.pid;
+        Platform::waitForLockRelease(pids, paths, static_cast<int>(remaining),
+                                     [this]{ return m_fileHandler->isCancelled(); });
+
+        m_lockSnapshot.reset();
+        locked = findLockers(paths);
+        if(locked.isEmpty())
             return true;
     }
 }
+
+LockAction UpdateController::promptForLocks(const QList<Platform::LockedProcess>& locked,
+                                            const QStringList& paths)
+{
+    if(m_lockWaitMs > 0)
+    {
+        emit statusMessage(QString("Waiting up to %1 s for locked files to be released...")
+                               .arg(m_lockWaitMs / 1000), Qt::yellow);
+        if(waitForLockRelease(locked, paths))
+            return LockAction::Retry;
+        if(m_fileHandler->isCancelled())
+            return LockAction::Cancel;
+    }
+
+    QStringList descriptions;
+    for(const auto& p : locked)
+        descriptions << QString("%1 (PID %2)").arg(p.name).arg(p.pid);
+
+    emit processLockDetected(descriptions);
+
+    LockAction action;
+    {
+        QMutexLocker locker(&m_lockMutex);
+        m_lockResponse = LockAction::Retry;
+        m_lockCondition.wait(&m_lockMutex);
+        action = m_lockResponse;
+    }
+
+    if(action == LockAction::Cancel)
+        m_fileHandler->cancel();
+
+    if(action == LockAction::KillAll)
+    {
+        static const int kKillTimeoutMs = 5000;
+
+        QList<quint64> pids;
+        for(const auto& p : locked)
+            pids << p.pid;
+        if(!Platform::killProcessesAndWait(pids, kKillTimeoutMs))
+            qWarning() << "Not all locking processes exited within" << kKillTimeoutMs << "ms";
+    }
+
+    m_lockSnapshot.reset();
+    return action;
+}
+
+QList<Platform::LockedProcess> UpdateController::findLockers(const QStringList& absolutePaths)
+{
+    static const qint64 kLockSnapshotMaxAgeMs = 2000;
+
+    // One snapshot answers every lookup of a resolve cycle. A cached snapshot is only
+    // trusted to confirm a lock; when it reports none the scan is repeated.
+    if(m_lockSnapshot && m_lockSnapshotAge.elapsed() < kLockSnapshotMaxAgeMs)
+    {
+        auto locked = withoutSelf(m_lockSnapshot->lockersOf(absolutePaths));
+        if(!locked.isEmpty())
+            return locked;
+    }
+
+    m_lockSnapshot = Platform::LockSnapshot::capture();
+    m_lockSnapshotAge.start();
+    return withoutSelf(m_lockSnapshot->lockersOf(absolutePaths));
+}
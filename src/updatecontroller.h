@@ -2,14 +2,21 @@
 #define UPDATECONTROLLER_H
 
 #include "manifest.h"
+#include "durability.h"
 #include "filehandler.h"
+#include "platform/platform.h"
 #include <QColor>
 #include <QDir>
+#include <QElapsedTimer>
 #include <QMutex>
 #include <QObject>
+#include <QSet>
+#include <QUrl>
 #include <QWaitCondition>
 
+class ApplyJournal;
 class DownloadHandler;
+class StagingJournal;
 
 enum class LockAction { Retry, KillAll, Cancel };
 
@@ -24,6 +31,13 @@ public:
     void setForceUpdate(bool force);
     void setInstallMode(bool install);
     void setContinueUpdate(bool continueUpdate);
+    void setLockWait(int seconds);
+    void setSweepEmptyDirs(bool sweep);
+    void setSwapApply(bool swap);
+    // Treat the target directory as the root of an A/B layout: slots/A, slots/B and a
+    // "current" symlink to the active slot. Updates are built in the other slot.
+    void setSlotLayout(bool enabled);
+    void setDurability(Durability durability);
 
     // Resolve source URL to a local directory. Must be called before prepare()
     // when the source is a URL. Returns true on success.
@@ -67,25 +81,62 @@ signals:
 private:
     QDir m_sourceDir;
     QString m_sourceUrl;
+    QUrl m_remoteManifestUrl;  // set when the source URL is a manifest.json served next to loose files
     QDir m_targetDir;
     bool m_forceUpdate = false;
     bool m_installMode = false;
     bool m_continueUpdate = false;
     bool m_mandatory = false;
+    qint64 m_lockWaitMs = 0;
+    bool m_sweepEmptyDirs = false;  // remove every empty directory, not just those this update emptied
+    bool m_swapApply = false;       // build the new tree beside the target and exchange directories
+    bool m_slotLayout = false;
+    Durability m_durability = Durability::Batch;
+    std::optional<QDir> m_slotRoot;  // set by prepare() in slot layout; m_targetDir is then its "current" link
     FileHandler* m_fileHandler;
     DownloadHandler* m_downloadHandler = nullptr;
     Manifest m_sourceManifest;
+    std::optional<DeltaDescriptor> m_delta;
     QVersionNumber m_targetVersion;
     QHash<QString, QByteArray> m_targetFiles;
+    DirectorySnapshot m_targetSnapshot;  // scanned once per execute(), kept in sync afterwards
     FileDiff m_diff;
 
     QMutex m_lockMutex;
     QWaitCondition m_lockCondition;
     LockAction m_lockResponse = LockAction::Retry;
+    std::optional<Platform::LockSnapshot> m_lockSnapshot;  // reused until the user acts or it ages out
+    QElapsedTimer m_lockSnapshotAge;
 
     void hashTargetWithLockRetry();
-    bool applyStaged(const QDir& stagingDir, const QStringList& filesToStage);
+    bool checkDeltaApplies(const QStringList& filesToStage);
+    QUrl remoteFileUrl(const QString& relPath) const;
+    // Files hashed against the manifest while being staged are added to preverified.
+    bool stageFromSource(const QDir& stagingDir, const QStringList& relPaths, QSet<QString>& preverified);
+    bool isBundleSource() const;
+    bool stageBundleFiles(const QDir& stagingDir, const QStringList& relPaths, QSet<QString>& preverified);
+    bool stageRemoteFiles(const QDir& stagingDir, const QStringList& relPaths);
+    bool fetchWithBlockReuse(const QString& relPath, const QString& outPath,
+                             qint64* reusedBytes, qint64* fetchedBytes);
+    // Files of filesToStage already staged and verified by an earlier, interrupted run.
+    QSet<QString> resumeStaging(const QDir& stagingDir, const QStringList& filesToStage,
+                                StagingJournal& journal);
+    bool applyStaged(const QDir& stagingDir, const QStringList& filesToStage, ApplyJournal& journal);
+    // Complete stagingDir into the full new tree and exchange it with the target.
+    // Returns nullopt, with the target untouched, if the per-file apply should run instead.
+    std::optional<bool> applyBySwap(const QDir& stagingDir);
+    bool applyBySlotSwitch(const QDir& slotDir);
+    QString inactiveSlot() const;
+    QDir stagingParent() const;
+    // Link every target file the per-file apply would keep into treeDir.
+    bool linkKeptFiles(const QDir& treeDir);
+    void migrateShortcuts(const QStringList& removedRelPaths);
+    void finishUpdate();
     bool resolveFileLock(const QString& absolutePath);
+    bool preflightLocks();
+    LockAction promptForLocks(const QList<Platform::LockedProcess>& locked, const QStringList& paths);
+    bool waitForLockRelease(QList<Platform::LockedProcess> locked, const QStringList& paths);
+    QList<Platform::LockedProcess> findLockers(const QStringList& absolutePaths);
 };
 
 #endif // UPDATECONTROLLER_H
@@ -0,0 +1,248 @@
+#include "ziparchive.h"
+
+#include <QtEndian>
+
+static const quint32 kLocalHeaderSignature = 0x04034b50;
+static const quint32 kCentralHeaderSignature = 0x02014b50;
+static const quint32 kEndOfCentralDirSignature = 0x06054b50;
+static const quint32 kZip64EndOfCentralDirSignature = 0x06064b50;
+static const quint32 kZip64LocatorSignature = 0x07064b50;
+
+static quint16 read16(const uchar* p) { return qFromLittleEndian<quint16>(p); }
+static quint32 read32(const uchar* p) { return qFromLittleEndian<quint32>(p); }
+static quint64 read64(const uchar* p) { return qFromLittleEndian<quint64>(p); }
+
+static bool fail(QString* error, const QString& message)
+{
+    if(error)
+        *error = message;
+    return false;
+}
+
+// Rejects names that would escape the extraction directory, and names such as "a//b"
+// or "./a" that alias another spelling of the same path.
+static bool isSafeName(const QString& name)
+{
+    QString path = name.endsWith('/') ? name.chopped(1) : name;
+    if(path.isEmpty() || path.startsWith('/') || path.contains(':'))
+        return false;
+    for(const auto& part : path.split('/'))
+    {
+        if(part.isEmpty() || part == "." || part == "..")
+            return false;
+    }
+    return true;
+}
+
+bool ZipArchive::open(const QString& path)
+{
+    close();
+    m_file.setFileName(path);
+    if(!m_file.open(QFile::ReadOnly))
+    {
+        m_error = m_file.errorString();
+        return false;
+    }
+
+    m_size = m_file.size();
+    m_data = m_size > 0 ? m_file.map(0, m_size) : nullptr;
+    if(!m_data)
+    {
+        m_error = "Cannot map " + path;
+        close();
+        return false;
+    }
+
+    if(!readCentralDirectory())
+    {
+        QString error = m_error;
+        close();
+        m_error = error;
+        return false;
+    }
+    return true;
+}
+
+void ZipArchive::close()
+{
+    if(m_data)
+        m_file.unmap(const_cast<uchar*>(m_data));
+    m_data = nullptr;
+    m_size = 0;
+    m_file.close();
+    m_entries.clear();
+    m_index.clear();
+    m_error.clear();
+}
+
+const ZipArchive::Entry* ZipArchive::entry(const QString& name) const
+{
+    auto it = m_index.constFind(name);
+    return it == m_index.constEnd() ? nullptr : &m_entries[it.value()];
+}
+
+bool ZipArchive::readCentralDirectory()
+{
+    // The end record is 22 bytes, followed by a comment of up to 64 KiB.
+    qint64 eocd = -1;
+    for(qint64 pos = m_size - 22; pos >= 0 && pos >= m_size - 22 - 0xFFFF; --pos)
+    {
+        if(read32(m_data + pos) == kEndOfCentralDirSignature)
+        {
+            eocd = pos;
+            break;
+        }
+    }
+    if(eocd < 0)
+        return fail(&m_error, "Not a zip archive");
+
+    quint64 count = read16(m_data + eocd + 10);
+    quint64 dirSize = read32(m_data + eocd + 12);
+    quint64 dirOffset = read32(m_data + eocd + 16);
+    if(eocd >= 20 && read32(m_data + eocd - 20) == kZip64LocatorSignature)
+    {
+        quint64 record = read64(m_data + eocd - 20 + 8);
+        if(record + 56 > quint64(m_size) || read32(m_data + record) != kZip64EndOfCentralDirSignature)
+            return fail(&m_error, "Corrupt zip64 end of central directory");
+        count = read64(m_data + record + 32);
+        dirSize = read64(m_data + record + 40);
+        dirOffset = read64(m_data + record + 48);
+    }
+    if(dirOffset > quint64(m_size) || dirSize > quint64(m_size) - dirOffset)
+        return fail(&m_error, "Central directory out of range");
+
+    const uchar* p = m_data + dirOffset;
+    const uchar* end = p + dirSize;
+    for(quint64 i = 0; i < count; ++i)
+    {
+        if(end - p < 46 || read32(p) != kCentralHeaderSignature)
+            return fail(&m_error, "Corrupt central directory");
+
+        quint16 madeBy = read16(p + 4);
+        quint16 flags = read16(p + 8);
+        quint16 nameLength = read16(p + 28);
+        quint16 extraLength = read16(p + 30);
+        quint16 commentLength = read16(p + 32);
+        if(end - p < 46 + nameLength + extraLength + commentLength)
+            return fail(&m_error, "Corrupt central directory");
+
+        Entry entry;
+        entry.method = read16(p + 10);
+        entry.crc32 = read32(p + 16);
+        quint64 compressedSize = read32(p + 20);
+        quint64 size = read32(p + 24);
+        quint64 offset = read32(p + 42);
+        entry.name = QString::fromUtf8(reinterpret_cast<const char*>(p + 46), nameLength);
+        entry.name.replace('\\', '/');
+        if(madeBy >> 8 == 3)
+            entry.unixMode = read32(p + 38) >> 16;
+
+        // Sizes and offset that do not fit 32 bits are in the zip64 extra field, in this order.
+        const uchar* extra = p + 46 + nameLength;
+        const uchar* extraEnd = extra + extraLength;
+        while(extraEnd - extra >= 4)
+        {
+            quint16 id = read16(extra);
+            quint16 length = read16(extra + 2);
+            const uchar* field = extra + 4;
+            if(extraEnd - field < length)
+                break;
+            if(id == 0x0001)
+            {
+                const uchar* value = field;
+                for(quint64* target : {&size, &compressedSize, &offset})
+                {
+                    if(*target == 0xFFFFFFFF && field + length - value >= 8)
+                    {
+                        *target = read64(value);
+                        value += 8;
+                    }
+                }
+            }
+            extra = field + length;
+        }
+        entry.compressedSize = qint64(compressedSize);
+        entry.size = qint64(size);
+        entry.localHeaderOffset = qint64(offset);
+
+        if(flags & 0x1)
+            return fail(&m_error, "Encrypted entries are not supported: " + entry.name);
+        if(!isSafeName(entry.name))
+            return fail(&m_error, "Unsafe path in archive: " + entry.name);
+        if(entry.method != DeflateBlob::kStored && entry.method != DeflateBlob::kDeflated)
+            return fail(&m_error, QString("Unsupported compression method %1: %2").arg(entry.method).arg(entry.name));
+        // Two entries for one path would be extracted over each other.
+        if(m_index.contains(entry.name))
+            return fail(&m_error, "Duplicate path in archive: " + entry.name);
+
+        m_index.insert(entry.name, m_entries.size());
+        m_entries.append(entry);
+        p += 46 + nameLength + extraLength + commentLength;
+    }
+    return true;
+}
+
+std::optional<DeflateBlob> ZipArchive::blob(const Entry& entry, QString* error) const
+{
+    // The local header repeats name and extra field, possibly with different lengths.
+    quint64 header = quint64(entry.localHeaderOffset);
+    if(header + 30 > quint64(m_size) || read32(m_data + header) != kLocalHeaderSignature)
+    {
+        fail(error, "Corrupt local header: " + entry.name);
+        return std::nullopt;
+    }
+    quint64 start = header + 30 + read16(m_data + header + 26) + read16(m_data + header + 28);
+    if(start > quint64(m_size) || quint64(entry.compressedSize) > quint64(m_size) - start)
+    {
+        fail(error, "Entry data out of range: " + entry.name);
+        return std::nullopt;
+    }
+
+    DeflateBlob blob;
+    blob.data = m_data + start;
+    blob.compressedSize = entry.compressedSize;
+    blob.size = entry.size;
+    blob.method = entry.method;
+    return blob;
+}
+
+std::optional<QByteArray> ZipArchive::read(const Entry& entry, QString* error) const
+{
+    auto source = blob(entry, error);
+    if(!source)
+        return std::nullopt;
+
+    QByteArray data;
+    data.reserve(entry.size);
+    quint32 crc = 0;
+    bool ok = inflateBlob(*source, entry.name, [&data](const char* chunk, qint64 length) {
+        data.append(chunk, length);
+        return true;
+    }, &crc, error);
+    if(!ok)
+        return std::nullopt;
+    if(crc != entry.crc32)
+    {
+        fail(error, "CRC mismatch: " + entry.name);
+        return std::nullopt;
+    }
+    return data;
+}
+
+bool ZipArchive::extract(const Entry& entry, const QString& destPath, QByteArray* sha256,
+                         QString* error) const
+{
+    auto source = blob(entry, error);
+    if(!source)
+        return false;
+
+    quint32 crc = 0;
+    if(!extractBlob(*source, entry.name, destPath, entry.unixMode & 0111, sha256, &crc, error))
+        return false;
+    if(crc != entry.crc32)
+    {
+        QFile::remove(destPath);
+        return fail(error, "CRC mismatch: " + entry.name);
+    }
+    return true;
+}
@@ -0,0 +1,68 @@
+#ifndef ZIPARCHIVE_H
+#define ZIPARCHIVE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <optional>
+
+#include "deflateblob.h"
+
+// Read-only zip reader on top of zlib. The archive is memory-mapped and located through
+// its central directory (zip64 included), so entries can be read in any order, and from
+// several threads at once. Only stored and deflated entries are supported.
+class ZipArchive {
+public:
+    struct Entry {
+        QString name;  // '/' separated; directories end with '/'
+        qint64 compressedSize = 0;
+        qint64 size = 0;
+        qint64 localHeaderOffset = 0;
+        quint32 crc32 = 0;
+        quint16 method = 0;
+        quint32 unixMode = 0;  // st_mode if the archive was made on Unix, else 0
+
+        bool isDirectory() const { return name.endsWith('/'); }
+        bool isSymlink() const { return (unixMode & 0170000) == 0120000; }
+    };
+
+    ZipArchive() = default;
+    ZipArchive(const ZipArchive&) = delete;
+    ZipArchive& operator=(const ZipArchive&) = delete;
+
+    // Fails on anything that is not a readable zip, and on entries that are encrypted,
+    // use another compression method, would land outside the extraction directory or
+    // name the same path as another entry.
+    bool open(const QString& path);
+    void close();
+    QString errorString() const { return m_error; }
+
+    const QList<Entry>& entries() const { return m_entries; }
+    // nullptr if there is no entry of that name.
+    const Entry* entry(const QString& name) const;
+
+    // Inflate entry into memory. Meant for small entries such as manifest.json.
+    std::optional<QByteArray> read(const Entry& entry, QString* error = nullptr) const;
+
+    // Inflate entry to destPath, checking its CRC-32. With sha256 set, the SHA-256 of the
+    // inflated data is computed on the way and stored there, so the file need not be
+    // read back to be verified. Executable bits are restored from unixMode.
+    bool extract(const Entry& entry, const QString& destPath, QByteArray* sha256 = nullptr,
+                 QString* error = nullptr) const;
+
+private:
+    bool readCentralDirectory();
+    // Locates the data of entry behind its local header.
+    std::optional<DeflateBlob> blob(const Entry& entry, QString* error) const;
+
+    QFile m_file;
+    const uchar* m_data = nullptr;
+    qint64 m_size = 0;
+    QList<Entry> m_entries;
+    QHash<QString, int> m_index;
+    QString m_error;
+};
+
+#endif // ZIPARCHIVE_H
@@ -0,0 +1,90 @@
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QObject>
+#include <QTemporaryDir>
+#include <QTest>
+
+#include "directorysnapshot.h"
+
+// Synthetic tree of SIMPLEUPDATER_BENCH_FILES files (default 500000), 1000 per directory
+// spread over two levels. Set SIMPLEUPDATER_BENCH_DIR to reuse an existing tree.
+static int envInt(const char* name, int fallback)
+{
+    bool ok = false;
+    int value = qEnvironmentVariableIntValue(name, &ok);
+    return ok && value > 0 ? value : fallback;
+}
+
+class BenchDirectorySnapshot : public QObject {
+    Q_OBJECT
+
+private:
+    QTemporaryDir m_tempDir;
+    QDir m_root;
+
+private slots:
+
+    void initTestCase()
+    {
+        if(qEnvironmentVariableIsSet("SIMPLEUPDATER_BENCH_DIR"))
+        {
+            m_root = QDir(qEnvironmentVariable("SIMPLEUPDATER_BENCH_DIR"));
+            QVERIFY(m_root.exists());
+            return;
+        }
+
+        QVERIFY(m_tempDir.isValid());
+        m_root = QDir(m_tempDir.path());
+
+        const int fileCount = envInt("SIMPLEUPDATER_BENCH_FILES", 500000);
+        const int filesPerDir = 1000;
+        for(int i = 0; i < fileCount; ++i)
+        {
+            int dirIndex = i / filesPerDir;
+            QString relDir = QString("d%1/d%2").arg(dirIndex / 32).arg(dirIndex % 32);
+            if(i % filesPerDir == 0)
+                QVERIFY(m_root.mkpath(relDir));
+
+            QFile file(m_root.filePath(QString("%1/f%2.bin").arg(relDir).arg(i)));
+            QVERIFY(file.open(QFile::WriteOnly));
+            file.write("x");
+        }
+    }
+
+    void snapshotScan()
+    {
+        int count = 0;
+        QBENCHMARK {
+            count = DirectorySnapshot::scan(m_root).size();
+        }
+        QVERIFY(count > 0);
+    }
+
+    // The per-entry QFileInfo pattern the updater used before DirectorySnapshot.
+    void qdirIteratorScan()
+    {
+        int count = 0;
+        QBENCHMARK {
+            count = 0;
+            QDirIterator it(m_root.absolutePath(),
+                            QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot,
+                            QDirIterator::Subdirectories);
+            while(it.hasNext())
+            {
+                it.next();
+                QFileInfo info = it.fileInfo();
+                if(info.isSymLink())
+                    continue;
+                if(info.fileName().isEmpty() || m_root.relativeFilePath(info.absoluteFilePath()).isEmpty())
+                    continue;
+                ++count;
+            }
+        }
+        QVERIFY(count > 0);
+    }
+};
+
+QTEST_GUILESS_MAIN(BenchDirectorySnapshot)
+#include "bench_directorysnapshot.moc"
@@ -0,0 +1,120 @@
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QObject>
+#include <QSet>
+#include <QTemporaryDir>
+#include <QTest>
+
+#include "filehandler.h"
+#include "platform/platform.h"
+
+// Synthetic release of SIMPLEUPDATER_BENCH_FILES files (default 2000) of
+// SIMPLEUPDATER_BENCH_FILE_KB KB each (default 16), 100 per directory, staged and then
+// renamed into a target the way an update does, at each durability level. Syncs cost
+// nothing on tmpfs: point SIMPLEUPDATER_BENCH_DIR at a directory on a real disk.
+static int envInt(const char* name, int fallback)
+{
+    bool ok = false;
+    int value = qEnvironmentVariableIntValue(name, &ok);
+    return ok && value > 0 ? value : fallback;
+}
+
+static QString workDirTemplate()
+{
+    QString base = qEnvironmentVariableIsSet("SIMPLEUPDATER_BENCH_DIR")
+                       ? qEnvironmentVariable("SIMPLEUPDATER_BENCH_DIR") : QDir::tempPath();
+    return base + "/bench_durability-XXXXXX";
+}
+
+class BenchDurability : public QObject {
+    Q_OBJECT
+
+private:
+    QTemporaryDir m_tempDir{workDirTemplate()};
+    QDir m_root;
+    QDir m_source;
+    QStringList m_relPaths;
+    int m_run = 0;
+
+private slots:
+
+    void initTestCase()
+    {
+        QVERIFY(m_tempDir.isValid());
+        m_root = QDir(m_tempDir.path());
+        QVERIFY(m_root.mkpath("source"));
+        m_source = QDir(m_root.filePath("source"));
+
+        const int fileCount = envInt("SIMPLEUPDATER_BENCH_FILES", 2000);
+        const QByteArray content(envInt("SIMPLEUPDATER_BENCH_FILE_KB", 16) * 1024, 'x');
+        for(int i = 0; i < fileCount; ++i)
+        {
+            QString relDir = QString("d%1").arg(i / 100);
+            if(i % 100 == 0)
+                QVERIFY(m_source.mkpath(relDir));
+
+            QString relPath = QString("%1/f%2.bin").arg(relDir).arg(i);
+            QFile file(m_source.filePath(relPath));
+            QVERIFY(file.open(QFile::WriteOnly));
+            file.write(content);
+            m_relPaths.append(relPath);
+        }
+    }
+
+    void stageAndApply_data()
+    {
+        QTest::addColumn<int>("level");
+        QTest::newRow("none") << int(Durability::None);
+        QTest::newRow("batch") << int(Durability::Batch);
+        QTest::newRow("strict") << int(Durability::Strict);
+    }
+
+    // Copy into staging, flush it, then rename every file into the target and sync the
+    // directories, mirroring UpdateController's staging and per-file apply.
+    void stageAndApply()
+    {
+        QFETCH(int, level);
+        Durability durability = Durability(level);
+        FileHandler handler;
+        handler.setDurability(durability);
+
+        QBENCHMARK {
+            QString run = QString::number(m_run++);
+            QDir staging(m_root.filePath("staging" + run));
+            QDir target(m_root.filePath("target" + run));
+            QVERIFY(handler.copyFiles(m_source, staging, m_relPaths));
+            QVERIFY(handler.syncStaged(staging, m_relPaths));
+
+            QSet<QString> dirs;
+            for(const auto& relPath : m_relPaths)
+            {
+                QString tgtPath = target.filePath(relPath);
+                QString tgtDir = QFileInfo(tgtPath).absolutePath();
+                QDir().mkpath(tgtDir);
+                QVERIFY(QFile::rename(staging.filePath(relPath), tgtPath));
+                if(durability == Durability::Strict)
+                    Platform::syncDirectory(tgtDir);
+                dirs.insert(tgtDir);
+            }
+            if(durability != Durability::None)
+            {
+                dirs.insert(target.absolutePath());
+                for(const auto& dir : dirs)
+                    Platform::syncDirectory(dir);
+            }
+        }
+    }
+
+    void cleanup()
+    {
+        for(const auto& entry : m_root.entryList(QDir::Dirs | QDir::NoDotAndDotDot))
+        {
+            if(entry != "source")
+                QDir(m_root.filePath(entry)).removeRecursively();
+        }
+    }
+};
+
+QTEST_GUILESS_MAIN(BenchDurability)
+#include "bench_durability.moc"
@@ -0,0 +1,118 @@
+#include <QDir>
+#include <QFile>
+#include <QObject>
+#include <QTemporaryDir>
+#include <QTest>
+
+#include "platform/platform.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Synthetic load: SIMPLEUPDATER_BENCH_PROCS child processes (default 500), each holding
+// SIMPLEUPDATER_BENCH_FDS descriptors (default 50) open on a shared pool of files.
+static int envInt(const char* name, int fallback)
+{
+    bool ok = false;
+    int value = qEnvironmentVariableIntValue(name, &ok);
+    return ok && value > 0 ? value : fallback;
+}
+
+class BenchLockSnapshot : public QObject {
+    Q_OBJECT
+
+private:
+    QTemporaryDir m_tempDir;
+    QStringList m_paths;
+    QList<pid_t> m_children;
+
+private slots:
+
+    void initTestCase()
+    {
+        QVERIFY(m_tempDir.isValid());
+        QDir dir(m_tempDir.path());
+
+        const int procCount = envInt("SIMPLEUPDATER_BENCH_PROCS", 500);
+        const int fdsPerProc = envInt("SIMPLEUPDATER_BENCH_FDS", 50);
+        const int poolSize = 1000;
+
+        QList<QByteArray> nativePaths;
+        for(int i = 0; i < poolSize; ++i)
+        {
+            QString path = dir.filePath(QString("file_%1.bin").arg(i));
+            QFile file(path);
+            QVERIFY(file.open(QFile::WriteOnly));
+            file.close();
+            m_paths << path;
+            nativePaths << QFile::encodeName(path);
+        }
+
+        int ready[2];
+        QVERIFY(::pipe(ready) == 0);
+
+        for(int i = 0; i < procCount; ++i)
+        {
+            pid_t pid = ::fork();
+            QVERIFY(pid >= 0);
+            if(pid == 0)
+            {
+                ::close(ready[0]);
+                for(int fd = 0; fd < fdsPerProc; ++fd)
+                    ::open(nativePaths[(i * fdsPerProc + fd) % poolSize].constData(), O_RDONLY);
+                char byte = 1;
+                if(::write(ready[1], &byte, 1) != 1)
+                    ::_exit(1);
+                ::pause();
+                ::_exit(0);
+            }
+            m_children << pid;
+        }
+
+        ::close(ready[1]);
+        for(int i = 0; i < procCount; ++i)
+        {
+            char byte = 0;
+            QVERIFY(::read(ready[0], &byte, 1) == 1);
+        }
+        ::close(ready[0]);
+    }
+
+    void cleanupTestCase()
+    {
+        for(pid_t pid : m_children)
+            ::kill(pid, SIGKILL);
+        for(pid_t pid : m_children)
+            ::waitpid(pid, nullptr, 0);
+    }
+
+    void captureSnapshot()
+    {
+        QBENCHMARK {
+            Platform::LockSnapshot::capture();
+        }
+    }
+
+    void lookupManyPathsOneScan()
+    {
+        QStringList paths = m_paths.mid(0, 200);
+        QBENCHMARK {
+            auto lockers = Platform::LockSnapshot::capture().lockersOf(paths);
+            QVERIFY(!lockers.isEmpty());
+        }
+    }
+
+    void lookupManyPathsScanPerPath()
+    {
+        QStringList paths = m_paths.mid(0, 200);
+        QBENCHMARK {
+            for(const auto& path : paths)
+                Platform::findLockingProcesses({path});
+        }
+    }
+};
+
+QTEST_GUILESS_MAIN(BenchLockSnapshot)
+#include "bench_locksnapshot.moc"
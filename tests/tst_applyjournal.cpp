@@ -0,0 +1,193 @@
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QObject>
+#include <QTemporaryDir>
+#include <QTest>
+
+#include "applyjournal.h"
+
+static bool createFile(const QDir& dir, const QString& relPath, const QByteArray& content)
+{
+    QString fullPath = dir.filePath(relPath);
+    QDir().mkpath(QFileInfo(fullPath).absolutePath());
+    QFile file(fullPath);
+    if(!file.open(QFile::WriteOnly))
+        return false;
+    file.write(content);
+    file.close();
+    return true;
+}
+
+static QByteArray readFileContent(const QString& path)
+{
+    QFile file(path);
+    if(!file.open(QFile::ReadOnly))
+        return {};
+    return file.readAll();
+}
+
+class TestApplyJournal : public QObject {
+    Q_OBJECT
+
+private:
+    // Lays out target/ and staging/ as they are after renameToBackup and after moving
+    // the added file and one of the two updated files into the target. The process
+    // "dies" here: the journal is left behind without commit or finish.
+    void interruptedApply(const QDir& root, bool committed)
+    {
+        QDir target(root.filePath("target"));
+        QDir staging(root.filePath("staging"));
+
+        QVERIFY(createFile(target, "keep.txt", "keep"));
+        QVERIFY(createFile(target, "a.txt.bak", "old a"));
+        QVERIFY(createFile(target, "b.txt.bak", "old b"));
+        QVERIFY(createFile(target, "a.txt", "new a"));
+        QVERIFY(createFile(target, "sub/added.txt", "added"));
+        QVERIFY(createFile(staging, "b.txt", "new b"));
+
+        ApplyJournal journal(Durability::None);
+        QVERIFY(journal.begin(target, staging, {"a.txt", "b.txt"}, {"sub/added.txt"}));
+        journal.backupsDone();
+        journal.applied("a.txt");
+        journal.applied("sub/added.txt");
+        if(committed)
+            journal.commit();
+    }
+
+private slots:
+
+    // ---- recover ----
+
+    void recoverWithoutJournalDoesNothing()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir root(tempDir.path());
+        QVERIFY(root.mkpath("target"));
+
+        QCOMPARE(ApplyJournal::recover(QDir(root.filePath("target"))), ApplyJournal::Recovery::None);
+    }
+
+    void recoverRollsBackUncommittedApply()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir root(tempDir.path());
+        interruptedApply(root, false);
+
+        QDir target(root.filePath("target"));
+        QDir staging(root.filePath("staging"));
+        QCOMPARE(ApplyJournal::recover(target), ApplyJournal::Recovery::RolledBack);
+
+        QCOMPARE(readFileContent(target.filePath("a.txt")), QByteArray("old a"));
+        QCOMPARE(readFileContent(target.filePath("b.txt")), QByteArray("old b"));
+        QCOMPARE(readFileContent(target.filePath("keep.txt")), QByteArray("keep"));
+        QVERIFY(!QFile::exists(target.filePath("a.txt.bak")));
+        QVERIFY(!QFile::exists(target.filePath("b.txt.bak")));
+        QVERIFY(!QFile::exists(target.filePath("sub/added.txt")));
+
+        // Applied files are back in staging for the next run to resume.
+        QCOMPARE(readFileContent(staging.filePath("a.txt")), QByteArray("new a"));
+        QCOMPARE(readFileContent(staging.filePath("b.txt")), QByteArray("new b"));
+        QCOMPARE(readFileContent(staging.filePath("sub/added.txt")), QByteArray("added"));
+
+        QVERIFY(!QFile::exists(ApplyJournal::pathFor(target)));
+    }
+
+    void recoverCompletesCommittedApply()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir root(tempDir.path());
+        interruptedApply(root, true);
+
+        QDir target(root.filePath("target"));
+        QCOMPARE(ApplyJournal::recover(target), ApplyJournal::Recovery::RolledForward);
+
+        QCOMPARE(readFileContent(target.filePath("a.txt")), QByteArray("new a"));
+        QVERIFY(!QFile::exists(target.filePath("a.txt.bak")));
+        QVERIFY(!QFile::exists(target.filePath("b.txt.bak")));
+        QVERIFY(!QDir(root.filePath("staging")).exists());
+        QVERIFY(!QFile::exists(ApplyJournal::pathFor(target)));
+    }
+
+    void recoverIgnoresTornPlan()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir root(tempDir.path());
+        QDir target(root.filePath("target"));
+        QVERIFY(createFile(target, "a.txt", "current"));
+        QVERIFY(createFile(target, "a.txt.bak", "unrelated"));
+
+        QFile file(ApplyJournal::pathFor(target));
+        QVERIFY(file.open(QFile::WriteOnly));
+        file.write("target " + target.absolutePath().toUtf8() + "\nstaging /nowhere\nupdate a.t");
+        file.close();
+
+        QCOMPARE(ApplyJournal::recover(target), ApplyJournal::Recovery::None);
+        QCOMPARE(readFileContent(target.filePath("a.txt")), QByteArray("current"));
+        QVERIFY(QFile::exists(target.filePath("a.txt.bak")));
+        QVERIFY(!file.exists());
+    }
+
+    void beginKeepsJournalOfFailedRecovery()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir root(tempDir.path());
+        QDir target(root.filePath("target"));
+        QDir staging(root.filePath("staging"));
+
+        // a.txt cannot be moved aside: a directory is in its place.
+        QVERIFY(createFile(target, "a.txt/inside.txt", "blocker"));
+        QVERIFY(createFile(target, "a.txt.bak", "original a"));
+        QVERIFY(createFile(staging, "a.txt", "new a"));
+        {
+            ApplyJournal journal(Durability::None);
+            QVERIFY(journal.begin(target, staging, {"a.txt"}, {}));
+            journal.backupsDone();
+        }
+        QCOMPARE(ApplyJournal::recover(target), ApplyJournal::Recovery::Failed);
+        QByteArray kept = readFileContent(ApplyJournal::pathFor(target));
+        QVERIFY(!kept.isEmpty());
+
+        // The next update must neither replace nor delete it.
+        ApplyJournal second(Durability::None);
+        QVERIFY(!second.begin(target, QDir(root.filePath("staging2")), {"a.txt"}, {}));
+        second.finish();
+        QCOMPARE(readFileContent(ApplyJournal::pathFor(target)), kept);
+        QCOMPARE(readFileContent(target.filePath("a.txt.bak")), QByteArray("original a"));
+    }
+
+    // ---- in-process use ----
+
+    void finishRemovesJournal()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir root(tempDir.path());
+        QDir target(root.filePath("target"));
+        QVERIFY(root.mkpath("target"));
+
+        ApplyJournal journal;
+        QVERIFY(journal.begin(target, QDir(root.filePath("staging")), {}, {"x.txt"}));
+        QVERIFY(QFile::exists(ApplyJournal::pathFor(target)));
+        journal.commit();
+        journal.finish();
+        QVERIFY(!QFile::exists(ApplyJournal::pathFor(target)));
+    }
+
+    void rollBackWithoutBeginFails()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+
+        ApplyJournal journal;
+        QVERIFY(!journal.rollBack(QDir(tempDir.path())));
+    }
+};
+
+QTEST_GUILESS_MAIN(TestApplyJournal)
+#include "tst_applyjournal.moc"
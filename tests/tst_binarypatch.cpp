@@ -0,0 +1,235 @@
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QObject>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QTest>
+
+#include "binarypatch.h"
+
+static bool writeFile(const QString& path, const QByteArray& content)
+{
+    QFile file(path);
+    if(!file.open(QFile::WriteOnly))
+        return false;
+    file.write(content);
+    file.close();
+    return true;
+}
+
+static QByteArray readFileContent(const QString& path)
+{
+    QFile file(path);
+    if(!file.open(QFile::ReadOnly))
+        return {};
+    return file.readAll();
+}
+
+static QByteArray randomBytes(int size, quint32 seed)
+{
+    QRandomGenerator rng(seed);
+    QByteArray data(size, '\0');
+    for(int i = 0; i < size; ++i)
+        data[i] = static_cast<char>(rng.bounded(256));
+    return data;
+}
+
+class TestBinaryPatch : public QObject {
+    Q_OBJECT
+
+private:
+    bool roundTrip(const QByteArray& oldData, const QByteArray& newData, QByteArray* patchOut = nullptr)
+    {
+        QTemporaryDir tempDir;
+        if(!tempDir.isValid())
+            return false;
+        QDir dir(tempDir.path());
+
+        QByteArray patch = createBinaryPatch(oldData, newData);
+        if(patchOut)
+            *patchOut = patch;
+
+        if(!writeFile(dir.filePath("old.bin"), oldData) || !writeFile(dir.filePath("p.patch"), patch))
+            return false;
+        if(!applyBinaryPatch(dir.filePath("old.bin"), dir.filePath("p.patch"), dir.filePath("new.bin")))
+            return false;
+        return readFileContent(dir.filePath("new.bin")) == newData;
+    }
+
+private slots:
+
+    // ---- RollingChecksum ----
+
+    void rollingChecksumMatchesReset()
+    {
+        QByteArray data = randomBytes(4096, 1);
+        RollingChecksum rolled(64);
+        rolled.reset(data.constData());
+        for(int pos = 1; pos + 64 <= data.size(); ++pos)
+        {
+            rolled.roll(static_cast<uchar>(data[pos - 1]), static_cast<uchar>(data[pos + 63]));
+            RollingChecksum fresh(64);
+            fresh.reset(data.constData() + pos);
+            QCOMPARE(rolled.value(), fresh.value());
+        }
+    }
+
+    // ---- createBinaryPatch / applyBinaryPatch ----
+
+    void patchIdenticalData()
+    {
+        QByteArray data = randomBytes(100000, 2);
+        QByteArray patch;
+        QVERIFY(roundTrip(data, data, &patch));
+        QVERIFY(patch.size() < 100);
+    }
+
+    void patchSmallEdits()
+    {
+        QByteArray oldData = randomBytes(200000, 3);
+        QByteArray newData = oldData;
+        newData.insert(5000, QByteArray(300, 'x'));
+        newData.remove(90000, 1000);
+        newData[150000] = static_cast<char>(newData[150000] ^ 0x55);
+
+        QByteArray patch;
+        QVERIFY(roundTrip(oldData, newData, &patch));
+        QVERIFY2(patch.size() < newData.size() / 10, "Patch for a few small edits should be tiny");
+    }
+
+    void patchUnrelatedData()
+    {
+        QVERIFY(roundTrip(randomBytes(50000, 4), randomBytes(60000, 5)));
+    }
+
+    void patchEmptyInputs()
+    {
+        QVERIFY(roundTrip({}, {}));
+        QVERIFY(roundTrip({}, "new content"));
+        QVERIFY(roundTrip("old content", {}));
+    }
+
+    void applyRejectsGarbagePatch()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir dir(tempDir.path());
+
+        QVERIFY(writeFile(dir.filePath("old.bin"), "base"));
+        QVERIFY(writeFile(dir.filePath("p.patch"), "not a patch at all"));
+        QVERIFY(!applyBinaryPatch(dir.filePath("old.bin"), dir.filePath("p.patch"), dir.filePath("new.bin")));
+        QVERIFY(!QFile::exists(dir.filePath("new.bin")));
+    }
+
+    void applyRejectsWrongBase()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir dir(tempDir.path());
+
+        QByteArray oldData = randomBytes(100000, 6);
+        QByteArray newData = oldData;
+        newData.append("tail");
+
+        QVERIFY(writeFile(dir.filePath("p.patch"), createBinaryPatch(oldData, newData)));
+        QVERIFY(writeFile(dir.filePath("short.bin"), oldData.left(1000)));
+        QVERIFY(!applyBinaryPatch(dir.filePath("short.bin"), dir.filePath("p.patch"), dir.filePath("new.bin")));
+        QVERIFY(!QFile::exists(dir.filePath("new.bin")));
+    }
+
+    void applyRejectsOpsLongerThanResult()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir dir(tempDir.path());
+        QVERIFY(writeFile(dir.filePath("old.bin"), QByteArray(4096, 'b')));
+
+        // Header as written by createBinaryPatch: magic "SUPT", format 1, result size 10.
+        auto patchWith = [](auto writeOp) {
+            QByteArray patch;
+            QDataStream out(&patch, QIODevice::WriteOnly);
+            out << quint32(0x53555054) << quint32(1) << quint64(10);
+            writeOp(out);
+            out << quint8(0xff);
+            return patch;
+        };
+
+        // An INSERT claiming 4 GB must fail before anything is allocated or written.
+        QVERIFY(writeFile(dir.filePath("insert.patch"), patchWith([](QDataStream& out) {
+            out << quint8(1) << quint32(0xffffffff);
+        })));
+        QVERIFY(!applyBinaryPatch(dir.filePath("old.bin"), dir.filePath("insert.patch"), dir.filePath("new.bin")));
+        QVERIFY(!QFile::exists(dir.filePath("new.bin")));
+
+        QVERIFY(writeFile(dir.filePath("copy.patch"), patchWith([](QDataStream& out) {
+            out << quint8(0) << quint64(0) << quint32(4096);
+        })));
+        QVERIFY(!applyBinaryPatch(dir.filePath("old.bin"), dir.filePath("copy.patch"), dir.filePath("new.bin")));
+        QVERIFY(!QFile::exists(dir.filePath("new.bin")));
+
+        // The offset must not wrap around when the length is added.
+        QVERIFY(writeFile(dir.filePath("wrap.patch"), patchWith([](QDataStream& out) {
+            out << quint8(0) << quint64(0xfffffffffffffffcULL) << quint32(8);
+        })));
+        QVERIFY(!applyBinaryPatch(dir.filePath("old.bin"), dir.filePath("wrap.patch"), dir.filePath("new.bin")));
+    }
+
+    // ---- computeBlockChecksums / matchBlocks ----
+
+    void blockChecksumsCoverWholeFile()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QString path = QDir(tempDir.path()).filePath("data.bin");
+        QVERIFY(writeFile(path, randomBytes(10000, 7)));
+
+        auto sums = computeBlockChecksums(path, 4096);
+        QVERIFY(sums.has_value());
+        QCOMPARE(sums->fileSize, qint64(10000));
+        QCOMPARE(sums->blockCount(), 3);
+    }
+
+    void matchBlocksFindsShiftedBlocks()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir dir(tempDir.path());
+
+        const int blockSize = 4096;
+        QByteArray remote = randomBytes(blockSize * 8, 8);
+        QByteArray local = remote;
+        local.insert(0, QByteArray(100, 'p'));              // shift everything
+        local.replace(100 + blockSize * 3 + 10, 4, "XXXX"); // damage block 3
+
+        QVERIFY(writeFile(dir.filePath("remote.bin"), remote));
+        QVERIFY(writeFile(dir.filePath("local.bin"), local));
+
+        auto sums = computeBlockChecksums(dir.filePath("remote.bin"), blockSize);
+        QVERIFY(sums.has_value());
+
+        QList<qint64> matches = matchBlocks(sums.value(), dir.filePath("local.bin"));
+        QCOMPARE(matches.size(), 8);
+        for(int block = 0; block < 8; ++block)
+        {
+            if(block == 3)
+                QCOMPARE(matches[block], qint64(-1));
+            else
+                QCOMPARE(matches[block], qint64(100 + block * blockSize));
+        }
+    }
+
+    void matchBlocksMissingLocalFile()
+    {
+        BlockChecksums sums;
+        sums.blockSize = 4096;
+        sums.fileSize = 8192;
+        sums.sums = QByteArray(2 * BlockChecksums::kSumSize, '\0');
+
+        QList<qint64> matches = matchBlocks(sums, "/nonexistent/path/file.bin");
+        QCOMPARE(matches, (QList<qint64>{-1, -1}));
+    }
+};
+
+QTEST_GUILESS_MAIN(TestBinaryPatch)
+#include "tst_binarypatch.moc"
@@ -0,0 +1,189 @@
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QObject>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QTest>
+
+#include "bundle.h"
+#include "manifest.h"
+
+static bool writeFile(const QString& path, const QByteArray& content)
+{
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QFile file(path);
+    if(!file.open(QFile::WriteOnly))
+        return false;
+    file.write(content);
+    return true;
+}
+
+static QByteArray readFileContent(const QString& path)
+{
+    QFile file(path);
+    if(!file.open(QFile::ReadOnly))
+        return {};
+    return file.readAll();
+}
+
+static QByteArray sha256(const QByteArray& data)
+{
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha256);
+}
+
+// Writes the files into releaseDir along with a stand-in manifest.json, and returns
+// the matching manifest.
+static Manifest makeRelease(const QDir& releaseDir, const QHash<QString, QByteArray>& files)
+{
+    Manifest manifest;
+    manifest.version = QVersionNumber(1, 2, 3);
+    for(auto it = files.constBegin(); it != files.constEnd(); ++it)
+    {
+        writeFile(releaseDir.filePath(it.key()), it.value());
+        manifest.files.insert(it.key(), sha256(it.value()));
+    }
+    writeFile(releaseDir.filePath("manifest.json"), "{\"version\": \"1.2.3\"}");
+    return manifest;
+}
+
+class TestBundle : public QObject {
+    Q_OBJECT
+
+private slots:
+
+    // ---- generateBundle ----
+
+    void generateAndExtract()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir root(tempDir.path());
+        QDir releaseDir(root.filePath("release"));
+        QByteArray big;
+        for(int i = 0; i < 100000; ++i)
+            big += QByteArray::number(i) + ' ';
+        Manifest manifest = makeRelease(releaseDir, {{"a.txt", "aaa"}, {"lib/big.txt", big},
+                                                     {"empty.txt", {}}});
+
+        QString bundlePath = generateBundle(releaseDir, manifest);
+        QCOMPARE(bundlePath, root.filePath("release_1.2.3.subundle"));
+        QVERIFY(!QFile::exists(bundlePath + ".tmp"));
+
+        Bundle bundle;
+        QVERIFY2(bundle.open(bundlePath), qPrintable(bundle.errorString()));
+        QCOMPARE(bundle.manifestJson(), readFileContent(releaseDir.filePath("manifest.json")));
+        QCOMPARE(bundle.entries().size(), 3);
+        // Sorted by path, so the files of one directory are adjacent.
+        QCOMPARE(bundle.entries()[0].name, QString("a.txt"));
+        QCOMPARE(bundle.entries()[2].name, QString("lib/big.txt"));
+        QVERIFY(bundle.entry("lib/big.txt")->compressedSize < big.size());
+        QVERIFY(!bundle.entry("manifest.json"));
+
+        for(const auto& entry : bundle.entries())
+        {
+            QString outPath = root.filePath("out_" + QFileInfo(entry.name).fileName());
+            QByteArray hash;
+            QString error;
+            QVERIFY2(bundle.extract(entry, outPath, &hash, &error), qPrintable(error));
+            QCOMPARE(hash, manifest.files.value(entry.name));
+            QCOMPARE(sha256(readFileContent(outPath)), hash);
+        }
+    }
+
+    void generateStoresIncompressibleData()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir releaseDir(QDir(tempDir.path()).filePath("release"));
+        QByteArray noise(64 * 1024, '\0');
+        QRandomGenerator generator(42);
+        for(auto& byte : noise)
+            byte = char(generator.bounded(256));
+        Manifest manifest = makeRelease(releaseDir, {{"noise.bin", noise}});
+
+        QString bundlePath = generateBundle(releaseDir, manifest);
+        Bundle bundle;
+        QVERIFY(bundle.open(bundlePath));
+        const Bundle::Entry* entry = bundle.entry("noise.bin");
+        QVERIFY(entry);
+        QCOMPARE(entry->method, quint16(DeflateBlob::kStored));
+        QCOMPARE(entry->compressedSize, qint64(noise.size()));
+        // The failed deflate attempt is cut off again.
+        QCOMPARE(QFileInfo(bundlePath).size(), entry->offset + entry->compressedSize);
+
+        QByteArray hash;
+        QVERIFY(bundle.extract(*entry, QDir(tempDir.path()).filePath("noise.bin"), &hash));
+        QCOMPARE(hash, sha256(noise));
+    }
+
+    // ---- open ----
+
+    void openWithOnlyIndexPresent()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir root(tempDir.path());
+        QDir releaseDir(root.filePath("release"));
+        Manifest manifest = makeRelease(releaseDir, {{"a.txt", "aaa"}, {"b.txt", "bbb"}});
+        QString bundlePath = generateBundle(releaseDir, manifest);
+
+        // As left by a range download that has fetched header, manifest and index only.
+        QByteArray full = readFileContent(bundlePath);
+        auto header = Bundle::parseHeader(full);
+        QVERIFY(header);
+        QByteArray partial = full.left(header->dataOffset);
+        partial.resize(full.size(), '\0');
+        QString partialPath = root.filePath("partial.subundle");
+        QVERIFY(writeFile(partialPath, partial));
+
+        Bundle bundle;
+        QVERIFY2(bundle.open(partialPath), qPrintable(bundle.errorString()));
+        QCOMPARE(bundle.entries().size(), 2);
+        QCOMPARE(bundle.entry("b.txt")->size, qint64(3));
+    }
+
+    void openRejectsTruncatedBundle()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir root(tempDir.path());
+        QDir releaseDir(root.filePath("release"));
+        Manifest manifest = makeRelease(releaseDir, {{"a.txt", "aaa"}});
+        QByteArray full = readFileContent(generateBundle(releaseDir, manifest));
+        QString truncatedPath = root.filePath("truncated.subundle");
+        QVERIFY(writeFile(truncatedPath, full.left(full.size() - 1)));
+
+        Bundle bundle;
+        QVERIFY(!bundle.open(truncatedPath));
+        QVERIFY(!bundle.errorString().isEmpty());
+    }
+
+    void parseHeaderRejectsOtherFiles()
+    {
+        QVERIFY(!Bundle::parseHeader(QByteArray(Bundle::kHeaderSize, 'x')));
+        QVERIFY(!Bundle::parseHeader("SUBUNDLE"));
+    }
+
+#ifdef Q_OS_UNIX
+    void extractRestoresExecutableBit()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir root(tempDir.path());
+        QDir releaseDir(root.filePath("release"));
+        Manifest manifest = makeRelease(releaseDir, {{"run.sh", "#!/bin/sh\n"}});
+        QFile::setPermissions(releaseDir.filePath("run.sh"),
+                              QFile::permissions(releaseDir.filePath("run.sh")) | QFile::ExeOwner);
+
+        Bundle bundle;
+        QVERIFY(bundle.open(generateBundle(releaseDir, manifest)));
+        QVERIFY(bundle.extract(*bundle.entry("run.sh"), root.filePath("run.sh")));
+        QVERIFY(QFileInfo(root.filePath("run.sh")).isExecutable());
+    }
+#endif
+};
+
+QTEST_GUILESS_MAIN(TestBundle)
+#include "tst_bundle.moc"
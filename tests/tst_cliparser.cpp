@@ -329,6 +329,123 @@ private slots:
         QCOMPARE(result->update->continueUpdate, true);
     }
 
+    void updateWithLockWait()
+    {
+        QTemporaryDir srcDir, tgtDir;
+        QVERIFY(srcDir.isValid());
+        QVERIFY(tgtDir.isValid());
+
+        auto result = parseCli({"SimpleUpdater", "update",
+                                "--source", srcDir.path(),
+                                "--target", tgtDir.path(),
+                                "--lock-wait", "30"});
+        QVERIFY(result.has_value());
+        QVERIFY(result->update.has_value());
+        QCOMPARE(result->update->lockWaitSeconds, 30);
+    }
+
+    void updateLockWaitDefaultsToPrompt()
+    {
+        QTemporaryDir srcDir, tgtDir;
+        QVERIFY(srcDir.isValid());
+        QVERIFY(tgtDir.isValid());
+
+        auto result = parseCli({"SimpleUpdater", "update",
+                                "--source", srcDir.path(),
+                                "--target", tgtDir.path()});
+        QVERIFY(result.has_value());
+        QCOMPARE(result->update->lockWaitSeconds, 0);
+    }
+
+    void updateRejectsInvalidLockWait()
+    {
+        QTemporaryDir srcDir, tgtDir;
+        QVERIFY(srcDir.isValid());
+        QVERIFY(tgtDir.isValid());
+
+        auto result = parseCli({"SimpleUpdater", "update",
+                                "--source", srcDir.path(),
+                                "--target", tgtDir.path(),
+                                "--lock-wait", "soon"});
+        QVERIFY(!result.has_value());
+    }
+
+    void updateWithSweepEmptyDirs()
+    {
+        QTemporaryDir srcDir, tgtDir;
+        QVERIFY(srcDir.isValid());
+        QVERIFY(tgtDir.isValid());
+
+        auto result = parseCli({"SimpleUpdater", "update",
+                                "--source", srcDir.path(),
+                                "--target", tgtDir.path(),
+                                "--sweep-empty-dirs"});
+        QVERIFY(result.has_value());
+        QCOMPARE(result->update->sweepEmptyDirs, true);
+    }
+
+    void updateWithSwapApply()
+    {
+        QTemporaryDir srcDir, tgtDir;
+        QVERIFY(srcDir.isValid());
+        QVERIFY(tgtDir.isValid());
+
+        auto result = parseCli({"SimpleUpdater", "update",
+                                "--source", srcDir.path(),
+                                "--target", tgtDir.path(),
+                                "--swap-apply"});
+        QVERIFY(result.has_value());
+        QCOMPARE(result->update->swapApply, true);
+    }
+
+    void updateWithSlots()
+    {
+        QTemporaryDir srcDir, tgtDir;
+        QVERIFY(srcDir.isValid());
+        QVERIFY(tgtDir.isValid());
+
+        auto result = parseCli({"SimpleUpdater", "update",
+                                "--source", srcDir.path(),
+                                "--target", tgtDir.path(),
+                                "--slots"});
+        QVERIFY(result.has_value());
+        QCOMPARE(result->update->slotLayout, true);
+        QCOMPARE(result->update->swapApply, false);
+    }
+
+    void updateWithDurability()
+    {
+        QTemporaryDir srcDir, tgtDir;
+        QVERIFY(srcDir.isValid());
+        QVERIFY(tgtDir.isValid());
+
+        auto result = parseCli({"SimpleUpdater", "update",
+                                "--source", srcDir.path(),
+                                "--target", tgtDir.path()});
+        QVERIFY(result.has_value());
+        QCOMPARE(result->update->durability, Durability::Batch);
+
+        result = parseCli({"SimpleUpdater", "update",
+                           "--source", srcDir.path(),
+                           "--target", tgtDir.path(),
+                           "--durability", "strict"});
+        QVERIFY(result.has_value());
+        QCOMPARE(result->update->durability, Durability::Strict);
+    }
+
+    void updateRejectsInvalidDurability()
+    {
+        QTemporaryDir srcDir, tgtDir;
+        QVERIFY(srcDir.isValid());
+        QVERIFY(tgtDir.isValid());
+
+        auto result = parseCli({"SimpleUpdater", "update",
+                                "--source", srcDir.path(),
+                                "--target", tgtDir.path(),
+                                "--durability", "paranoid"});
+        QVERIFY(!result.has_value());
+    }
+
     void updateWithUrlSource()
     {
         auto result = parseCli({"SimpleUpdater", "update",
@@ -339,6 +456,33 @@ private slots:
         QCOMPARE(result->update->source, QString("https://releases.example.com/v2.0.zip"));
     }
 
+    void updateWithBundleSource()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QString bundlePath = QDir(tempDir.path()).filePath("release_2.0.subundle");
+        QFile bundle(bundlePath);
+        QVERIFY(bundle.open(QFile::WriteOnly));
+        bundle.close();
+
+        auto result = parseCli({"SimpleUpdater", "update",
+                                "--source", bundlePath,
+                                "--target", tempDir.path()});
+        QVERIFY2(result.has_value(), "A bundle file is accepted as source");
+        QCOMPARE(result->update->source, bundlePath);
+    }
+
+    void updateMissingBundleErrors()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+
+        auto result = parseCli({"SimpleUpdater", "update",
+                                "--source", QDir(tempDir.path()).filePath("missing.subundle"),
+                                "--target", tempDir.path()});
+        QVERIFY(!result.has_value());
+    }
+
     void updateShortFlags()
     {
         QTemporaryDir srcDir, tgtDir;
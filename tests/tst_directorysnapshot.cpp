@@ -0,0 +1,235 @@
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QObject>
+#include <QScopeGuard>
+#include <QTemporaryDir>
+#include <QTest>
+
+#include "directorysnapshot.h"
+#include "platform/platform.h"
+
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+
+static bool createFile(const QDir& dir, const QString& relPath, const QByteArray& content)
+{
+    QString fullPath = dir.filePath(relPath);
+    QDir().mkpath(QFileInfo(fullPath).absolutePath());
+    QFile file(fullPath);
+    if(!file.open(QFile::WriteOnly))
+        return false;
+    file.write(content);
+    file.close();
+    return true;
+}
+
+class TestDirectorySnapshot : public QObject {
+    Q_OBJECT
+
+private slots:
+
+    // ---- scan ----
+
+    void scanListsFilesAndDirectories()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir dir(tempDir.path());
+
+        QVERIFY(createFile(dir, "a.txt", "aaa"));
+        QVERIFY(createFile(dir, "sub/deep/b.txt", "bbbbb"));
+        QVERIFY(dir.mkpath("empty"));
+
+        auto snapshot = DirectorySnapshot::scan(dir);
+        QStringList files = snapshot.files();
+        files.sort();
+        QCOMPARE(files, (QStringList{"a.txt", "sub/deep/b.txt"}));
+
+        QStringList dirs = snapshot.directories();
+        dirs.sort();
+        QCOMPARE(dirs, (QStringList{"empty", "sub", "sub/deep"}));
+
+        QCOMPARE(snapshot.entry("sub/deep/b.txt")->size, qint64(5));
+        QVERIFY(snapshot.isEmptyDirectory("empty"));
+        QVERIFY(!snapshot.isEmptyDirectory("sub"));
+    }
+
+    void scanIncludesHiddenFiles()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir dir(tempDir.path());
+
+        QVERIFY(createFile(dir, ".hidden", "h"));
+
+        auto snapshot = DirectorySnapshot::scan(dir);
+        QVERIFY(snapshot.contains(".hidden"));
+    }
+
+    void scanMissingDirectoryIsEmpty()
+    {
+        auto snapshot = DirectorySnapshot::scan(QDir("/nonexistent/path/for/snapshot"));
+        QCOMPARE(snapshot.size(), 0);
+    }
+
+    void scanClassifiesSymlinks()
+    {
+#ifdef Q_OS_WIN
+        QSKIP("Symlink creation needs extra privileges on Windows");
+#endif
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir dir(tempDir.path());
+
+        QVERIFY(createFile(dir, "real/file.txt", "content"));
+        QVERIFY(QFile::link(dir.filePath("real/file.txt"), dir.filePath("file_link")));
+        QVERIFY(QFile::link(dir.filePath("real"), dir.filePath("dir_link")));
+
+        auto snapshot = DirectorySnapshot::scan(dir);
+        QCOMPARE(snapshot.entry("file_link")->type, DirectoryEntry::Symlink);
+        QCOMPARE(snapshot.entry("dir_link")->type, DirectoryEntry::Other);
+        QVERIFY(!snapshot.contains("dir_link/file.txt"));
+        QCOMPARE(snapshot.entry("real/file.txt")->type, DirectoryEntry::File);
+    }
+
+#ifdef Q_OS_LINUX
+    void scanReportsUnreadableDirectory()
+    {
+        if(geteuid() == 0)
+            QSKIP("Running as root, every directory is readable");
+
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir dir(tempDir.path());
+        QVERIFY(createFile(dir, "a.txt", "a"));
+        QVERIFY(createFile(dir, "locked/hidden.txt", "h"));
+        QVERIFY(QFile::setPermissions(dir.filePath("locked"), QFileDevice::Permissions()));
+        auto restore = qScopeGuard([&dir]() {
+            QFile::setPermissions(dir.filePath("locked"),
+                                  QFileDevice::ReadOwner | QFileDevice::WriteOwner | QFileDevice::ExeOwner);
+        });
+
+        // The native scanner gives up rather than return a partial listing.
+        QVERIFY(!Platform::scanDirectoryTree(dir.absolutePath(), [](const QString&, const DirectoryEntry&) {}));
+
+        auto snapshot = DirectorySnapshot::scan(dir);
+        QVERIFY(!snapshot.isComplete());
+        QVERIFY(snapshot.contains("a.txt"));
+        QVERIFY(snapshot.contains("locked"));
+        QVERIFY(!snapshot.contains("locked/hidden.txt"));
+    }
+#endif
+
+    void scanOfReadableTreeIsComplete()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir dir(tempDir.path());
+        QVERIFY(createFile(dir, "sub/a.txt", "a"));
+
+        QVERIFY(DirectorySnapshot::scan(dir).isComplete());
+    }
+
+    // ---- incremental updates ----
+
+    void insertAddsParentDirectories()
+    {
+        DirectorySnapshot snapshot;
+        DirectoryEntry file;
+        file.type = DirectoryEntry::File;
+        snapshot.insert("x/y/z.bin", file);
+
+        QVERIFY(snapshot.contains("x"));
+        QVERIFY(snapshot.contains("x/y"));
+        QCOMPARE(snapshot.entry("x/y")->type, DirectoryEntry::Directory);
+        QVERIFY(!snapshot.isEmptyDirectory("x/y"));
+    }
+
+    void removeLastChildLeavesDirectoryEmpty()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir dir(tempDir.path());
+
+        QVERIFY(createFile(dir, "sub/one.txt", "1"));
+        QVERIFY(createFile(dir, "sub/two.txt", "2"));
+
+        auto snapshot = DirectorySnapshot::scan(dir);
+        snapshot.remove("sub/one.txt");
+        QVERIFY(!snapshot.isEmptyDirectory("sub"));
+        snapshot.remove("sub/two.txt");
+        QVERIFY(snapshot.isEmptyDirectory("sub"));
+    }
+
+    void removeDirectoryDropsEverythingBelow()
+    {
+        DirectorySnapshot snapshot;
+        DirectoryEntry file;
+        file.type = DirectoryEntry::File;
+        snapshot.insert("top/mid/leaf.txt", file);
+        snapshot.insert("top/other.txt", file);
+
+        snapshot.remove("top/mid");
+        QVERIFY(!snapshot.contains("top/mid"));
+        QVERIFY(!snapshot.contains("top/mid/leaf.txt"));
+        QVERIFY(snapshot.contains("top/other.txt"));
+        QCOMPARE(snapshot.size(), 2);
+    }
+
+    void removeEmptiedDirectoryBottomUp()
+    {
+        DirectorySnapshot snapshot;
+        DirectoryEntry file;
+        file.type = DirectoryEntry::File;
+        snapshot.insert("a/b/c.txt", file);
+        snapshot.insert("keep.txt", file);
+
+        // As the sweep does it: the file, then each directory once it is empty.
+        snapshot.remove("a/b/c.txt");
+        QVERIFY(snapshot.isEmptyDirectory("a/b"));
+        snapshot.remove("a/b");
+        QVERIFY(snapshot.isEmptyDirectory("a"));
+        snapshot.remove("a");
+        QCOMPARE(snapshot.size(), 1);
+        QVERIFY(snapshot.contains("keep.txt"));
+
+        // Counts restart from zero when the path is used again.
+        snapshot.insert("a/b/new.txt", file);
+        QVERIFY(!snapshot.isEmptyDirectory("a/b"));
+        snapshot.remove("a/b/new.txt");
+        QVERIFY(snapshot.isEmptyDirectory("a/b"));
+    }
+
+    void renameMovesEntry()
+    {
+        DirectorySnapshot snapshot;
+        DirectoryEntry file;
+        file.type = DirectoryEntry::File;
+        file.size = 42;
+        snapshot.insert("old/name.txt", file);
+
+        snapshot.rename("old/name.txt", "new/name.txt");
+        QVERIFY(!snapshot.contains("old/name.txt"));
+        QVERIFY(snapshot.isEmptyDirectory("old"));
+        QCOMPARE(snapshot.entry("new/name.txt")->size, qint64(42));
+    }
+
+    void insertFileReadsSizeFromDisk()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir dir(tempDir.path());
+
+        auto snapshot = DirectorySnapshot::scan(dir);
+        QVERIFY(createFile(dir, "added/new.bin", "0123456789"));
+        snapshot.insertFile("added/new.bin");
+
+        QCOMPARE(snapshot.entry("added/new.bin")->size, qint64(10));
+        QVERIFY(snapshot.directories().contains("added"));
+    }
+};
+
+QTEST_GUILESS_MAIN(TestDirectorySnapshot)
+#include "tst_directorysnapshot.moc"
@@ -1,5 +1,6 @@
 #include <QCryptographicHash>
 #include <QDir>
+#include <QElapsedTimer>
 #include <QFile>
 #include <QFileInfo>
 #include <QObject>
@@ -7,6 +8,7 @@
 #include <QTemporaryDir>
 #include <QTest>
 
+#include "binarypatch.h"
 #include "filehandler.h"
 #include "platform/platform.h"
 
@@ -16,6 +18,10 @@
 
 #ifdef Q_OS_LINUX
 #include <cerrno>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #endif
 
@@ -193,6 +199,87 @@ private slots:
         QVERIFY(diff.unchanged.isEmpty());
     }
 
+    void computeDiffDetectsMovedFile()
+    {
+        QHash<QString, QByteArray> source;
+        source.insert("new/name.dll", "hash_lib");
+        source.insert("a.txt", "hash_a");
+
+        QHash<QString, QByteArray> target;
+        target.insert("old/name.dll", "hash_lib");
+        target.insert("a.txt", "hash_a");
+
+        FileDiff diff = FileHandler::computeDiff(source, target);
+        QCOMPARE(diff.toAdd, QStringList{"new/name.dll"});
+        QCOMPARE(diff.toRemove, QStringList{"old/name.dll"});
+        QCOMPARE(diff.moved.value("new/name.dll"), QString("old/name.dll"));
+        QVERIFY(diff.reused.isEmpty());
+    }
+
+    void computeDiffDetectsReusedContent()
+    {
+        QHash<QString, QByteArray> source;
+        source.insert("a.txt", "hash_a");
+        source.insert("copy_of_a.txt", "hash_a");
+        source.insert("b.txt", "hash_b");
+
+        QHash<QString, QByteArray> target;
+        target.insert("a.txt", "hash_a");
+
+        FileDiff diff = FileHandler::computeDiff(source, target);
+        QCOMPARE(diff.toAdd.size(), 2);
+        QVERIFY(diff.moved.isEmpty());
+        QCOMPARE(diff.reused.size(), 1);
+        QCOMPARE(diff.reused.value("copy_of_a.txt"), QString("a.txt"));
+    }
+
+    void computeDiffPrefersRemovedPathForMove()
+    {
+        QHash<QString, QByteArray> source;
+        source.insert("kept.txt", "hash_x");
+        source.insert("moved.txt", "hash_x");
+
+        QHash<QString, QByteArray> target;
+        target.insert("kept.txt", "hash_x");
+        target.insert("gone.txt", "hash_x");
+
+        FileDiff diff = FileHandler::computeDiff(source, target);
+        QCOMPARE(diff.moved.value("moved.txt"), QString("gone.txt"));
+        QVERIFY(diff.reused.isEmpty());
+    }
+
+    void computeDiffListsUnhashedFilesAsStale()
+    {
+        QHash<QString, QByteArray> source;
+        source.insert("a.txt", "hash_a");
+        source.insert("locked_but_kept.dll", "hash_l");
+
+        QHash<QString, QByteArray> target;
+        target.insert("a.txt", "hash_a");
+        target.insert("old.txt", "hash_old");
+
+        DirectorySnapshot snapshot;
+        DirectoryEntry file;
+        file.type = DirectoryEntry::File;
+        for(const char* path : {"a.txt", "old.txt", "locked_but_kept.dll", "locked_obsolete.dll",
+                                "lib/link.so", "config.ini.bak"})
+            snapshot.insert(path, file);
+
+        FileDiff diff = FileHandler::computeDiff(source, target, &snapshot);
+        QCOMPARE(diff.toRemove, QStringList{"old.txt"});
+        diff.stale.sort();
+        QCOMPARE(diff.stale, (QStringList{"lib/link.so", "locked_obsolete.dll"}));
+    }
+
+    void computeDiffWithoutSnapshotHasNoStale()
+    {
+        QHash<QString, QByteArray> target;
+        target.insert("old.txt", "hash_old");
+
+        FileDiff diff = FileHandler::computeDiff({}, target);
+        QVERIFY(diff.stale.isEmpty());
+    }
+
     // ---- copyFiles ----
 
     void copyFilesBasic()
@@ -399,6 +486,219 @@ private slots:
         QCOMPARE(readFileContent(tgt.filePath("a.txt")), QByteArray("aaa"));
     }
 
+    // ---- moveFiles ----
+
+    void moveFilesRenamesOutOfSource()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir root(tempDir.path());
+        QDir src(root.filePath("extracted")), tgt(root.filePath("staging"));
+
+        QVERIFY(createFile(src, "a.txt", "aaa"));
+        QVERIFY(createFile(src, "sub/b.txt", "bbb"));
+        QVERIFY(createFile(src, "unchanged.txt", "keep"));
+        QVERIFY(createFile(tgt, "a.txt", "stale"));
+
+        FileHandler handler;
+        QVERIFY(handler.moveFiles(src, tgt, {"a.txt", "sub/b.txt"}));
+
+        QCOMPARE(readFileContent(tgt.filePath("a.txt")), QByteArray("aaa"));
+        QCOMPARE(readFileContent(tgt.filePath("sub/b.txt")), QByteArray("bbb"));
+        QVERIFY(!QFile::exists(src.filePath("a.txt")));
+        QVERIFY(!QFile::exists(src.filePath("sub/b.txt")));
+        QVERIFY(QFile::exists(src.filePath("unchanged.txt")));
+    }
+
+    void moveFilesFailsForMissingSource()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir root(tempDir.path());
+
+        FileHandler handler;
+        QVERIFY(!handler.moveFiles(QDir(root.filePath("extracted")), QDir(root.filePath("staging")),
+                                   {"missing.txt"}));
+    }
+
+    // ---- dedupFiles ----
+
+    void dedupFilesMaterializesDuplicates()
+    {
+        QTemporaryDir stagingTemp;
+        QVERIFY(stagingTemp.isValid());
+        QDir staging(stagingTemp.path());
+
+        QVERIFY(createFile(staging, "plugins/a/runtime.dll", "runtime"));
+
+        FileHandler handler;
+        QSignalSpy spy(&handler, &FileHandler::progressUpdated);
+        QStringList failed = handler.dedupFiles(staging, {{"plugins/b/runtime.dll", "plugins/a/runtime.dll"},
+                                                          {"plugins/c/runtime.dll", "plugins/a/runtime.dll"}});
+        QVERIFY(failed.isEmpty());
+        QCOMPARE(readFileContent(staging.filePath("plugins/b/runtime.dll")), QByteArray("runtime"));
+        QCOMPARE(readFileContent(staging.filePath("plugins/c/runtime.dll")), QByteArray("runtime"));
+        QCOMPARE(spy.count(), 2);
+        QVERIFY(spy.at(0).at(0).toString().contains("DEDUP"));
+
+        // Never hardlinks: writing one path in place must leave the others alone.
+        QFile b(staging.filePath("plugins/b/runtime.dll"));
+        QVERIFY(b.open(QFile::ReadWrite));
+        b.write("changed");
+        b.close();
+        QCOMPARE(readFileContent(staging.filePath("plugins/a/runtime.dll")), QByteArray("runtime"));
+        QCOMPARE(readFileContent(staging.filePath("plugins/c/runtime.dll")), QByteArray("runtime"));
+    }
+
+    void dedupFilesReportsMissingOriginal()
+    {
+        QTemporaryDir stagingTemp;
+        QVERIFY(stagingTemp.isValid());
+        QDir staging(stagingTemp.path());
+
+        FileHandler handler;
+        QStringList failed = handler.dedupFiles(staging, {{"b.dll", "a.dll"}});
+        QCOMPARE(failed, QStringList{"b.dll"});
+        QVERIFY(!QFile::exists(staging.filePath("b.dll")));
+    }
+
+    // ---- linkFiles ----
+
+    void linkFilesBuildsTreeBesideExisting()
+    {
+        QTemporaryDir existingTemp, nextTemp;
+        QVERIFY(existingTemp.isValid());
+        QVERIFY(nextTemp.isValid());
+        QDir existing(existingTemp.path());
+        QDir next(nextTemp.path());
+
+        QVERIFY(createFile(existing, "app.exe", "binary"));
+        QVERIFY(createFile(existing, "data/config.ini", "config"));
+
+        FileHandler handler;
+        QSignalSpy spy(&handler, &FileHandler::progressUpdated);
+        QStringList failed = handler.linkFiles(existing, next, {"app.exe", "data/config.ini", "missing.txt"});
+        QCOMPARE(failed, QStringList{"missing.txt"});
+        QCOMPARE(readFileContent(next.filePath("app.exe")), QByteArray("binary"));
+        QCOMPARE(readFileContent(next.filePath("data/config.ini")), QByteArray("config"));
+        QCOMPARE(spy.count(), 0);
+    }
+
+    // ---- patchFiles ----
+
+    void patchFilesRebuildsFromBase()
+    {
+        QTemporaryDir baseTemp, sourceTemp, stagingTemp;
+        QVERIFY(baseTemp.isValid() && sourceTemp.isValid() && stagingTemp.isValid());
+        QDir base(baseTemp.path()), source(sourceTemp.path()), staging(stagingTemp.path());
+
+        QByteArray oldData(64 * 1024, 'a');
+        QByteArray newData = oldData;
+        newData.replace(1000, 5, "patch");
+
+        QVERIFY(createFile(base, "lib/core.dll", oldData));
+        QVERIFY(createFile(source, ".patches/lib/core.dll.patch", createBinaryPatch(oldData, newData)));
+
+        QHash<QString, QByteArray> expected;
+        expected.insert("lib/core.dll", QCryptographicHash::hash(newData, QCryptographicHash::Sha256));
+
+        FileHandler handler;
+        QStringList failed = handler.patchFiles(base, source, staging,
+                                                {{"lib/core.dll", ".patches/lib/core.dll.patch"}},
+                                                expected);
+        QVERIFY(failed.isEmpty());
+        QCOMPARE(readFileContent(staging.filePath("lib/core.dll")), newData);
+    }
+
+    void patchFilesReportsHashMismatchForFallback()
+    {
+        QTemporaryDir baseTemp, sourceTemp, stagingTemp;
+        QVERIFY(baseTemp.isValid() && sourceTemp.isValid() && stagingTemp.isValid());
+        QDir base(baseTemp.path()), source(sourceTemp.path()), staging(stagingTemp.path());
+
+        QByteArray oldData(64 * 1024, 'a');
+        QByteArray newData = oldData + "tail";
+
+        QVERIFY(createFile(base, "data.bin", oldData));
+        QVERIFY(createFile(source, "data.patch", createBinaryPatch(oldData, newData)));
+
+        QHash<QString, QByteArray> expected;
+        expected.insert("data.bin", QCryptographicHash::hash("something else", QCryptographicHash::Sha256));
+
+        FileHandler handler;
+        QStringList failed = handler.patchFiles(base, source, staging,
+                                                {{"data.bin", "data.patch"}}, expected);
+        QCOMPARE(failed, QStringList{"data.bin"});
+        QVERIFY(!QFile::exists(staging.filePath("data.bin")));
+    }
+
+    void patchFilesDoesNotResolveLocksForBadPatch()
+    {
+        QTemporaryDir baseTemp, sourceTemp, stagingTemp;
+        QVERIFY(baseTemp.isValid() && sourceTemp.isValid() && stagingTemp.isValid());
+        QDir base(baseTemp.path()), source(sourceTemp.path()), staging(stagingTemp.path());
+
+        QVERIFY(createFile(base, "data.bin", QByteArray(1024, 'a')));
+        QVERIFY(createFile(source, "data.patch", "not a patch"));
+
+        int resolverCalls = 0;
+        FileHandler handler;
+        handler.setLockResolver([&](const QString&) -> bool {
+            resolverCalls++;
+            return true;
+        });
+        QStringList failed = handler.patchFiles(base, source, staging, {{"data.bin", "data.patch"}}, {});
+        QCOMPARE(failed, QStringList{"data.bin"});
+        QCOMPARE(resolverCalls, 0);
+    }
+
+    // ---- reuseFiles ----
+
+    void reuseFilesLinksMovedFiles()
+    {
+        QTemporaryDir existingTemp, stagingTemp;
+        QVERIFY(existingTemp.isValid() && stagingTemp.isValid());
+        QDir existing(existingTemp.path()), staging(stagingTemp.path());
+
+        QVERIFY(createFile(existing, "old/lib.so", "library"));
+
+        FileHandler handler;
+        QSignalSpy spy(&handler, &FileHandler::progressUpdated);
+        QStringList failed = handler.reuseFiles(existing, staging, {{"new/lib.so", "old/lib.so"}}, true);
+        QVERIFY(failed.isEmpty());
+        QCOMPARE(readFileContent(staging.filePath("new/lib.so")), QByteArray("library"));
+        QCOMPARE(spy.count(), 1);
+        QVERIFY(spy.at(0).at(0).toString().contains("MOVE"));
+    }
+
+    void reuseFilesCopiesKeptFiles()
+    {
+        QTemporaryDir existingTemp, stagingTemp;
+        QVERIFY(existingTemp.isValid() && stagingTemp.isValid());
+        QDir existing(existingTemp.path()), staging(stagingTemp.path());
+
+        QVERIFY(createFile(existing, "a.txt", "shared"));
+
+        FileHandler handler;
+        QStringList failed = handler.reuseFiles(existing, staging, {{"b.txt", "a.txt"}}, false);
+        QVERIFY(failed.isEmpty());
+
+        // A copy must not share storage with the file that stays in place.
+        QVERIFY(createFile(staging, "b.txt", "changed"));
+        QCOMPARE(readFileContent(existing.filePath("a.txt")), QByteArray("shared"));
+    }
+
+    void reuseFilesReportsMissingSource()
+    {
+        QTemporaryDir existingTemp, stagingTemp;
+        QVERIFY(existingTemp.isValid() && stagingTemp.isValid());
+        QDir existing(existingTemp.path()), staging(stagingTemp.path());
+
+        FileHandler handler;
+        QStringList failed = handler.reuseFiles(existing, staging, {{"b.txt", "missing.txt"}}, true);
+        QCOMPARE(failed, QStringList{"b.txt"});
+    }
+
     // ---- removeFiles ----
 
     void removeFilesBasic()
@@ -799,6 +1099,75 @@ private slots:
         QVERIFY(!QDir(dir.filePath("remove_me")).exists());
     }
 
+    void removeEmptyDirectoriesFromSnapshot()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir dir(tempDir.path());
+
+        QVERIFY(createFile(dir, "keep/file.txt", "content"));
+        QVERIFY(createFile(dir, "gone/deep/removed.txt", "content"));
+
+        auto snapshot = DirectorySnapshot::scan(dir);
+        QVERIFY(QFile::remove(dir.filePath("gone/deep/removed.txt")));
+        snapshot.remove("gone/deep/removed.txt");
+
+        FileHandler handler;
+        handler.removeEmptyDirectories(snapshot);
+
+        QVERIFY(QDir(dir.filePath("keep")).exists());
+        QVERIFY(!QDir(dir.filePath("gone")).exists());
+        QVERIFY(!snapshot.contains("gone"));
+    }
+
+    void removeEmptyParentsWalksUpward()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir dir(tempDir.path());
+
+        QVERIFY(createFile(dir, "a/keep.txt", "content"));
+        QVERIFY(createFile(dir, "a/b/c/removed.txt", "content"));
+        QVERIFY(dir.mkpath("unrelated_empty"));
+        QVERIFY(QFile::remove(dir.filePath("a/b/c/removed.txt")));
+
+        FileHandler handler;
+        QStringList removed = handler.removeEmptyParents(dir, {"a/b/c/removed.txt"});
+        QCOMPARE(removed, (QStringList{"a/b/c", "a/b"}));
+        QVERIFY(QDir(dir.filePath("a")).exists());
+        QVERIFY(QDir(dir.filePath("unrelated_empty")).exists());
+    }
+
+    void removeEmptyParentsNeverRemovesRoot()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir dir(tempDir.path());
+
+        QVERIFY(createFile(dir, "only/file.txt", "content"));
+        QVERIFY(QFile::remove(dir.filePath("only/file.txt")));
+
+        FileHandler handler;
+        handler.removeEmptyParents(dir, {"only/file.txt", "top_level.txt"});
+        QVERIFY(!QDir(dir.filePath("only")).exists());
+        QVERIFY(dir.exists());
+    }
+
+    void removeEmptyDirectoriesStaleSnapshotKeepsNonEmpty()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir dir(tempDir.path());
+        QVERIFY(dir.mkpath("was_empty"));
+
+        auto snapshot = DirectorySnapshot::scan(dir);
+        QVERIFY(createFile(dir, "was_empty/late.txt", "written after the scan"));
+
+        FileHandler handler;
+        handler.removeEmptyDirectories(snapshot);
+        QVERIFY(QFile::exists(dir.filePath("was_empty/late.txt")));
+    }
+
 #ifdef Q_OS_WIN
 
     // ---- Windows file locking tests ----
@@ -1042,6 +1411,183 @@ private slots:
                               QFileDevice::ReadOwner | QFileDevice::WriteOwner | QFileDevice::ExeOwner);
     }
 
+    void lockSnapshotFindsOwnOpenFile()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir dir(tempDir.path());
+        QVERIFY(createFile(dir, "held.bin", "content"));
+        QVERIFY(createFile(dir, "free.bin", "content"));
+
+        QFile held(dir.filePath("held.bin"));
+        QVERIFY(held.open(QFile::ReadOnly));
+
+        auto snapshot = Platform::LockSnapshot::capture();
+        auto lockers = snapshot.lockersOf({dir.filePath("held.bin")});
+        bool foundSelf = false;
+        for(const auto& p : lockers)
+            foundSelf = foundSelf || p.pid == static_cast<quint64>(getpid());
+        QVERIFY(foundSelf);
+
+        QVERIFY(snapshot.lockersOf({dir.filePath("free.bin")}).isEmpty());
+        QVERIFY(snapshot.lockersOf({dir.filePath("missing.bin")}).isEmpty());
+    }
+
+    void lockSnapshotFindsMappedFile()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir dir(tempDir.path());
+        QVERIFY(createFile(dir, "lib.so", QByteArray(8192, 'x')));
+
+        // Map the file and close the descriptor, as the dynamic loader does.
+        int fd = ::open(QFile::encodeName(dir.filePath("lib.so")).constData(), O_RDONLY);
+        QVERIFY(fd >= 0);
+        void* mapping = ::mmap(nullptr, 8192, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        QVERIFY(mapping != MAP_FAILED);
+
+        auto lockers = Platform::LockSnapshot::capture().lockersOf({dir.filePath("lib.so")});
+        ::munmap(mapping, 8192);
+
+        bool foundSelf = false;
+        for(const auto& p : lockers)
+            foundSelf = foundSelf || p.pid == static_cast<quint64>(getpid());
+        QVERIFY(foundSelf);
+    }
+
+    void killProcessesAndWaitReturnsOnceExited()
+    {
+        pid_t child = ::fork();
+        QVERIFY(child >= 0);
+        if(child == 0)
+        {
+            ::pause();
+            ::_exit(0);
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+        QVERIFY(Platform::killProcessesAndWait({static_cast<quint64>(child)}, 5000));
+        QVERIFY(timer.elapsed() < 5000);
+
+        int status = 0;
+        QCOMPARE(::waitpid(child, &status, 0), child);
+        QVERIFY(WIFSIGNALED(status));
+    }
+
+    void killProcessesAndWaitGivesUpOnProcessItCannotSignal()
+    {
+        if(geteuid() == 0)
+            QSKIP("Running as root, every process can be signalled");
+
+        // init belongs to root, so SIGKILL fails with EPERM and there is nothing to wait for.
+        QElapsedTimer timer;
+        timer.start();
+        QVERIFY(!Platform::killProcessesAndWait({1}, 5000));
+        QVERIFY(timer.elapsed() < 1000);
+    }
+
+    void waitForLockReleaseWakesOnClose()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir dir(tempDir.path());
+        QVERIFY(createFile(dir, "held.bin", "content"));
+
+        pid_t child = ::fork();
+        QVERIFY(child >= 0);
+        if(child == 0)
+        {
+            int fd = ::open(QFile::encodeName(dir.filePath("held.bin")).constData(), O_RDONLY);
+            ::usleep(200 * 1000);
+            ::close(fd);
+            ::pause();
+            ::_exit(0);
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+        bool woken = Platform::waitForLockRelease({}, {dir.filePath("held.bin")}, 5000, {});
+        ::kill(child, SIGKILL);
+        ::waitpid(child, nullptr, 0);
+
+        QVERIFY(woken);
+        QVERIFY(timer.elapsed() < 5000);
+    }
+
+    void waitForLockReleaseHonoursTimeout()
+    {
+        QElapsedTimer timer;
+        timer.start();
+        QVERIFY(!Platform::waitForLockRelease({}, {}, 100, {}));
+        QVERIFY(timer.elapsed() >= 100);
+    }
+
+    void exchangePathsSwapsDirectories()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir dir(tempDir.path());
+
+        QVERIFY(createFile(dir, "current/version.txt", "1"));
+        QVERIFY(createFile(dir, "next/version.txt", "2"));
+
+        if(!Platform::exchangePaths(dir.filePath("next"), dir.filePath("current")))
+            QSKIP("renameat2(RENAME_EXCHANGE) is not supported on this filesystem");
+
+        QCOMPARE(readFileContent(dir.filePath("current/version.txt")), QByteArray("2"));
+        QCOMPARE(readFileContent(dir.filePath("next/version.txt")), QByteArray("1"));
+
+        QVERIFY(Platform::exchangePaths(dir.filePath("next"), dir.filePath("current")));
+        QCOMPARE(readFileContent(dir.filePath("current/version.txt")), QByteArray("1"));
+    }
+
+    void exchangePathsFailsWhenOneIsMissing()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir dir(tempDir.path());
+
+        QVERIFY(dir.mkpath("current"));
+        QVERIFY(!Platform::exchangePaths(dir.filePath("next"), dir.filePath("current")));
+        QVERIFY(dir.exists("current"));
+    }
+
+    void replaceSymlinkSwitchesAtomically()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir dir(tempDir.path());
+
+        QVERIFY(createFile(dir, "slots/A/version.txt", "1"));
+        QVERIFY(createFile(dir, "slots/B/version.txt", "2"));
+
+        QVERIFY(Platform::replaceSymlink(dir.filePath("current"), "slots/A"));
+        QCOMPARE(readFileContent(dir.filePath("current/version.txt")), QByteArray("1"));
+
+        QVERIFY(Platform::replaceSymlink(dir.filePath("current"), "slots/B"));
+        QCOMPARE(readFileContent(dir.filePath("current/version.txt")), QByteArray("2"));
+        QCOMPARE(QFileInfo(dir.filePath("current")).symLinkTarget(), dir.filePath("slots/B"));
+        QVERIFY(!QFileInfo::exists(dir.filePath("current.tmp")));
+        QCOMPARE(readFileContent(dir.filePath("slots/A/version.txt")), QByteArray("1"));
+    }
+
+    void deviceIdDistinguishesFilesystems()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir dir(tempDir.path());
+        QVERIFY(dir.mkpath("sub"));
+
+        auto root = Platform::deviceId(dir.absolutePath());
+        QVERIFY(root.has_value());
+        QCOMPARE(Platform::deviceId(dir.filePath("sub")), root);
+        // procfs is always its own mount.
+        QVERIFY(Platform::deviceId("/proc") != root);
+        QVERIFY(!Platform::deviceId(dir.filePath("missing")).has_value());
+    }
+
 #endif // Q_OS_LINUX
 };
 
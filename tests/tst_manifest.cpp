@@ -352,6 +352,27 @@ private slots:
         QVERIFY(!files.contains("updateInfo.ini"));
     }
 
+    void hashDirectoryReportsUnreadableFiles()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir dir(tempDir.path());
+
+        QVERIFY(createFile(dir, "ok.txt", "readable"));
+        QVERIFY(createFile(dir, "locked.bin", "unreadable"));
+        QFile::setPermissions(dir.filePath("locked.bin"), QFileDevice::WriteOwner);
+        if(QFile(dir.filePath("locked.bin")).open(QFile::ReadOnly))
+            QSKIP("File permissions do not prevent reading here (e.g. running as root)");
+
+        QStringList failed;
+        auto files = hashDirectory(dir, &failed);
+        QCOMPARE(files.size(), 1);
+        QVERIFY(files.contains("ok.txt"));
+        QCOMPARE(failed, QStringList{dir.absoluteFilePath("locked.bin")});
+
+        QFile::setPermissions(dir.filePath("locked.bin"), QFileDevice::ReadOwner | QFileDevice::WriteOwner);
+    }
+
     void hashDirectoryHandlesSubdirectories()
     {
         QTemporaryDir tempDir;
@@ -500,6 +521,170 @@ private slots:
                  "Non-string min_version should be silently ignored");
     }
 
+    void patchesAndBlocksRoundTrip()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+
+        Manifest original;
+        original.version = QVersionNumber(1, 0, 0);
+        original.appExe = "app.exe";
+        original.files.insert("big.dat", QByteArray::fromHex("0011"));
+
+        FilePatch patch;
+        patch.baseHash = QByteArray::fromHex("aabb");
+        patch.patchPath = ".patches/big.dat.patch";
+        original.patches["big.dat"].append(patch);
+
+        BlockChecksums sums;
+        sums.blockSize = 4096;
+        sums.fileSize = 5000;
+        sums.sums = QByteArray(2 * BlockChecksums::kSumSize, 'x');
+        original.blocks.insert("big.dat", sums);
+
+        QString path = QDir(tempDir.path()).filePath("manifest.json");
+        QVERIFY(writeManifest(path, original));
+
+        auto loaded = readManifest(path);
+        QVERIFY(loaded.has_value());
+        QCOMPARE(loaded->patches.value("big.dat").size(), 1);
+        QCOMPARE(loaded->patches.value("big.dat").first().baseHash, patch.baseHash);
+        QCOMPARE(loaded->patches.value("big.dat").first().patchPath, patch.patchPath);
+        QVERIFY(loaded->blocks.contains("big.dat"));
+        QCOMPARE(loaded->blocks.value("big.dat").blockSize, 4096);
+        QCOMPARE(loaded->blocks.value("big.dat").fileSize, qint64(5000));
+        QCOMPARE(loaded->blocks.value("big.dat").sums, sums.sums);
+    }
+
+    void readManifestIgnoresPatchesOutsideRelease()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QVERIFY(createFile(QDir(tempDir.path()), "manifest.json", R"({
+            "version": "1.0.0",
+            "files": {"a.dat": "AAAA", "b.dat": "AAAA", "c.dat": "AAAA", "d.dat": "AAAA"},
+            "patches": {
+                "a.dat": [{"from": "AAAA", "patch": "../../a.patch"}],
+                "b.dat": [{"from": "AAAA", "patch": "/etc/b.patch"}],
+                "c.dat": [{"from": "AAAA", "patch": "C:\\c.patch"}],
+                "d.dat": [{"from": "AAAA", "patch": ".patches/d.dat.patch"}]
+            }
+        })"));
+
+        auto loaded = readManifest(QDir(tempDir.path()).filePath("manifest.json"));
+        QVERIFY(loaded.has_value());
+        QCOMPARE(loaded->patches.size(), 1);
+        QCOMPARE(loaded->patches.value("d.dat").first().patchPath, QString(".patches/d.dat.patch"));
+    }
+
+    // ---- delta packages ----
+
+    void deltaDescriptorRoundTrip()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+
+        DeltaDescriptor original;
+        original.baseVersion = QVersionNumber(1, 0, 0);
+        original.version = QVersionNumber(1, 1, 0);
+        original.added << "new.txt";
+        original.updated << "lib/core.dll";
+        original.removed << "old.txt";
+        original.baseFiles.insert("lib/core.dll", QByteArray::fromHex("0102030405"));
+        original.baseFiles.insert("old.txt", QByteArray::fromHex("0a0b0c"));
+
+        QString path = QDir(tempDir.path()).filePath("delta.json");
+        QVERIFY(writeDeltaDescriptor(path, original));
+
+        auto loaded = readDeltaDescriptor(path);
+        QVERIFY(loaded.has_value());
+        QCOMPARE(loaded->baseVersion, original.baseVersion);
+        QCOMPARE(loaded->version, original.version);
+        QCOMPARE(loaded->added, original.added);
+        QCOMPARE(loaded->updated, original.updated);
+        QCOMPARE(loaded->removed, original.removed);
+        QCOMPARE(loaded->baseFiles, original.baseFiles);
+    }
+
+    void deltaDescriptorMissingBaseVersion()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QVERIFY(createFile(QDir(tempDir.path()), "delta.json", R"({"version": "1.1.0"})"));
+
+        auto loaded = readDeltaDescriptor(QDir(tempDir.path()).filePath("delta.json"));
+        QVERIFY(!loaded.has_value());
+    }
+
+    void writeDeltaPackageContainsOnlyChangedFiles()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir root(tempDir.path());
+        QDir oldDir(root.filePath("v1"));
+        QDir newDir(root.filePath("v2"));
+
+        QVERIFY(createFile(oldDir, "same.txt", "unchanged"));
+        QVERIFY(createFile(oldDir, "lib/core.dll", "core v1"));
+        QVERIFY(createFile(oldDir, "obsolete.txt", "gone in v2"));
+
+        QVERIFY(createFile(newDir, "same.txt", "unchanged"));
+        QVERIFY(createFile(newDir, "lib/core.dll", "core v2"));
+        QVERIFY(createFile(newDir, "assets/banner.png", "new in v2"));
+
+        Manifest base;
+        base.version = QVersionNumber(1, 0, 0);
+        base.appExe = "app.exe";
+        base.files = hashDirectory(oldDir);
+
+        Manifest release;
+        release.version = QVersionNumber(2, 0, 0);
+        release.appExe = "app.exe";
+        release.files = hashDirectory(newDir);
+
+        QDir packageDir(root.filePath("v2_delta_1.0.0"));
+        QVERIFY(writeDeltaPackage(newDir, release, base, packageDir));
+
+        QVERIFY(packageDir.exists("lib/core.dll"));
+        QVERIFY(packageDir.exists("assets/banner.png"));
+        QVERIFY(!packageDir.exists("same.txt"));
+        QVERIFY(!packageDir.exists("obsolete.txt"));
+
+        auto manifest = readManifest(packageDir.filePath("manifest.json"));
+        QVERIFY(manifest.has_value());
+        QCOMPARE(manifest->files, release.files);
+
+        auto delta = readDeltaDescriptor(packageDir.filePath("delta.json"));
+        QVERIFY(delta.has_value());
+        QCOMPARE(delta->baseVersion, QVersionNumber(1, 0, 0));
+        QCOMPARE(delta->added, QStringList{"assets/banner.png"});
+        QCOMPARE(delta->updated, QStringList{"lib/core.dll"});
+        QCOMPARE(delta->removed, QStringList{"obsolete.txt"});
+        QCOMPARE(delta->baseFiles.value("lib/core.dll"), base.files.value("lib/core.dll"));
+    }
+
+    void loadDeltaBaseFromManifestFile()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+
+        Manifest m;
+        m.version = QVersionNumber(1, 2, 0);
+        m.appExe = "app.exe";
+        m.files.insert("a.txt", QByteArray::fromHex("aa"));
+        QString path = QDir(tempDir.path()).filePath("manifest.json");
+        QVERIFY(writeManifest(path, m));
+
+        auto base = loadDeltaBase(path, "app.exe");
+        QVERIFY(base.has_value());
+        QCOMPARE(base->version, m.version);
+        QCOMPARE(base->files, m.files);
+
+        auto fromDir = loadDeltaBase(tempDir.path(), "app.exe");
+        QVERIFY(fromDir.has_value());
+        QCOMPARE(fromDir->version, m.version);
+    }
+
     // ---- version comparison ----
 
     void versionComparisonLogic()
@@ -0,0 +1,116 @@
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <QTest>
+#include <QThread>
+#include <atomic>
+
+#include "parallelextract.h"
+
+class TestParallelExtract : public QObject {
+    Q_OBJECT
+
+private slots:
+
+    void runsEveryJobLargestFirst()
+    {
+        QStringList order;
+        QList<ExtractJob> jobs;
+        for(int size : {10, 300, 20, 5000, 1})
+        {
+            QString name = QString::number(size);
+            jobs.append({name, size, [&order, name](QString*) {
+                order.append(name);
+                return true;
+            }});
+        }
+
+        QStringList reported;
+        auto done = [&](const ExtractJob& job, bool ok) {
+            QVERIFY(ok);
+            reported.append(job.name);
+        };
+        QString error;
+        // One thread, so the start order is the completion order.
+        QVERIFY(runExtractJobs(jobs, done, {}, &error, 1));
+        QCOMPARE(order, QStringList({"5000", "300", "20", "10", "1"}));
+        QCOMPARE(reported, order);
+        QVERIFY(error.isEmpty());
+    }
+
+    void emptyJobListSucceeds()
+    {
+        bool doneCalled = false;
+        QString error;
+        QVERIFY(runExtractJobs({}, [&](const ExtractJob&, bool) { doneCalled = true; }, {}, &error));
+        QVERIFY(!doneCalled);
+        QVERIFY(error.isEmpty());
+    }
+
+    void runsOnSeveralThreads()
+    {
+        QMutex mutex;
+        QSet<Qt::HANDLE> threads;
+        std::atomic<int> running{0};
+        QList<ExtractJob> jobs;
+        for(int i = 0; i < 8; ++i)
+        {
+            jobs.append({QString::number(i), 1, [&](QString*) {
+                ++running;
+                // Hold each job until another one has started, or give up after a while.
+                for(int wait = 0; wait < 100 && running < 2; ++wait)
+                    QThread::msleep(5);
+                QMutexLocker locker(&mutex);
+                threads.insert(QThread::currentThreadId());
+                return true;
+            }});
+        }
+
+        QVERIFY(runExtractJobs(jobs, {}, {}, nullptr, 4));
+        QVERIFY(threads.size() > 1);
+    }
+
+    void stopsAtFirstFailure()
+    {
+        std::atomic<int> ran{0};
+        QList<ExtractJob> jobs;
+        jobs.append({"big", 100, [&](QString* error) {
+            ++ran;
+            *error = "disk full";
+            return false;
+        }});
+        for(int i = 0; i < 5; ++i)
+        {
+            jobs.append({QString::number(i), 1, [&](QString*) {
+                ++ran;
+                return true;
+            }});
+        }
+
+        QString error;
+        QVERIFY(!runExtractJobs(jobs, {}, {}, &error, 1));
+        QCOMPARE(error, QString("disk full"));
+        QCOMPARE(ran.load(), 1);
+    }
+
+    void stopsWhenCancelled()
+    {
+        std::atomic<int> ran{0};
+        QList<ExtractJob> jobs;
+        for(int i = 0; i < 5; ++i)
+        {
+            jobs.append({QString::number(i), 1, [&](QString*) {
+                ++ran;
+                return true;
+            }});
+        }
+
+        QString error;
+        QVERIFY(!runExtractJobs(jobs, {}, [&ran]() { return ran >= 2; }, &error, 1));
+        QCOMPARE(ran.load(), 2);
+        QVERIFY(error.isEmpty());
+    }
+};
+
+QTEST_GUILESS_MAIN(TestParallelExtract)
+#include "tst_parallelextract.moc"
@@ -0,0 +1,171 @@
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QObject>
+#include <QTemporaryDir>
+#include <QTest>
+
+#include "stagingjournal.h"
+
+static bool createFile(const QDir& dir, const QString& relPath, const QByteArray& content)
+{
+    QString fullPath = dir.filePath(relPath);
+    QDir().mkpath(QFileInfo(fullPath).absolutePath());
+    QFile file(fullPath);
+    if(!file.open(QFile::WriteOnly))
+        return false;
+    file.write(content);
+    file.close();
+    return true;
+}
+
+static QByteArray sha256(const QByteArray& content)
+{
+    return QCryptographicHash::hash(content, QCryptographicHash::Sha256);
+}
+
+class TestStagingJournal : public QObject {
+    Q_OBJECT
+
+private slots:
+
+    // ---- keyFor ----
+
+    void keyDependsOnVersionAndFiles()
+    {
+        Manifest a;
+        a.version = QVersionNumber(1, 2, 0);
+        a.files.insert("app.exe", sha256("one"));
+
+        Manifest b = a;
+        QCOMPARE(StagingJournal::keyFor(a), StagingJournal::keyFor(b));
+        QVERIFY(StagingJournal::keyFor(a).startsWith("1.2.0_"));
+
+        b.files.insert("app.exe", sha256("two"));
+        QVERIFY(StagingJournal::keyFor(a) != StagingJournal::keyFor(b));
+
+        b = a;
+        b.version = QVersionNumber(1, 3, 0);
+        QVERIFY(StagingJournal::keyFor(a) != StagingJournal::keyFor(b));
+    }
+
+    // ---- open / record / stagedFiles ----
+
+    void reopenWithSameKeyResumes()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir dir(tempDir.path());
+        QDir staging(dir.filePath("staging"));
+        QString journalPath = dir.filePath("staging.journal");
+
+        QVERIFY(createFile(staging, "app.exe", "binary"));
+        QVERIFY(createFile(staging, "data/with space.txt", "data"));
+        QHash<QString, QByteArray> expected{{"app.exe", sha256("binary")},
+                                            {"data/with space.txt", sha256("data")},
+                                            {"never.txt", sha256("never")}};
+        {
+            StagingJournal journal;
+            QVERIFY(journal.open(journalPath, "1.0_abc"));
+            QVERIFY(!journal.isResumed());
+            journal.record(staging, "app.exe", expected.value("app.exe"));
+            journal.record(staging, "data/with space.txt", expected.value("data/with space.txt"));
+        }
+
+        StagingJournal journal;
+        QVERIFY(journal.open(journalPath, "1.0_abc"));
+        QVERIFY(journal.isResumed());
+        QStringList staged = journal.stagedFiles(staging, expected);
+        staged.sort();
+        QCOMPARE(staged, (QStringList{"app.exe", "data/with space.txt"}));
+    }
+
+    void changedFileIsNotReused()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir dir(tempDir.path());
+        QDir staging(dir.filePath("staging"));
+        QString journalPath = dir.filePath("staging.journal");
+
+        QVERIFY(createFile(staging, "app.exe", "binary"));
+        QHash<QString, QByteArray> expected{{"app.exe", sha256("binary")}};
+        {
+            StagingJournal journal;
+            QVERIFY(journal.open(journalPath, "key"));
+            journal.record(staging, "app.exe", expected.value("app.exe"));
+        }
+
+        QVERIFY(createFile(staging, "app.exe", "truncated"));
+
+        StagingJournal journal;
+        QVERIFY(journal.open(journalPath, "key"));
+        QVERIFY(journal.stagedFiles(staging, expected).isEmpty());
+    }
+
+    void differentKeyStartsAfresh()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir dir(tempDir.path());
+        QDir staging(dir.filePath("staging"));
+        QString journalPath = dir.filePath("staging.journal");
+
+        QVERIFY(createFile(staging, "app.exe", "binary"));
+        QHash<QString, QByteArray> expected{{"app.exe", sha256("binary")}};
+        {
+            StagingJournal journal;
+            QVERIFY(journal.open(journalPath, "old"));
+            journal.record(staging, "app.exe", expected.value("app.exe"));
+        }
+
+        StagingJournal journal;
+        QVERIFY(journal.open(journalPath, "new"));
+        QVERIFY(!journal.isResumed());
+        QVERIFY(journal.stagedFiles(staging, expected).isEmpty());
+    }
+
+    void partialLastLineIsIgnored()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir dir(tempDir.path());
+        QDir staging(dir.filePath("staging"));
+        QString journalPath = dir.filePath("staging.journal");
+
+        QVERIFY(createFile(staging, "a.txt", "a"));
+        QHash<QString, QByteArray> expected{{"a.txt", sha256("a")}, {"b.txt", sha256("b")}};
+        {
+            StagingJournal journal;
+            QVERIFY(journal.open(journalPath, "key"));
+            journal.record(staging, "a.txt", expected.value("a.txt"));
+        }
+        {
+            QFile file(journalPath);
+            QVERIFY(file.open(QFile::Append));
+            file.write(sha256("b").toHex() + " 1 12");
+        }
+
+        StagingJournal journal;
+        QVERIFY(journal.open(journalPath, "key"));
+        QVERIFY(journal.isResumed());
+        QCOMPARE(journal.stagedFiles(staging, expected), QStringList{"a.txt"});
+    }
+
+    void removeDeletesJournal()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QString journalPath = QDir(tempDir.path()).filePath("staging.journal");
+
+        StagingJournal journal;
+        QVERIFY(journal.open(journalPath, "key"));
+        QVERIFY(QFile::exists(journalPath));
+        journal.remove();
+        QVERIFY(!QFile::exists(journalPath));
+    }
+};
+
+QTEST_GUILESS_MAIN(TestStagingJournal)
+#include "tst_stagingjournal.moc"
@@ -0,0 +1,264 @@
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QObject>
+#include <QScopeGuard>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QThread>
+
+#include "applyjournal.h"
+#include "platform/platform.h"
+#include "updatecontroller.h"
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static bool createFile(const QDir& dir, const QString& relPath, const QByteArray& content)
+{
+    QString fullPath = dir.filePath(relPath);
+    QDir().mkpath(QFileInfo(fullPath).absolutePath());
+    QFile file(fullPath);
+    if(!file.open(QFile::WriteOnly))
+        return false;
+    file.write(content);
+    file.close();
+    return true;
+}
+
+static QByteArray readFileContent(const QString& path)
+{
+    QFile file(path);
+    if(!file.open(QFile::ReadOnly))
+        return {};
+    return file.readAll();
+}
+
+struct ExecuteResult {
+    bool finished = false;
+    bool success = false;
+    QStringList prompted;  // processes listed by the lock prompts
+};
+
+// Runs execute() on a worker thread, as the GUI does, and cancels at every lock prompt.
+static ExecuteResult executeCancellingLockPrompts(UpdateController& controller)
+{
+    ExecuteResult result;
+    QObject context;
+    QObject::connect(&controller, &UpdateController::processLockDetected, &context,
+                     [&result](const QStringList& processes) { result.prompted += processes; });
+    QObject::connect(&controller, &UpdateController::updateFinished, &context,
+                     [&result](bool success) { result.finished = true; result.success = success; });
+
+    QScopedPointer<QThread> worker(QThread::create([&controller]() { controller.execute(); }));
+    worker->start();
+    // An answer given before the worker waits for it is lost, so keep answering.
+    while(!worker->wait(50))
+    {
+        QCoreApplication::processEvents();
+        if(!result.prompted.isEmpty())
+            controller.respondToLockPrompt(LockAction::Cancel);
+    }
+    QCoreApplication::processEvents();
+    return result;
+}
+
+// Fork a child that holds path open until killed. Returns its pid once the lock is
+// visible, or -1.
+static pid_t holdOpenInChild(const QString& path)
+{
+    QByteArray encoded = QFile::encodeName(path);
+    pid_t child = ::fork();
+    if(child == 0)
+    {
+        if(::open(encoded.constData(), O_RDONLY) < 0)
+            ::_exit(1);
+        ::pause();
+        ::_exit(0);
+    }
+    if(child < 0)
+        return -1;
+
+    for(int attempt = 0; attempt < 100; ++attempt)
+    {
+        for(const auto& p : Platform::findLockingProcesses({path}))
+        {
+            if(p.pid == static_cast<quint64>(child))
+                return child;
+        }
+        QThread::msleep(20);
+    }
+    ::kill(child, SIGKILL);
+    ::waitpid(child, nullptr, 0);
+    return -1;
+}
+
+static void killChild(pid_t child)
+{
+    ::kill(child, SIGKILL);
+    ::waitpid(child, nullptr, 0);
+}
+#endif // Q_OS_LINUX
+
+class TestUpdateController : public QObject {
+    Q_OBJECT
+
+private slots:
+
+#ifdef Q_OS_LINUX
+
+    // ---- lock preflight ----
+
+    void preflightCancelLeavesTargetUntouched()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir root(tempDir.path());
+        QDir sourceDir(root.filePath("source"));
+        QDir targetDir(root.filePath("target"));
+        QVERIFY(createFile(sourceDir, "app.dat", "new"));
+        QVERIFY(createFile(sourceDir, "added.dat", "added"));
+        QVERIFY(createFile(targetDir, "app.dat", "old"));
+
+        pid_t child = holdOpenInChild(targetDir.filePath("app.dat"));
+        QVERIFY(child > 0);
+        auto cleanup = qScopeGuard([child]() { killChild(child); });
+
+        UpdateController controller;
+        controller.setSourceDir(sourceDir);
+        controller.setTargetDir(targetDir);
+        controller.prepare();
+        ExecuteResult result = executeCancellingLockPrompts(controller);
+
+        QCOMPARE(result.prompted.size(), 1);
+        QVERIFY(result.prompted.first().contains(QString::number(child)));
+        QVERIFY(result.finished);
+        QVERIFY(!result.success);
+        QVERIFY(controller.isCancelled());
+        // Cancelled before staging: nothing was replaced or added.
+        QCOMPARE(readFileContent(targetDir.filePath("app.dat")), QByteArray("old"));
+        QVERIFY(!QFile::exists(targetDir.filePath("added.dat")));
+    }
+
+    void preflightChecksStaleFiles()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir root(tempDir.path());
+        QDir sourceDir(root.filePath("source"));
+        QDir targetDir(root.filePath("target"));
+        QVERIFY(createFile(sourceDir, "app.dat", "new"));
+        QVERIFY(createFile(targetDir, "app.dat", "old"));
+        // Symlinks are not hashed, so one missing from the source is cleaned up as stale.
+        QVERIFY(createFile(root, "outside.dat", "outside"));
+        QVERIFY(QFile::link(root.filePath("outside.dat"), targetDir.filePath("link.dat")));
+
+        pid_t child = holdOpenInChild(root.filePath("outside.dat"));
+        QVERIFY(child > 0);
+        auto cleanup = qScopeGuard([child]() { killChild(child); });
+
+        UpdateController controller;
+        controller.setSourceDir(sourceDir);
+        controller.setTargetDir(targetDir);
+        controller.prepare();
+        ExecuteResult result = executeCancellingLockPrompts(controller);
+
+        QCOMPARE(controller.fileDiff().stale, QStringList({"link.dat"}));
+        QCOMPARE(result.prompted.size(), 1);
+        QVERIFY(result.finished);
+        QVERIFY(!result.success);
+        QCOMPARE(readFileContent(targetDir.filePath("app.dat")), QByteArray("old"));
+        QVERIFY(QFileInfo(targetDir.filePath("link.dat")).isSymLink());
+    }
+
+    // ---- apply journal ----
+
+    void updateStopsWhenRecoveryFailed()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir root(tempDir.path());
+        QDir sourceDir(root.filePath("source"));
+        QDir targetDir(root.filePath("target"));
+        QDir oldStaging(root.filePath("old_staging"));
+        QVERIFY(createFile(sourceDir, "app.dat", "new"));
+        QVERIFY(createFile(targetDir, "app.dat", "old"));
+
+        // An earlier apply died after backing up lib.dat, and a directory now blocks
+        // its restore.
+        QVERIFY(createFile(targetDir, "lib.dat/inside.txt", "blocker"));
+        QVERIFY(createFile(targetDir, "lib.dat.bak", "original lib"));
+        QVERIFY(createFile(oldStaging, "lib.dat", "new lib"));
+        {
+            ApplyJournal journal(Durability::None);
+            QVERIFY(journal.begin(targetDir, oldStaging, {"lib.dat"}, {}));
+            journal.backupsDone();
+        }
+        QCOMPARE(ApplyJournal::recover(targetDir), ApplyJournal::Recovery::Failed);
+        QByteArray kept = readFileContent(ApplyJournal::pathFor(targetDir));
+
+        UpdateController controller;
+        controller.setSourceDir(sourceDir);
+        controller.setTargetDir(targetDir);
+        controller.prepare();
+        QSignalSpy finished(&controller, &UpdateController::updateFinished);
+        controller.execute();
+
+        QCOMPARE(finished.count(), 1);
+        QCOMPARE(finished.first().first().toBool(), false);
+        QCOMPARE(readFileContent(ApplyJournal::pathFor(targetDir)), kept);
+        QCOMPARE(readFileContent(targetDir.filePath("lib.dat.bak")), QByteArray("original lib"));
+        QCOMPARE(readFileContent(targetDir.filePath("app.dat")), QByteArray("old"));
+        QVERIFY(!QFile::exists(targetDir.filePath("app.dat.bak")));
+    }
+
+    // ---- swap apply ----
+
+    void swapKeepsDirectorySymlinksAndModes()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir root(tempDir.path());
+        QDir sourceDir(root.filePath("source"));
+        QDir targetDir(root.filePath("target"));
+        for(const QDir& dir : {sourceDir, targetDir})
+        {
+            QVERIFY(createFile(dir, "real/inside.dat", "inside"));
+            QVERIFY(createFile(dir, "private/secret.dat", "secret"));
+        }
+        QVERIFY(createFile(sourceDir, "app.dat", "new"));
+        QVERIFY(createFile(targetDir, "app.dat", "old"));
+        // Not part of any release: a relative link to a directory and a private directory.
+        QVERIFY(QFile::link("real", targetDir.filePath("linked")));
+        const QFile::Permissions privateMode = QFileDevice::ReadOwner | QFileDevice::WriteOwner
+                                               | QFileDevice::ExeOwner | QFileDevice::ReadUser
+                                               | QFileDevice::WriteUser | QFileDevice::ExeUser;
+        QVERIFY(QFile::setPermissions(targetDir.filePath("private"), privateMode));
+
+        UpdateController controller;
+        controller.setSourceDir(sourceDir);
+        controller.setTargetDir(targetDir);
+        controller.setSwapApply(true);
+        controller.prepare();
+        QSignalSpy finished(&controller, &UpdateController::updateFinished);
+        controller.execute();
+
+        QCOMPARE(finished.count(), 1);
+        QVERIFY(finished.first().first().toBool());
+        QCOMPARE(readFileContent(targetDir.filePath("app.dat")), QByteArray("new"));
+        QVERIFY(QFileInfo(targetDir.filePath("linked")).isSymLink());
+        QCOMPARE(Platform::readSymlink(targetDir.filePath("linked")).value_or(QString()), QString("real"));
+        QCOMPARE(readFileContent(targetDir.filePath("linked/inside.dat")), QByteArray("inside"));
+        QCOMPARE(QFileInfo(targetDir.filePath("private")).permissions(), privateMode);
+    }
+
+#endif // Q_OS_LINUX
+};
+
+QTEST_GUILESS_MAIN(TestUpdateController)
+#include "tst_updatecontroller.moc"
@@ -0,0 +1,258 @@
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QObject>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QtEndian>
+
+#include <zlib.h>
+
+#include "ziparchive.h"
+
+struct ZipInput {
+    QString name;
+    QByteArray content;
+    bool deflate = true;
+    quint32 unixMode = 0;
+};
+
+static void append16(QByteArray& out, quint16 value)
+{
+    char buf[2];
+    qToLittleEndian(value, buf);
+    out.append(buf, 2);
+}
+
+static void append32(QByteArray& out, quint32 value)
+{
+    char buf[4];
+    qToLittleEndian(value, buf);
+    out.append(buf, 4);
+}
+
+static QByteArray rawDeflate(const QByteArray& data)
+{
+    z_stream stream{};
+    deflateInit2(&stream, Z_BEST_SPEED, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    QByteArray out(int(deflateBound(&stream, uLong(data.size()))), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.constData()));
+    stream.avail_in = uInt(data.size());
+    stream.next_out = reinterpret_cast<Bytef*>(out.data());
+    stream.avail_out = uInt(out.size());
+    deflate(&stream, Z_FINISH);
+    out.resize(int(stream.total_out));
+    deflateEnd(&stream);
+    return out;
+}
+
+// Minimal zip writer: local headers and data, then the central directory.
+static QByteArray makeZip(const QList<ZipInput>& inputs)
+{
+    QByteArray zip, central;
+    for(const auto& input : inputs)
+    {
+        QByteArray name = input.name.toUtf8();
+        QByteArray data = input.deflate ? rawDeflate(input.content) : input.content;
+        quint16 method = input.deflate ? 8 : 0;
+        quint32 crc = quint32(crc32(0L, reinterpret_cast<const Bytef*>(input.content.constData()),
+                                    uInt(input.content.size())));
+        quint32 offset = quint32(zip.size());
+
+        append32(zip, 0x04034b50);
+        append16(zip, 20);
+        append16(zip, 0);
+        append16(zip, method);
+        append32(zip, 0);
+        append32(zip, crc);
+        append32(zip, quint32(data.size()));
+        append32(zip, quint32(input.content.size()));
+        append16(zip, quint16(name.size()));
+        append16(zip, 0);
+        zip += name + data;
+
+        append32(central, 0x02014b50);
+        append16(central, input.unixMode ? (3 << 8) | 20 : 20);
+        append16(central, 20);
+        append16(central, 0);
+        append16(central, method);
+        append32(central, 0);
+        append32(central, crc);
+        append32(central, quint32(data.size()));
+        append32(central, quint32(input.content.size()));
+        append16(central, quint16(name.size()));
+        append16(central, 0);
+        append16(central, 0);
+        append16(central, 0);
+        append16(central, 0);
+        append32(central, input.unixMode << 16);
+        append32(central, offset);
+        central += name;
+    }
+
+    quint32 centralOffset = quint32(zip.size());
+    zip += central;
+    append32(zip, 0x06054b50);
+    append16(zip, 0);
+    append16(zip, 0);
+    append16(zip, quint16(inputs.size()));
+    append16(zip, quint16(inputs.size()));
+    append32(zip, quint32(central.size()));
+    append32(zip, centralOffset);
+    append16(zip, 0);
+    return zip;
+}
+
+static bool writeFile(const QString& path, const QByteArray& content)
+{
+    QFile file(path);
+    if(!file.open(QFile::WriteOnly))
+        return false;
+    file.write(content);
+    return true;
+}
+
+static QByteArray readFileContent(const QString& path)
+{
+    QFile file(path);
+    if(!file.open(QFile::ReadOnly))
+        return {};
+    return file.readAll();
+}
+
+class TestZipArchive : public QObject {
+    Q_OBJECT
+
+private slots:
+
+    // ---- open ----
+
+    void openListsEntries()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QString zipPath = tempDir.filePath("release.zip");
+        QVERIFY(writeFile(zipPath, makeZip({{"app/", {}, false}, {"app/a.txt", "aaa"}})));
+
+        ZipArchive archive;
+        QVERIFY2(archive.open(zipPath), qPrintable(archive.errorString()));
+        QCOMPARE(archive.entries().size(), 2);
+        QVERIFY(archive.entries()[0].isDirectory());
+        QVERIFY(archive.entry("app/a.txt"));
+        QCOMPARE(archive.entry("app/a.txt")->size, qint64(3));
+        QVERIFY(!archive.entry("missing.txt"));
+    }
+
+    void openRejectsNonZip()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QString path = tempDir.filePath("not.zip");
+        QVERIFY(writeFile(path, QByteArray(100, 'x')));
+
+        ZipArchive archive;
+        QVERIFY(!archive.open(path));
+        QVERIFY(!archive.errorString().isEmpty());
+    }
+
+    void openRejectsEscapingPaths()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QString zipPath = tempDir.filePath("evil.zip");
+        QVERIFY(writeFile(zipPath, makeZip({{"ok.txt", "fine"}, {"../evil.txt", "boom"}})));
+
+        ZipArchive archive;
+        QVERIFY(!archive.open(zipPath));
+        QVERIFY(archive.errorString().contains("../evil.txt"));
+    }
+
+    void openRejectsAliasedAndDuplicatePaths()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir dir(tempDir.path());
+
+        const QList<QList<ZipInput>> archives = {
+            {{"a/b.txt", "one"}, {"a/b.txt", "two"}},
+            {{"a//b.txt", "one"}},
+            {{"./a/b.txt", "one"}},
+            {{"a/./b.txt", "one"}},
+        };
+        for(const auto& inputs : archives)
+        {
+            QString zipPath = dir.filePath("aliased.zip");
+            QVERIFY(writeFile(zipPath, makeZip(inputs)));
+            ZipArchive archive;
+            QVERIFY2(!archive.open(zipPath), qPrintable(inputs.last().name));
+        }
+    }
+
+    // ---- extract ----
+
+    void extractStoredAndDeflated()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir dir(tempDir.path());
+        // Larger than one output chunk, to cover the inflate loop.
+        QByteArray big;
+        for(int i = 0; i < 100000; ++i)
+            big += QByteArray::number(i) + ' ';
+        QString zipPath = dir.filePath("release.zip");
+        QVERIFY(writeFile(zipPath, makeZip({{"stored.txt", "plain", false}, {"big.txt", big}})));
+
+        ZipArchive archive;
+        QVERIFY(archive.open(zipPath));
+
+        QByteArray hash;
+        QString error;
+        QVERIFY2(archive.extract(*archive.entry("big.txt"), dir.filePath("big.txt"), &hash, &error),
+                 qPrintable(error));
+        QCOMPARE(readFileContent(dir.filePath("big.txt")), big);
+        QCOMPARE(hash, QCryptographicHash::hash(big, QCryptographicHash::Sha256));
+
+        QVERIFY(archive.extract(*archive.entry("stored.txt"), dir.filePath("stored.txt")));
+        QCOMPARE(readFileContent(dir.filePath("stored.txt")), QByteArray("plain"));
+        QCOMPARE(archive.read(*archive.entry("stored.txt")).value_or(QByteArray()), QByteArray("plain"));
+    }
+
+    void extractDetectsCorruptData()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir dir(tempDir.path());
+        QByteArray zip = makeZip({{"a.txt", "stored content", false}});
+        // Flip a byte of the stored data: the CRC no longer matches.
+        zip[30 + 5 + 3] = zip[30 + 5 + 3] ^ 0x20;
+        QString zipPath = dir.filePath("corrupt.zip");
+        QVERIFY(writeFile(zipPath, zip));
+
+        ZipArchive archive;
+        QVERIFY(archive.open(zipPath));
+        QString error;
+        QVERIFY(!archive.extract(*archive.entry("a.txt"), dir.filePath("a.txt"), nullptr, &error));
+        QVERIFY(error.contains("CRC"));
+        QVERIFY(!QFile::exists(dir.filePath("a.txt")));
+    }
+
+#ifdef Q_OS_UNIX
+    void extractRestoresExecutableBit()
+    {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QDir dir(tempDir.path());
+        QString zipPath = dir.filePath("release.zip");
+        QVERIFY(writeFile(zipPath, makeZip({{"run.sh", "#!/bin/sh\n", true, 0100755}})));
+
+        ZipArchive archive;
+        QVERIFY(archive.open(zipPath));
+        QVERIFY(archive.extract(*archive.entry("run.sh"), dir.filePath("run.sh")));
+        QVERIFY(QFileInfo(dir.filePath("run.sh")).isExecutable());
+    }
+#endif
+};
+
+QTEST_GUILESS_MAIN(TestZipArchive)
+#include "tst_ziparchive.moc"